@@ -0,0 +1,411 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   bench_pmemops.cc
+ * @date   octobre 14, 2026
+ * @brief  Latency and bandwidth of the pmemops backends
+ *
+ * Sweeps over sizes, thread counts and NUMA nodes and runs flush, persist,
+ * streaming_wr, memcpy and memset on every backend the CPU supports. Run with
+ * --help for the options.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <numa.h>
+#include <sstream>
+#include <string>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "nvsl/clock.hh"
+#include "nvsl/constants.hh"
+#include "nvsl/cpu.hh"
+#include "nvsl/pmemops.hh"
+#include "nvsl/string.hh"
+
+using nvsl::SZ;
+
+namespace {
+  /** @brief Bytes touched by a single timed sample of small operations */
+  constexpr size_t BATCH_BYTES = 64 * SZ::KiB;
+
+  enum class Op { flush, persist, streaming_wr, memcpy, memset };
+
+  const std::vector<std::pair<Op, std::string>> ALL_OPS = {
+      {Op::flush, "flush"},
+      {Op::persist, "persist"},
+      {Op::streaming_wr, "streaming_wr"},
+      {Op::memcpy, "memcpy"},
+      {Op::memset, "memset"},
+  };
+
+  struct Config {
+    size_t min_size = 8;
+    size_t max_size = 64 * SZ::MiB;
+    std::vector<size_t> threads = {1};
+    std::vector<int> nodes = {-1}; /* -1: don't bind */
+    std::vector<std::string> backends, ops; /* Empty: all */
+    size_t min_samples = 10;
+    size_t budget = 256 * SZ::MiB; /* Bytes per thread per data point */
+    std::string format = "text";
+    std::string dir; /* Directory for file backed buffers */
+  };
+
+  struct Result {
+    std::string backend, op;
+    size_t size, threads;
+    int node;
+    size_t ops; /* Per thread */
+    double ns_per_op, gb_per_s;
+    size_t p50, p90, p99; /* Worst thread, ns/op */
+    std::string summary;
+  };
+
+  /** @brief Page aligned buffer, optionally on a NUMA node or in a file */
+  class Buffer {
+  private:
+    char *addr = nullptr;
+    size_t size = 0;
+
+  public:
+    Buffer(size_t size, int node, const std::string &dir) : size(size) {
+      int fd = -1, flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+      if (not dir.empty()) {
+        auto path = dir + "/nvsl-bench-XXXXXX";
+        fd = mkstemp(path.data());
+        if (fd == -1 or ftruncate(fd, size) != 0) {
+          std::cerr << "Unable to create " << path << ": " << strerror(errno)
+                    << std::endl;
+          exit(1);
+        }
+        unlink(path.c_str());
+        flags = MAP_SHARED;
+      }
+
+      void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, fd, 0);
+      if (fd != -1) close(fd);
+
+      if (map == MAP_FAILED) {
+        std::cerr << "mmap(" << size << ") failed: " << strerror(errno)
+                  << std::endl;
+        exit(1);
+      }
+
+      addr = (char *)map;
+      if (node >= 0 and dir.empty()) {
+        numa_tonode_memory(addr, size, node);
+      }
+
+      /* Fault in all the pages before timing anything */
+      memset(addr, 0xAB, size);
+    }
+
+    Buffer(const Buffer &) = delete;
+    Buffer &operator=(const Buffer &) = delete;
+
+    ~Buffer() { munmap(addr, size); }
+
+    char *get() const { return addr; }
+  };
+
+  [[noreturn]] void usage(const char *prog, int code) {
+    std::cerr
+        << "Usage: " << prog << " [options]\n"
+        << "  --min-size SZ     Smallest operation (default 8)\n"
+        << "  --max-size SZ     Largest operation (default 64M)\n"
+        << "  --threads N,..    Thread counts to sweep (default 1)\n"
+        << "  --nodes N,..|all  NUMA nodes to place threads and memory on\n"
+        << "  --backends B,..   clwb,clflushopt,clflush,msync,nopersist\n"
+        << "  --ops O,..        flush,persist,streaming_wr,memcpy,memset\n"
+        << "  --budget SZ       Bytes per thread per data point (default "
+           "256M)\n"
+        << "  --min-samples N   Minimum timed samples per point (default 10)\n"
+        << "  --dir PATH        Use files in PATH (e.g., a DAX mount)\n"
+        << "  --format F        text, csv or json (default text)\n"
+        << "Sizes take K, M and G suffixes. Sizes are swept in powers of 2.\n";
+    exit(code);
+  }
+
+  size_t parse_size(const std::string &str) {
+    size_t idx = 0;
+    size_t result = std::stoul(str, &idx);
+
+    if (idx < str.size()) {
+      switch (toupper(str[idx])) {
+      case 'G': result *= SZ::GiB; break;
+      case 'M': result *= SZ::MiB; break;
+      case 'K': result *= SZ::KiB; break;
+      default:
+        std::cerr << "Unknown size suffix in " << str << std::endl;
+        exit(1);
+      }
+    }
+
+    return result;
+  }
+
+  Config parse_args(int argc, char *argv[]) {
+    Config cfg;
+
+    for (int i = 1; i < argc; i++) {
+      const std::string arg = argv[i];
+
+      if (arg == "--help" or arg == "-h") usage(argv[0], 0);
+      if (i + 1 >= argc) usage(argv[0], 1);
+
+      const std::string val = argv[++i];
+
+      if (arg == "--min-size") {
+        cfg.min_size = parse_size(val);
+      } else if (arg == "--max-size") {
+        cfg.max_size = parse_size(val);
+      } else if (arg == "--threads") {
+        cfg.threads.clear();
+        for (const auto &tok : nvsl::split(val, ",")) {
+          cfg.threads.push_back(std::stoul(tok));
+        }
+      } else if (arg == "--nodes") {
+        cfg.nodes.clear();
+        if (val == "all") {
+          for (int node = 0; node <= numa_max_node(); node++) {
+            cfg.nodes.push_back(node);
+          }
+        } else {
+          for (const auto &tok : nvsl::split(val, ",")) {
+            cfg.nodes.push_back(std::stoi(tok));
+          }
+        }
+      } else if (arg == "--backends") {
+        cfg.backends = nvsl::split(val, ",");
+      } else if (arg == "--ops") {
+        cfg.ops = nvsl::split(val, ",");
+      } else if (arg == "--budget") {
+        cfg.budget = parse_size(val);
+      } else if (arg == "--min-samples") {
+        cfg.min_samples = std::stoul(val);
+      } else if (arg == "--dir") {
+        cfg.dir = val;
+      } else if (arg == "--format") {
+        cfg.format = val;
+      } else {
+        usage(argv[0], 1);
+      }
+    }
+
+    /* Clock::summarize() divides by the number of samples */
+    cfg.min_samples = std::max(cfg.min_samples, 1UL);
+
+    return cfg;
+  }
+
+  bool selected(const std::vector<std::string> &list, const std::string &name) {
+    return list.empty() or
+           std::find(list.begin(), list.end(), name) != list.end();
+  }
+
+  std::vector<std::pair<std::string, std::unique_ptr<nvsl::PMemOps>>>
+  make_backends(const Config &cfg) {
+    std::vector<std::pair<std::string, std::unique_ptr<nvsl::PMemOps>>> result;
+    const auto &cpu = nvsl::cpu_features();
+
+    if (cpu.clwb and selected(cfg.backends, "clwb")) {
+      result.emplace_back("clwb", new nvsl::PMemOpsClwb());
+    }
+    if (cpu.clflushopt and selected(cfg.backends, "clflushopt")) {
+      result.emplace_back("clflushopt", new nvsl::PMemOpsClflushOpt());
+    }
+    if (cpu.clflush and selected(cfg.backends, "clflush")) {
+      result.emplace_back("clflush", new nvsl::PMemOpsClflush());
+    }
+    if (selected(cfg.backends, "msync")) {
+      result.emplace_back("msync", new nvsl::PMemOpsMsync());
+    }
+    if (selected(cfg.backends, "nopersist")) {
+      result.emplace_back("nopersist", new nvsl::PMemOpsNoPersist());
+    }
+
+    return result;
+  }
+
+  inline void run_op(const nvsl::PMemOps *pmemops, Op op, char *dst, char *src,
+                     size_t size, int sample) {
+    switch (op) {
+    case Op::flush: pmemops->flush(dst, size); break;
+    case Op::persist: pmemops->persist(dst, size); break;
+    case Op::streaming_wr: pmemops->streaming_wr(dst, src, size); break;
+    case Op::memcpy: pmemops->memcpy(dst, src, size); break;
+    case Op::memset: pmemops->memset(dst, (char)sample, size); break;
+    }
+  }
+
+  Result run_point(const Config &cfg, const std::string &backend_name,
+                   const nvsl::PMemOps *pmemops, Op op,
+                   const std::string &op_name, size_t size, size_t threads,
+                   int node) {
+    /* Small operations are batched over distinct cachelines and timed
+       together, Clock::summarize() divides the percentiles by the batch */
+    const size_t stride = (size + nvsl::CL_SIZE - 1) & ~(nvsl::CL_SIZE - 1);
+    const size_t batch = std::max(1UL, BATCH_BYTES / stride);
+    const size_t region = stride * batch;
+    const size_t samples = std::max(cfg.min_samples, cfg.budget / region);
+    const bool dirty_first = (op == Op::flush or op == Op::persist);
+    const bool needs_src = (op == Op::streaming_wr or op == Op::memcpy);
+
+    std::vector<std::unique_ptr<Buffer>> dsts, srcs;
+    for (size_t t = 0; t < threads; t++) {
+      dsts.emplace_back(new Buffer(region, node, cfg.dir));
+      if (needs_src) srcs.emplace_back(new Buffer(region, node, ""));
+    }
+
+    std::vector<nvsl::Clock> clocks(threads,
+                                    nvsl::Clock(nvsl::ClockMode::histogram));
+    std::atomic<size_t> ready = 0;
+    std::atomic<bool> go = false;
+
+    const auto worker = [&](size_t t) {
+      if (node >= 0) numa_run_on_node(node);
+
+      char *dst = dsts[t]->get();
+      char *src = needs_src ? srcs[t]->get() : nullptr;
+
+      const auto run_batch = [&](int sample) {
+        for (size_t b = 0; b < batch; b++) {
+          run_op(pmemops, op, dst + b * stride,
+                 src == nullptr ? nullptr : src + b * stride, size, sample);
+        }
+      };
+
+      run_batch(0); /* Warm up */
+      pmemops->drain();
+
+      ready++;
+      while (not go) std::this_thread::yield();
+
+      for (size_t s = 0; s < samples; s++) {
+        if (dirty_first) memset(dst, (int)s, region);
+
+        clocks[t].tick();
+        run_batch((int)s);
+        clocks[t].tock();
+
+        if (op == Op::flush) pmemops->drain();
+      }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++) workers.emplace_back(worker, t);
+    while (ready != threads) std::this_thread::yield();
+    go = true;
+    for (auto &w : workers) w.join();
+
+    const size_t total_ops = samples * batch;
+    Result result = {backend_name, op_name, size, threads, node, total_ops,
+                     0, 0, 0, 0, 0, ""};
+    std::stringstream summary;
+
+    size_t total_ns = 0;
+    for (size_t t = 0; t < threads; t++) {
+      auto &clk = clocks[t];
+      clk.reconcile();
+
+      total_ns += clk.ns();
+      result.gb_per_s += (double)(total_ops * size) / (double)clk.ns();
+      result.p50 = std::max(result.p50, clk.percentile_per_op(total_ops, 50));
+      result.p90 = std::max(result.p90, clk.percentile_per_op(total_ops, 90));
+      result.p99 = std::max(result.p99, clk.percentile_per_op(total_ops, 99));
+
+      summary << "thread " << t << ":\n"
+              << clk.summarize(total_ops, true) << "\n";
+    }
+    result.ns_per_op = (double)total_ns / (double)(total_ops * threads);
+    result.summary = summary.str();
+
+    return result;
+  }
+
+  void print_text(const Result &r) {
+    std::cout << "== " << r.backend << " " << r.op << " size=" << r.size
+              << " threads=" << r.threads << " node=" << r.node << " ==\n"
+              << r.summary << "GB/s: " << std::fixed << std::setprecision(3)
+              << r.gb_per_s << std::defaultfloat << "\n"
+              << std::endl;
+  }
+
+  void print_csv_header() {
+    std::cout << "backend,op,size,threads,node,ops,ns_per_op,p50_ns,p90_ns,"
+                 "p99_ns,gb_per_s"
+              << std::endl;
+  }
+
+  void print_csv(const Result &r) {
+    std::cout << r.backend << "," << r.op << "," << r.size << "," << r.threads
+              << "," << r.node << "," << r.ops << "," << r.ns_per_op << ","
+              << r.p50 << "," << r.p90 << "," << r.p99 << "," << r.gb_per_s
+              << std::endl;
+  }
+
+  void print_json(const Result &r, bool first) {
+    std::cout << (first ? "  " : ",\n  ") << "{\"backend\": \"" << r.backend
+              << "\", \"op\": \"" << r.op << "\", \"size\": " << r.size
+              << ", \"threads\": " << r.threads << ", \"node\": " << r.node
+              << ", \"ops\": " << r.ops << ", \"ns_per_op\": " << r.ns_per_op
+              << ", \"p50_ns\": " << r.p50 << ", \"p90_ns\": " << r.p90
+              << ", \"p99_ns\": " << r.p99 << ", \"gb_per_s\": " << r.gb_per_s
+              << "}" << std::flush;
+  }
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const auto cfg = parse_args(argc, argv);
+
+  if (cfg.format != "text" and cfg.format != "csv" and cfg.format != "json") {
+    usage(argv[0], 1);
+  }
+
+  if (numa_available() < 0 and
+      (cfg.nodes.size() != 1 or cfg.nodes.front() != -1)) {
+    std::cerr << "NUMA is not available on this machine" << std::endl;
+    return 1;
+  }
+
+  const auto backends = make_backends(cfg);
+
+  if (cfg.format == "csv") print_csv_header();
+  if (cfg.format == "json") std::cout << "[\n";
+
+  bool first = true;
+  for (const auto &[backend_name, pmemops] : backends) {
+    for (const auto &[op, op_name] : ALL_OPS) {
+      if (not selected(cfg.ops, op_name)) continue;
+
+      for (const auto threads : cfg.threads) {
+        for (const auto node : cfg.nodes) {
+          for (size_t sz = cfg.min_size; sz <= cfg.max_size; sz *= 2) {
+            const auto r = run_point(cfg, backend_name, pmemops.get(), op,
+                                     op_name, sz, threads, node);
+
+            if (cfg.format == "text") print_text(r);
+            if (cfg.format == "csv") print_csv(r);
+            if (cfg.format == "json") print_json(r, first);
+
+            first = false;
+          }
+        }
+      }
+    }
+  }
+
+  if (cfg.format == "json") std::cout << "\n]" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,462 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   arena.hh
+ * @date   octobre 14, 2026
+ * @brief  NUMA-local arena allocator on 2 MiB aligned DRAM or DAX regions
+ * @details Requires linking with -lnuma
+ */
+
+#pragma once
+
+#include <fcntl.h>
+#include <numa.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "nvsl/common.hh"
+#include "nvsl/constants.hh"
+#include "nvsl/error.hh"
+#include "nvsl/shard.hh"
+#include "nvsl/utils.hh"
+
+namespace nvsl {
+  /** @brief Where an Arena gets its memory from */
+  struct ArenaConfig {
+    int numa_node = -1; /**< Bind the memory to this node, -1 to not bind */
+
+    /** Anonymous memory is reserved in regions of this size, 2 MiB aligned */
+    size_t region_size = 64 * MiB;
+
+    /** Upper bound on the reserved bytes, 0 for no limit */
+    size_t max_size = 0;
+
+    bool huge_pages = true; /**< madvise(MADV_HUGEPAGE) anonymous regions */
+
+    /**
+     * File on a DAX file system to allocate from, mapped once with MAP_SYNC.
+     * Uses the first max_size bytes, or the whole file if max_size is 0.
+     */
+    std::string dax_path = "";
+  };
+
+  /**
+   * @brief Allocator for small objects from NUMA-local, 2 MiB aligned memory
+   * @details Sizes up to MAX_SMALL_SIZE use power-of-two size classes carved
+   * out of SPAN_SIZE spans, so a block is aligned to its size. Every thread
+   * has its own cache of free blocks per class and only takes the arena lock
+   * to move a batch of blocks to or from the arena. Larger allocations are
+   * page aligned and reused by exact size.
+   *
+   * The free lists live in the freed blocks, the arena keeps no persistent
+   * metadata in PMem. Freeing a block only needs its size, like
+   * std::pmr::memory_resource::deallocate().
+   */
+  class Arena {
+  public:
+    static constexpr size_t MIN_CLASS_SHIFT = 4; /* 16 B */
+    static constexpr size_t MAX_CLASS_SHIFT = 16;
+    static constexpr size_t MAX_SMALL_SIZE = 1UL << MAX_CLASS_SHIFT;
+    static constexpr size_t NUM_CLASSES = MAX_CLASS_SHIFT - MIN_CLASS_SHIFT + 1;
+    static constexpr size_t SPAN_SIZE = 64 * KiB;
+
+  private:
+    struct FreeBlock {
+      FreeBlock *next;
+    };
+
+    struct FreeList {
+      FreeBlock *head = nullptr;
+      size_t count = 0;
+
+      void push(void *ptr) {
+        auto *blk = (FreeBlock *)ptr;
+        blk->next = head;
+        head = blk;
+        count++;
+      }
+
+      void *pop() {
+        auto *blk = head;
+        head = blk->next;
+        count--;
+        return blk;
+      }
+    };
+
+    struct Region {
+      void *base;
+      size_t size;
+    };
+
+    /* Outlives the arena while a thread cache is returning its blocks */
+    struct State {
+      std::mutex lock;
+      bool alive = true;
+      ArenaConfig cfg;
+      int fd = -1;
+
+      std::vector<Region> regions;
+      uint8_t *bump = nullptr, *bump_end = nullptr;
+      size_t reserved = 0;
+
+      FreeList central[NUM_CLASSES];
+      std::map<size_t, std::vector<void *>> large_free;
+    };
+
+    struct ThreadCache {
+      const uint64_t epoch; /* Of the arena the cache belongs to */
+      std::weak_ptr<State> state;
+      FreeList lists[NUM_CLASSES];
+
+      ThreadCache(uint64_t epoch, const std::shared_ptr<State> &state)
+          : epoch(epoch), state(state) {}
+
+      ~ThreadCache() {
+        const auto owner = state.lock();
+        if (owner == nullptr) return; /* The arena is gone */
+
+        std::lock_guard<std::mutex> guard(owner->lock);
+        if (not owner->alive) return; /* The memory is gone */
+
+        for (size_t cls = 0; cls < NUM_CLASSES; cls++) {
+          while (lists[cls].count != 0) {
+            owner->central[cls].push(lists[cls].pop());
+          }
+        }
+      }
+    };
+
+    static inline std::atomic<uint64_t> next_epoch = 0;
+
+    /* Ids are reused so the per-thread cache vectors stay as small as the
+       number of live arenas */
+    const size_t id;
+    const uint64_t epoch;
+    std::shared_ptr<State> state;
+
+    static detail::IndexPool &id_pool() {
+      static detail::IndexPool pool;
+      return pool;
+    }
+
+    /** @brief Caches of the calling thread, indexed by arena id */
+    static std::vector<std::unique_ptr<ThreadCache>> &thread_caches() {
+      thread_local std::vector<std::unique_ptr<ThreadCache>> caches;
+      return caches;
+    }
+
+    static size_t class_of(size_t size) {
+      size = std::max(size, (size_t)1 << MIN_CLASS_SHIFT);
+      return (64 - __builtin_clzl(size - 1)) - MIN_CLASS_SHIFT;
+    }
+
+    static size_t class_size(size_t cls) {
+      return (size_t)1 << (cls + MIN_CLASS_SHIFT);
+    }
+
+    /** @brief Blocks moved between a thread cache and the arena at once */
+    static size_t batch_of(size_t cls) {
+      return std::clamp(SPAN_SIZE / 2 / class_size(cls), (size_t)1,
+                        (size_t)64);
+    }
+
+    /**
+     * @brief Cache of the calling thread
+     * @details A slot can still hold the cache of a destroyed arena that had
+     * the same id, the epoch tells them apart and the stale cache is dropped.
+     */
+    ThreadCache &this_cache() {
+      auto &caches = thread_caches();
+
+      if (id >= caches.size()) [[unlikely]] caches.resize(id + 1);
+
+      auto &cache = caches[id];
+      if (cache == nullptr or cache->epoch != epoch) [[unlikely]] {
+        cache = std::make_unique<ThreadCache>(epoch, state);
+      }
+
+      return *cache;
+    }
+
+    /** @brief Reserve a 2 MiB aligned anonymous region, state->lock held */
+    bool grow(size_t min_size) {
+      auto &cfg = state->cfg;
+      if (not cfg.dax_path.empty()) return false;
+
+      const size_t size =
+          round_up(std::max(min_size, cfg.region_size), LARGE_PG_SZ);
+      if (cfg.max_size != 0 and state->reserved + size > cfg.max_size) {
+        return false;
+      }
+
+      /* Over-reserve and trim to get a 2 MiB aligned region */
+      const size_t len = size + LARGE_PG_SZ;
+      auto *raw = (uint8_t *)mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (raw == MAP_FAILED) return false;
+
+      auto *base = (uint8_t *)align_2mb(raw);
+      if (base != raw) munmap(raw, base - raw);
+      munmap(base + size, (raw + len) - (base + size));
+
+      if (cfg.huge_pages) madvise(base, size, MADV_HUGEPAGE);
+      if (cfg.numa_node >= 0) numa_tonode_memory(base, size, cfg.numa_node);
+
+      add_region(base, size);
+      return true;
+    }
+
+    void add_region(uint8_t *base, size_t size) {
+      state->regions.push_back({base, size});
+      state->reserved += size;
+      state->bump = base;
+      state->bump_end = base + size;
+    }
+
+    /** @brief Bump allocate, state->lock held */
+    void *bump_alloc(size_t size, size_t align) {
+      for (int attempt = 0; attempt < 2; attempt++) {
+        auto *ptr = (uint8_t *)(((uintptr_t)state->bump + align - 1) &
+                                ~(uintptr_t)(align - 1));
+        if (state->bump != nullptr and ptr + size <= state->bump_end) {
+          state->bump = ptr + size;
+          return ptr;
+        }
+
+        if (not grow(size + align)) return nullptr;
+      }
+
+      return nullptr;
+    }
+
+    /** @brief Move a batch of blocks from the arena to the cache */
+    bool refill(ThreadCache &cache, size_t cls) {
+      std::lock_guard<std::mutex> guard(state->lock);
+      auto &central = state->central[cls];
+
+      if (central.count == 0) {
+        const auto sz = class_size(cls);
+        const auto span = std::max(SPAN_SIZE, sz);
+        auto *base = (uint8_t *)bump_alloc(span, span);
+        if (base == nullptr) return false;
+
+        for (size_t off = span; off >= sz; off -= sz) {
+          central.push(base + off - sz);
+        }
+      }
+
+      for (size_t i = batch_of(cls); i > 0 and central.count != 0; i--) {
+        cache.lists[cls].push(central.pop());
+      }
+
+      return true;
+    }
+
+    void flush(ThreadCache &cache, size_t cls) {
+      std::lock_guard<std::mutex> guard(state->lock);
+
+      for (size_t i = batch_of(cls); i > 0; i--) {
+        state->central[cls].push(cache.lists[cls].pop());
+      }
+    }
+
+    void map_dax() {
+      auto &cfg = state->cfg;
+
+      state->fd = open(cfg.dax_path.c_str(), O_RDWR);
+      if (state->fd == -1) {
+        NVSL_ERROR("Unable to open " + cfg.dax_path + ": " + PSTR());
+      }
+
+      size_t size = cfg.max_size;
+      if (size == 0) {
+        struct stat st;
+        if (fstat(state->fd, &st) != 0) NVSL_ERROR(PSTR());
+        size = st.st_size;
+      }
+      size = round_down(size, LARGE_PG_SZ);
+      if (size == 0) NVSL_ERROR(cfg.dax_path + " is smaller than 2 MiB");
+
+      /* Reserve a 2 MiB aligned range and map the file over it */
+      const size_t len = size + LARGE_PG_SZ;
+      auto *raw = (uint8_t *)mmap(nullptr, len, PROT_NONE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (raw == MAP_FAILED) NVSL_ERROR(PSTR());
+
+      auto *base = (uint8_t *)align_2mb(raw);
+      const int prot = PROT_READ | PROT_WRITE;
+      const int flags = MAP_SHARED_VALIDATE | MAP_SYNC | MAP_FIXED;
+      if (mmap(base, size, prot, flags, state->fd, 0) == MAP_FAILED) {
+        const auto err = PSTR();
+        munmap(raw, len);
+        NVSL_ERROR(mmap_to_str(base, size, prot, flags, state->fd, 0) +
+                   " failed: " + err);
+      }
+
+      if (base != raw) munmap(raw, base - raw);
+      munmap(base + size, (raw + len) - (base + size));
+
+      if (cfg.numa_node >= 0) numa_tonode_memory(base, size, cfg.numa_node);
+
+      add_region(base, size);
+    }
+
+  public:
+    explicit Arena(const ArenaConfig &cfg = {})
+        : id(id_pool().acquire()), epoch(next_epoch++),
+          state(std::make_shared<State>()) {
+      state->cfg = cfg;
+      if (not cfg.dax_path.empty()) map_dax();
+    }
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    /**
+     * @brief Unmaps all the memory, including blocks not freed yet
+     * @details Drops the cache of the calling thread, other threads drop
+     * theirs the next time they use an arena with the same id.
+     */
+    ~Arena() {
+      {
+        std::lock_guard<std::mutex> guard(state->lock);
+
+        state->alive = false;
+        for (const auto &region : state->regions) {
+          munmap(region.base, region.size);
+        }
+        if (state->fd != -1) close(state->fd);
+      }
+
+      auto &caches = thread_caches();
+      if (id < caches.size() and caches[id] != nullptr and
+          caches[id]->epoch == epoch) {
+        caches[id].reset();
+      }
+
+      id_pool().release(id);
+    }
+
+    /**
+     * @brief Allocate size bytes
+     * @param[in] align Power of two, honoured up to the size class for small
+     * sizes and up to the region alignment (2 MiB) for large ones
+     * @return nullptr if the arena is out of memory
+     */
+    void *allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+      if (std::max(size, align) <= MAX_SMALL_SIZE) [[likely]] {
+        const auto cls = class_of(std::max(size, align));
+        auto &cache = this_cache();
+
+        if (cache.lists[cls].count == 0) [[unlikely]] {
+          if (not refill(cache, cls)) return nullptr;
+        }
+
+        return cache.lists[cls].pop();
+      }
+
+      const size_t sz = round_up(size, SMALL_PG_SZ);
+      std::lock_guard<std::mutex> guard(state->lock);
+
+      auto it = state->large_free.find(sz);
+      if (it != state->large_free.end() and not it->second.empty()) {
+        for (size_t i = it->second.size(); i > 0; i--) {
+          auto *ptr = it->second[i - 1];
+          if ((uintptr_t)ptr % align == 0) {
+            it->second.erase(it->second.begin() + (i - 1));
+            return ptr;
+          }
+        }
+      }
+
+      return bump_alloc(sz, std::max(align, SMALL_PG_SZ));
+    }
+
+    /** @brief Free memory from allocate() with the same size and alignment */
+    void deallocate(void *ptr, size_t size,
+                    size_t align = alignof(std::max_align_t)) {
+      if (ptr == nullptr) return;
+
+      if (std::max(size, align) <= MAX_SMALL_SIZE) [[likely]] {
+        const auto cls = class_of(std::max(size, align));
+        auto &cache = this_cache();
+
+        cache.lists[cls].push(ptr);
+        if (cache.lists[cls].count > 2 * batch_of(cls)) [[unlikely]] {
+          flush(cache, cls);
+        }
+        return;
+      }
+
+      std::lock_guard<std::mutex> guard(state->lock);
+      state->large_free[round_up(size, SMALL_PG_SZ)].push_back(ptr);
+    }
+
+    /** @brief Bytes of memory mapped by the arena */
+    size_t reserved() const {
+      std::lock_guard<std::mutex> guard(state->lock);
+      return state->reserved;
+    }
+
+    /** @brief True if ptr is in memory mapped by this arena */
+    bool owns(const void *ptr) const {
+      std::lock_guard<std::mutex> guard(state->lock);
+      for (const auto &region : state->regions) {
+        const auto *base = (const uint8_t *)region.base;
+        if (ptr >= base and ptr < base + region.size) return true;
+      }
+      return false;
+    }
+  };
+
+  /**
+   * @brief std::pmr adapter for an Arena
+   * @code
+   * nvsl::Arena arena({.numa_node = 1});
+   * nvsl::ArenaResource res(arena);
+   * std::pmr::vector<int> vec(&res);
+   * @endcode
+   */
+  class ArenaResource : public std::pmr::memory_resource {
+  private:
+    Arena &arena;
+
+  protected:
+    void *do_allocate(size_t bytes, size_t alignment) override {
+      void *result = arena.allocate(bytes, alignment);
+      if (result == nullptr) throw std::bad_alloc();
+      return result;
+    }
+
+    void do_deallocate(void *ptr, size_t bytes, size_t alignment) override {
+      arena.deallocate(ptr, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other)
+        const noexcept override {
+      const auto *res = dynamic_cast<const ArenaResource *>(&other);
+      return res != nullptr and &res->arena == &arena;
+    }
+
+  public:
+    explicit ArenaResource(Arena &arena) : arena(arena) {}
+
+    Arena &get_arena() const { return arena; }
+  };
+} // namespace nvsl
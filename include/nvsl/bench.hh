@@ -0,0 +1,262 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   bench.hh
+ * @date   octobre 14, 2026
+ * @brief  Benchmark runner with warmup, repetitions, pinning and a barrier
+ */
+
+#pragma once
+
+#include <numa.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nvsl/clock.hh"
+#include "nvsl/error.hh"
+#include "nvsl/numa.hh"
+#include "nvsl/stats.hh"
+
+namespace nvsl {
+  namespace bench {
+    /** @brief How to run a benchmark */
+    struct Config {
+      size_t threads = 1;
+      int numa_node = -1; /**< Run the threads on this node, -1 for any */
+      bool pin = true;    /**< Pin each thread to its own CPU if possible */
+
+      size_t warmup_calls = 1000; /**< Untimed calls per thread */
+      size_t ops_per_call = 1;    /**< Operations done by one call */
+
+      /**
+       * Time one in this many calls for the percentiles, 0 to time none.
+       * A timed call costs about 100 cycles extra (serialized TSC reads and
+       * a histogram insert), spread over the untimed ones.
+       */
+      size_t latency_sample = 64;
+
+      /** Length of a repetition, all threads run for the whole of it */
+      std::chrono::milliseconds rep_time{100};
+      size_t min_reps = 5;
+      size_t max_reps = 100;
+
+      /** Stop when the 95% CI of ops/s is within this fraction of the mean */
+      double target_rel_ci = 0.02;
+    };
+
+    /** @brief Outcome of a benchmark, latencies are in ns per operation */
+    struct Result {
+      std::string name;
+      size_t threads = 0;
+      size_t reps = 0;
+      uint64_t ops = 0;
+      double seconds = 0;
+
+      double ops_per_s = 0;    /**< Mean over the repetitions */
+      double ops_per_s_ci = 0; /**< Half-width of the 95% CI of ops_per_s */
+      double p50 = 0, p90 = 0, p99 = 0;
+
+      /** Change of the registered stats during the timed repetitions */
+      StatsSnapshot stats;
+
+      std::string json() const;
+    };
+
+    /** @brief Barrier that spins (and yields) instead of sleeping */
+    class SpinBarrier {
+    private:
+      const size_t count;
+      std::atomic<size_t> waiting = 0;
+      std::atomic<size_t> generation = 0;
+
+    public:
+      explicit SpinBarrier(size_t count) : count(count) {}
+
+      void arrive_and_wait() {
+        const auto gen = generation.load(std::memory_order_acquire);
+
+        if (waiting.fetch_add(1, std::memory_order_acq_rel) + 1 == count) {
+          waiting.store(0, std::memory_order_relaxed);
+          generation.fetch_add(1, std::memory_order_release);
+        } else {
+          while (generation.load(std::memory_order_acquire) == gen) {
+            std::this_thread::yield();
+          }
+        }
+      }
+    };
+
+    namespace detail {
+      struct alignas(64) WorkerState {
+        TscClock clk = TscClock(ClockMode::histogram);
+        uint64_t calls = 0;
+      };
+    } // namespace detail
+
+    /**
+     * @brief Run a benchmark
+     * @details Every thread is pinned, runs `warmup_calls` untimed calls and
+     * then waits on a barrier. Each repetition releases all threads together,
+     * lets them call `fn` for `rep_time` and measures the aggregate ops/s.
+     * Repetitions continue until the 95% confidence interval (normal
+     * approximation) is within `target_rel_ci` of the mean, or `max_reps`.
+     * One in `latency_sample` calls is timed with a TscClock for the
+     * percentiles, the others only bump a counter so the timing overhead
+     * barely shows in ops/s. Set it to 0 for pure throughput, or to 1 to time
+     * every call if fn() takes well over a hundred cycles.
+     *
+     * @code
+     * const auto res = nvsl::bench::run("persist-64", cfg, [&](size_t tid) {
+     *   pmemops->persist(bufs[tid], 64);
+     * });
+     * std::cout << res.json() << std::endl;
+     * @endcode
+     *
+     * @param[in] name Name of the benchmark
+     * @param[in] cfg How to run the benchmark
+     * @param[in] fn Callable taking the thread index (0..threads-1)
+     */
+    template <typename Fn>
+    Result run(const std::string &name, const Config &cfg, Fn &&fn) {
+      const size_t threads = std::max(cfg.threads, (size_t)1);
+      const auto cpus = node_cpus(cfg.numa_node);
+
+      std::vector<detail::WorkerState> states(threads);
+      SpinBarrier barrier(threads + 1);
+      std::atomic<bool> stop = false, done = false;
+
+      const auto worker = [&](size_t t) {
+        if (cfg.pin and not cpus.empty()) {
+          pin_thread(cpus[t % cpus.size()]);
+        } else if (cfg.numa_node >= 0) {
+          numa_run_on_node(cfg.numa_node);
+        }
+
+        for (size_t i = 0; i < cfg.warmup_calls; i++) fn(t);
+
+        auto &state = states[t];
+        size_t until_sample = 1; /* Time the first call */
+        while (true) {
+          barrier.arrive_and_wait(); /* Start of a repetition */
+          if (done.load(std::memory_order_relaxed)) break;
+
+          while (not stop.load(std::memory_order_relaxed)) {
+            if (cfg.latency_sample != 0 and --until_sample == 0) {
+              until_sample = cfg.latency_sample;
+              state.clk.tick();
+              fn(t);
+              state.clk.tock();
+            } else {
+              fn(t);
+            }
+            state.calls++;
+          }
+
+          barrier.arrive_and_wait(); /* End of a repetition */
+        }
+      };
+
+      std::vector<std::thread> workers;
+      for (size_t t = 0; t < threads; t++) workers.emplace_back(worker, t);
+
+#ifdef NVSL_ENABLE_COLLECTION_REGISTRATION
+      const auto stats_before = StatsCollection::snapshot();
+#endif
+
+      std::vector<double> rates;
+      double mean = 0, half_ci = 0, seconds = 0;
+      uint64_t prev_calls = 0;
+
+      while (rates.size() < std::max(cfg.max_reps, (size_t)1)) {
+        stop = false;
+        barrier.arrive_and_wait();
+        const auto start = std::chrono::steady_clock::now();
+
+        std::this_thread::sleep_for(cfg.rep_time);
+        stop = true;
+
+        barrier.arrive_and_wait();
+        const std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+
+        uint64_t calls = 0;
+        for (const auto &state : states) calls += state.calls;
+
+        seconds += elapsed.count();
+        rates.push_back((calls - prev_calls) * cfg.ops_per_call /
+                        elapsed.count());
+        prev_calls = calls;
+
+        const double n = rates.size();
+        mean = 0;
+        for (const auto rate : rates) mean += rate / n;
+
+        double var = 0;
+        for (const auto rate : rates) var += (rate - mean) * (rate - mean);
+        var = n > 1 ? var / (n - 1) : 0;
+        half_ci = 1.96 * std::sqrt(var / n);
+
+        if (rates.size() >= cfg.min_reps and
+            half_ci <= cfg.target_rel_ci * mean) {
+          break;
+        }
+      }
+
+      done = true;
+      barrier.arrive_and_wait();
+      for (auto &w : workers) w.join();
+
+      Result result;
+      result.name = name;
+      result.threads = threads;
+      result.reps = rates.size();
+      result.ops = prev_calls * cfg.ops_per_call;
+      result.seconds = seconds;
+      result.ops_per_s = mean;
+      result.ops_per_s_ci = half_ci;
+
+#ifdef NVSL_ENABLE_COLLECTION_REGISTRATION
+      result.stats = StatsCollection::snapshot().delta(stats_before);
+#endif
+
+      TscClock all(ClockMode::histogram);
+      for (const auto &state : states) all.merge(state.clk);
+
+      const double per_call = std::max(cfg.ops_per_call, (size_t)1);
+      result.p50 = all.percentile(50) / per_call;
+      result.p90 = all.percentile(90) / per_call;
+      result.p99 = all.percentile(99) / per_call;
+
+      return result;
+    }
+
+    inline std::string Result::json() const {
+      std::stringstream ss;
+      ss.precision(std::numeric_limits<double>::max_digits10);
+
+      ss << "{\"name\": \"" << nvsl::detail::json_escape(name)
+         << "\", \"threads\": " << threads << ", \"reps\": " << reps
+         << ", \"ops\": " << ops << ", \"seconds\": " << seconds
+         << ", \"ops_per_s\": " << ops_per_s
+         << ", \"ops_per_s_ci95\": " << ops_per_s_ci
+         << ", \"p50_ns\": " << p50 << ", \"p90_ns\": " << p90
+         << ", \"p99_ns\": " << p99;
+      if (not stats.entries.empty()) ss << ", \"stats\": " << stats.json();
+      ss << "}";
+
+      return ss.str();
+    }
+  } // namespace bench
+} // namespace nvsl
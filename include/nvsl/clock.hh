@@ -13,13 +13,21 @@
 #include <cassert>
 #endif
 
+#include <x86intrin.h>
+
 #include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <iostream>
+#include <optional>
+#include <random>
 #include <sstream>
 #include <string>
 #include <vector>
 
+#include "nvsl/cpu.hh"
+#include "nvsl/histogram.hh"
+
 namespace nvsl {
   inline std::string ns_to_hr_clk(const size_t ns_total) {
     std::stringstream ss;
@@ -34,36 +42,221 @@ namespace nvsl {
     return ss.str();
   }
 
-  /** @brief Clock object based on std::chrono::high_resolution_clock */
-  class Clock {
+  /**
+   * @brief Clock source based on std::chrono::high_resolution_clock
+   * @details A clock source provides start() and stop() timestamps in ticks and
+   * to_ns() to convert a number of ticks to ns.
+   */
+  struct ChronoClockSource {
+    static uint64_t now() {
+      using namespace std::chrono;
+      return duration_cast<nanoseconds>(
+                 high_resolution_clock::now().time_since_epoch())
+          .count();
+    }
+
+    static uint64_t start() { return now(); }
+    static uint64_t stop() { return now(); }
+    static double to_ns(uint64_t ticks) { return (double)ticks; }
+  };
+
+  namespace detail {
+    struct TscCalibration {
+      bool usable = false;   /**< Invariant TSC with RDTSCP */
+      double ns_per_tick = 1; /**< 1 if falling back to steady_clock */
+    };
+
+    inline uint64_t steady_ns() {
+      using namespace std::chrono;
+      return duration_cast<nanoseconds>(
+                 steady_clock::now().time_since_epoch())
+          .count();
+    }
+
+    /** @brief Measure the TSC frequency against steady_clock for ~10 ms */
+    inline TscCalibration calibrate_tsc() {
+      TscCalibration result;
+      const auto &cpu = cpu_features();
+
+      if (not cpu.invariant_tsc or not cpu.rdtscp) return result;
+
+      constexpr uint64_t CALIBRATION_NS = 10 * 1000 * 1000;
+      unsigned aux;
+
+      const uint64_t ns_start = steady_ns();
+      const uint64_t tsc_start = __rdtscp(&aux);
+
+      uint64_t ns_end;
+      do {
+        ns_end = steady_ns();
+      } while (ns_end - ns_start < CALIBRATION_NS);
+      const uint64_t tsc_end = __rdtscp(&aux);
+
+      if (tsc_end <= tsc_start) return result;
+
+      result.usable = true;
+      result.ns_per_tick =
+          (double)(ns_end - ns_start) / (double)(tsc_end - tsc_start);
+      return result;
+    }
+
+    inline const TscCalibration &tsc_calibration() {
+      static const TscCalibration calibration = calibrate_tsc();
+      return calibration;
+    }
+  } // namespace detail
+
+  /**
+   * @brief Clock source based on the TSC
+   * @details start() and stop() are serialized with LFENCE so the timed code
+   * can't move out of the window. The TSC frequency is calibrated once per
+   * process. Falls back to steady_clock if the TSC isn't invariant or RDTSCP is
+   * missing.
+   */
+  struct TscClockSource {
+    static uint64_t start() {
+      if (not detail::tsc_calibration().usable) [[unlikely]] {
+        return detail::steady_ns();
+      }
+
+      _mm_lfence();
+      const uint64_t result = __rdtsc();
+      _mm_lfence();
+      return result;
+    }
+
+    static uint64_t stop() {
+      if (not detail::tsc_calibration().usable) [[unlikely]] {
+        return detail::steady_ns();
+      }
+
+      unsigned aux;
+      const uint64_t result = __rdtscp(&aux);
+      _mm_lfence();
+      return result;
+    }
+
+    static double to_ns(uint64_t ticks) {
+      return ticks * detail::tsc_calibration().ns_per_tick;
+    }
+  };
+
+  /** @brief How a Clock keeps the duration of each tick()/tock() */
+  enum class ClockMode {
+    raw,       /**< Every duration, up to RAW_VAL_CNT of them */
+    histogram, /**< Log-linear histogram, ~3% relative error */
+    reservoir, /**< Uniform random sample of a fixed number of durations */
+  };
+
+  /**
+   * @brief Clock object for benchmarking workloads
+   * @details Durations are kept in ticks of the source and converted to ns
+   * when reported.
+   * @tparam Source Clock source, e.g., ChronoClockSource or TscClockSource
+   */
+  template <typename Source>
+  class BasicClock {
   private:
-    std::chrono::system_clock::time_point start_clk;
+    uint64_t start_tick = 0;
     bool running = false;
-    size_t total_ns = 0;
+    size_t total_ticks = 0;
+    /* Only reordered by reconcile(), sorted is set once it sorted them */
     std::vector<size_t> raw_values;
-    std::vector<size_t> sorted_raw_values;
+    bool sorted = true;
     size_t events = 0;
 
+    ClockMode mode = ClockMode::raw;
+    std::optional<LogLinearHistogram> hist;
+    size_t reservoir_cap = 0;
+    std::mt19937_64 rng;
+
     /**< Total number of values to store */
     static constexpr size_t RAW_VAL_CNT = 1024 * 1024 * 100;
 
+    void record(size_t elapsed) {
+      sorted = false;
+      switch (mode) {
+      case ClockMode::histogram: hist->add(elapsed); break;
+      case ClockMode::reservoir:
+        if (raw_values.size() < reservoir_cap) {
+          raw_values.push_back(elapsed);
+        } else {
+          /* Algorithm R: keep the new value with prob. cap/(events + 1) */
+          std::uniform_int_distribution<size_t> dist(0, this->events);
+          const auto slot = dist(rng);
+          if (slot < reservoir_cap) raw_values[slot] = elapsed;
+        }
+        break;
+      case ClockMode::raw:
+#define OVERFLOW_MSG                                    \
+  "Raw values buffer overflow, increase array size or " \
+  "operations/loop"
+#if defined(NVSL_ASSERT) && defined(DBGE)
+        NVSL_ASSERT(this->raw_values.size() < RAW_VAL_CNT, OVERFLOW_MSG);
+#else
+        if (this->raw_values.size() > RAW_VAL_CNT) {
+          fprintf(stderr, OVERFLOW_MSG "\n");
+          exit(1);
+        }
+#endif
+        this->raw_values.push_back(elapsed);
+        break;
+      }
+    }
+
   public:
-    Clock(bool reserve_raw_vals = false) { 
+    /** @brief Largest duration in ticks the histogram mode tells apart */
+    static constexpr uint64_t HIST_MAX_TICKS = 1ULL << 44;
+
+    /** @brief Default number of durations kept by the reservoir mode */
+    static constexpr size_t DEFAULT_RESERVOIR_CNT = 64 * 1024;
+
+    BasicClock(bool reserve_raw_vals = false) {
+      (void)Source::to_ns(0); /* Calibrate the source outside tick() */
       if (reserve_raw_vals)
         raw_values.reserve(RAW_VAL_CNT); 
     }
 
+    /**
+     * @brief Clock that keeps its durations in constant memory
+     * @details ClockMode::histogram never needs reconcile(), and percentiles
+     * are within the bucket width of the exact value. ClockMode::reservoir
+     * keeps `reservoir_cnt` uniformly sampled durations, percentiles are exact
+     * for the sample and need reconcile(). Neither mode aborts on long runs.
+     * @param[in] mode How to keep the durations
+     * @param[in] reservoir_cnt Durations to keep in ClockMode::reservoir
+     */
+    explicit BasicClock(ClockMode mode,
+                        size_t reservoir_cnt = DEFAULT_RESERVOIR_CNT)
+        : mode(mode) {
+      (void)Source::to_ns(0);
+      switch (mode) {
+      case ClockMode::histogram: hist.emplace(HIST_MAX_TICKS); break;
+      case ClockMode::reservoir:
+        reservoir_cap = std::max(reservoir_cnt, (size_t)1);
+        raw_values.reserve(reservoir_cap);
+        break;
+      case ClockMode::raw: break;
+      }
+    }
+
+    ClockMode get_mode() const { return this->mode; }
+
+    /**
+     * @brief Durations in ticks recorded in ClockMode::histogram
+     * @warning Only valid in ClockMode::histogram
+     */
+    const LogLinearHistogram &histogram() const { return *this->hist; }
+
     /** @brief Start the timer */
     void tick() {
       running = true;
-      this->start_clk = std::chrono::high_resolution_clock::now();
+      this->start_tick = Source::start();
     }
 
     /** @brief Stop the timer */
     void tock() {
-      using namespace std::chrono;
-
-      const auto end_clk = high_resolution_clock::now();
+      const auto end_tick = Source::stop();
       if (!running) {
 #if defined(NVSL_ERROR) && defined(DBGE)
         NVSL_ERROR("Clock not running");
@@ -74,37 +267,27 @@ namespace nvsl {
       }
 
       running = false;
-      const auto elapsed =
-          duration_cast<nanoseconds>(end_clk - start_clk).count();
-      this->total_ns += elapsed;
+      const auto elapsed = end_tick - start_tick;
+      this->total_ticks += elapsed;
 
-#define OVERFLOW_MSG                                    \
-  "Raw values buffer overflow, increase array size or " \
-  "operations/loop"
-#if defined(NVSL_ASSERT) && defined(DBGE)
-      NVSL_ASSERT(this->raw_values.size() < RAW_VAL_CNT, OVERFLOW_MSG);
-#else
-      if (this->raw_values.size() > RAW_VAL_CNT) {
-        fprintf(stderr, OVERFLOW_MSG "\n");
-        exit(1);
-      }
-#endif
-      this->raw_values.push_back(elapsed);
+      record(elapsed);
       this->events++;
     }
 
     void reset() {
       this->running = false;
-      this->total_ns = 0;
+      this->total_ticks = 0;
       this->events = 0;
       this->raw_values.clear();
-      this->sorted_raw_values.clear();
+      this->sorted = true;
+      if (this->hist) this->hist->reset();
     }
 
-    size_t ns() const { return this->total_ns; }
-    size_t us() const { return this->total_ns / 1000; }
-    size_t ms() const { return this->total_ns / 1000000; }
-    size_t s() const { return this->total_ns / 1000000000; }
+    size_t ticks() const { return this->total_ticks; }
+    size_t ns() const { return (size_t)Source::to_ns(this->total_ticks); }
+    size_t us() const { return this->ns() / 1000; }
+    size_t ms() const { return this->ns() / 1000000; }
+    size_t s() const { return this->ns() / 1000000000; }
 
     /** @brief Total time elapsed */
     const std::string summarize() const {
@@ -119,34 +302,127 @@ namespace nvsl {
     }
 
     /**
-     * @brief Prepare clock object to calculate percentile/summary
-     * @details non-const function to update the internal state so that other
-     * functions can be const
+     * @brief Sort the durations in place so percentile() is O(1)
+     * @details Optional, percentiles() works without it by running
+     * nth_element() on one copy per call. Worth calling before many separate
+     * percentile() queries. The sort is cached until the next tock().
      */
     void reconcile() {
-      sorted_raw_values.reserve(raw_values.size());
-      std::copy(raw_values.begin(), raw_values.end(),
-                std::back_inserter(sorted_raw_values));
-      std::sort(sorted_raw_values.begin(), sorted_raw_values.end());
+      if (mode == ClockMode::histogram or sorted) return;
+
+      std::sort(raw_values.begin(), raw_values.end());
+      sorted = true;
+    }
+
+    /**
+     * @brief Calculate several percentiles at once
+     * @details O(1) per percentile once reconcile() sorted the durations.
+     * Otherwise copies the durations once and selects the ranks in increasing
+     * order, each nth_element() only partitions the values above the previous
+     * rank. Never modifies the clock, so concurrent queries are safe.
+     * @param[in] pcs Percentiles out of 100, in any order
+     * @return Durations in ns in the order of pcs, 0 if nothing was recorded
+     */
+    std::vector<size_t> percentiles(const std::vector<size_t> &pcs) const {
+      std::vector<size_t> result(pcs.size(), 0);
+
+      if (mode == ClockMode::histogram) {
+        for (size_t i = 0; i < pcs.size(); i++) {
+          result[i] = (size_t)Source::to_ns(hist->percentile(pcs[i]));
+        }
+        return result;
+      }
+
+      const auto sz = raw_values.size();
+      if (sz == 0) return result;
+
+      /* Nearest rank, 1 <= rank <= sz */
+      std::vector<std::pair<size_t, size_t>> ranks; /* (rank, index in pcs) */
+      for (size_t i = 0; i < pcs.size(); i++) {
+        const auto rank = std::clamp(
+            (size_t)std::ceil(sz * (pcs[i] / 100.0)), (size_t)1, sz);
+        ranks.emplace_back(rank, i);
+      }
+
+      if (sorted) {
+        for (const auto &[rank, i] : ranks) {
+          result[i] = (size_t)Source::to_ns(raw_values[rank - 1]);
+        }
+        return result;
+      }
+
+      std::sort(ranks.begin(), ranks.end());
+
+      auto values = raw_values;
+      auto first = values.begin();
+      for (const auto &[rank, i] : ranks) {
+        const auto nth = values.begin() + (rank - 1);
+        if (nth >= first) {
+          std::nth_element(first, nth, values.end());
+          first = nth + 1;
+        }
+        result[i] = (size_t)Source::to_ns(*nth);
+      }
+
+      return result;
     }
 
     /**
      * @brief Calculate the percentile value
+     * @details See percentiles(), use it to query several percentiles.
      * @param[in] pc Percentile out of 100
+     * @return Duration in ns, 0 if nothing was recorded
+     */
+    size_t percentile(const size_t pc) const { return percentiles({pc})[0]; }
+
+    /**
+     * @brief Add the durations of another clock, e.g., one per thread
+     * @details Both clocks have to use the same mode. Reservoirs are merged by
+     * keeping values from each clock in proportion to its number of events.
      */
-    size_t percentile(const size_t pc) const {
-      if (sorted_raw_values.size() == 0) {
-#if defined(NVSL_ERROR)
-        NVSL_ERROR("Clock not reconcile. Call reconcile()");
+    void merge(const BasicClock &other) {
+      if (mode != other.mode) {
+#if defined(NVSL_ERROR) && defined(DBGE)
+        NVSL_ERROR("Cannot merge clocks with different modes");
 #else
-        assert(0 && "Clock not reconciled. Call reconcile()");
+        std::cerr << "Cannot merge clocks with different modes" << std::endl;
+        exit(1);
 #endif
+        return;
       }
 
-      const auto sz = sorted_raw_values.size();
-      const auto idx = std::max(0UL, (size_t)((sz * pc) / 100.0) - 1);
+      switch (mode) {
+      case ClockMode::histogram: hist->merge(*other.hist); break;
+      case ClockMode::raw:
+        raw_values.insert(raw_values.end(), other.raw_values.begin(),
+                          other.raw_values.end());
+        break;
+      case ClockMode::reservoir:
+        if (raw_values.size() + other.raw_values.size() <= reservoir_cap) {
+          raw_values.insert(raw_values.end(), other.raw_values.begin(),
+                            other.raw_values.end());
+        } else {
+          auto theirs = other.raw_values;
+          std::shuffle(raw_values.begin(), raw_values.end(), rng);
+          std::shuffle(theirs.begin(), theirs.end(), rng);
 
-      return sorted_raw_values[idx];
+          const double share =
+              (double)events / (double)(events + other.events);
+          size_t keep = std::min(raw_values.size(),
+                                 (size_t)std::llround(share * reservoir_cap));
+          keep = std::max(keep, reservoir_cap - std::min(reservoir_cap,
+                                                         theirs.size()));
+
+          raw_values.resize(keep);
+          raw_values.insert(raw_values.end(), theirs.begin(),
+                            theirs.begin() + (reservoir_cap - keep));
+        }
+        break;
+      }
+
+      this->sorted = false;
+      this->total_ticks += other.total_ticks;
+      this->events += other.events;
     }
 
     /**
@@ -163,19 +439,17 @@ namespace nvsl {
       assert(total_ops != 0 && "Total ops cannot be zero");
 #endif
 
-      size_t ops_per_iter = total_ops / raw_values.size();
+      size_t ops_per_iter = total_ops / this->events;
       ss << this->summarize() << "ops: " << total_ops
          << "\nops/s: " << (total_ops * (1000000000)) / ((double)this->ns())
          << "\ntime/op: "
          << ns_to_hr_clk((size_t)(this->ns() / (double)total_ops))
          << "\nns/op: " << (this->ns() / (double)total_ops);
       if (distribution) {
-        ss << "\np50/op: "
-           << ns_to_hr_clk((size_t)(this->percentile(50)) / ops_per_iter)
-           << "\np90/op: "
-           << ns_to_hr_clk((size_t)(this->percentile(90)) / ops_per_iter)
-           << "\np99/op: "
-           << ns_to_hr_clk((size_t)(this->percentile(99)) / ops_per_iter)
+        const auto pcs = this->percentiles({50, 90, 99});
+        ss << "\np50/op: " << ns_to_hr_clk(pcs[0] / ops_per_iter)
+           << "\np90/op: " << ns_to_hr_clk(pcs[1] / ops_per_iter)
+           << "\np99/op: " << ns_to_hr_clk(pcs[2] / ops_per_iter)
            << "\ntime/op: "
            << ns_to_hr_clk((size_t)(this->ns() / (double)total_ops));
       }
@@ -192,8 +466,14 @@ namespace nvsl {
       }
     }
     size_t percentile_per_op(const size_t total_ops, const size_t pc) const {
-      const auto ops_per_iter = total_ops / raw_values.size();
+      const auto ops_per_iter = total_ops / this->events;
       return this->percentile(pc) / ops_per_iter;
     }
   };
+
+  /** @brief Clock based on std::chrono::high_resolution_clock */
+  using Clock = BasicClock<ChronoClockSource>;
+
+  /** @brief Clock based on the TSC, for timing short sequences */
+  using TscClock = BasicClock<TscClockSource>;
 } // namespace nvsl
@@ -11,20 +11,25 @@
 #include "nvsl/constants.hh"
 #include "nvsl/defs.h"
 #include "nvsl/envvars.hh"
+#include "nvsl/log_sink.hh"
 
+#include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <fcntl.h>
 #include <fstream>
 #include <iomanip>
 #include <ios>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <vector>
 
 #include <fnmatch.h>
 
@@ -32,6 +37,7 @@
 #define NVSL_UNUSED __attribute__((unused))
 #define NVSL_EXPORT __attribute__((visibility("default")))
 #define NVSL_NOINLINE __attribute__((noinline))
+#define NVSL_TARGET(isa) __attribute__((target(isa)))
 
 #define NVSL_BEGIN_IGNORE_WPEDANTIC \
   _Pragma("GCC diagnostic push")    \
@@ -60,6 +66,16 @@
 
 static std::ofstream nullstream;
 
+/**
+ * @brief Highest DBGH() level compiled in
+ * @details DBGH(lvl) and NVSL_LOG(lvl, ...) above this level are discarded at
+ * compile time, without evaluating their arguments. DBGW, DBGE and NVSL_ERROR
+ * are not affected.
+ */
+#ifndef NVSL_MAX_LOG_LEVEL
+#define NVSL_MAX_LOG_LEVEL 4
+#endif
+
 extern std::ofstream log_st;
 #ifdef RELEASE
 #define DBG 0 && std::cerr
@@ -75,49 +91,135 @@ namespace nvsl {
     return not fnmatch(pat.c_str(), str.c_str(), 0);
   }
 
-  static inline bool is_log_enabled(int level) {
-    uint8_t log_lvl = 0;
+  /**
+   * @brief Logging config parsed from NVSL_LOG_LEVEL and NVSL_LOG_WILDCARD
+   * @details Parsed on first use. Call reload_log_config() after changing the
+   * env variables.
+   */
+  struct LogConfig {
+    uint8_t level = 0;
+    bool has_wildcard = false;
+    std::string wildcard;
+  };
+
+  /** @brief Cached decision of a DBGH() call site */
+  struct LogSite {
+    /** (config generation << 1) | enabled, 0 if not computed yet */
+    std::atomic<uint32_t> state{0};
+  };
+
+  /** @brief Tag for a DBGH whose call site is known to be enabled */
+  struct LogSiteEnabled {};
+  inline constexpr LogSiteEnabled log_site_enabled{};
+
+  namespace detail {
+    inline LogConfig parse_log_config() {
+      LogConfig result;
+
+      const char *val = std::getenv(NVSL_LOG_LEVEL_ENV);
+      if (val != nullptr) {
+        const std::string val_str = std::string(val);
+
+        try {
+          const auto log_lvl = std::stoul(val_str, nullptr, 10);
+
+          if (log_lvl > 4) {
+            throw std::out_of_range("Valid values: [0-4]");
+          }
+
+          result.level = log_lvl;
+        } catch (std::out_of_range &e) {
+          std::cerr << "LP FATAL: " << NVSL_LOG_LEVEL_ENV
+                    << " is out of range. Valid values: [0-4]" << std::endl;
+          std::exit(1);
+        } catch (std::invalid_argument &e) {
+          std::cerr << "LP FATAL: "
+                    << "Unable to parse " << NVSL_LOG_LEVEL_ENV
+                    << " env variable." << std::endl;
+          std::exit(1);
+        }
+      }
 
-    const char *val = std::getenv(NVSL_LOG_LEVEL_ENV);
-    if (val != nullptr) {
-      const std::string val_str = std::string(val);
+      const char *wc = std::getenv(NVSL_LOG_WILDCARD_ENV);
+      if (wc != nullptr) {
+        result.has_wildcard = true;
+        result.wildcard = wc;
+      }
 
-      try {
-        log_lvl = std::stoul(val_str, nullptr, 10);
+      return result;
+    }
 
-        if (log_lvl > 4) {
-          throw std::out_of_range("Valid values: [0-4]");
-        }
-      } catch (std::out_of_range &e) {
-        std::cerr << "LP FATAL: " << NVSL_LOG_LEVEL_ENV
-                  << " is out of range. Valid values: [0-4]" << std::endl;
-        std::exit(1);
-      } catch (std::invalid_argument &e) {
-        std::cerr << "LP FATAL: "
-                  << "Unable to parse " << NVSL_LOG_LEVEL_ENV
-                  << " env variable." << std::endl;
-        std::exit(1);
+    /**
+     * @brief Published logging config
+     * @details Readers load `config` without a lock. A reload publishes a new
+     * config and bumps the generation, the old configs are kept since readers
+     * may still be using them. Reloads are rare, so they cost a few bytes.
+     */
+    struct LogState {
+      std::mutex lock; /* Serializes reload_log_config() */
+      std::vector<std::unique_ptr<const LogConfig>> configs;
+      std::atomic<const LogConfig *> config{nullptr};
+      std::atomic<uint32_t> generation{1};
+
+      LogState() {
+        configs.push_back(
+            std::make_unique<const LogConfig>(parse_log_config()));
+        config.store(configs.back().get(), std::memory_order_release);
       }
-    }
 
-    if (level <= log_lvl) {
-      return true;
-    } else {
-      return false;
+      const LogConfig &current() const {
+        return *config.load(std::memory_order_acquire);
+      }
+    };
+
+    inline LogState &log_state() {
+      static LogState state;
+      return state;
     }
+  } // namespace detail
+
+  /** @brief Re-read the logging env variables and drop all cached decisions */
+  inline void reload_log_config() {
+    auto &state = detail::log_state();
+    std::lock_guard<std::mutex> guard(state.lock);
+
+    state.configs.push_back(
+        std::make_unique<const LogConfig>(detail::parse_log_config()));
+    state.config.store(state.configs.back().get(), std::memory_order_release);
+    state.generation.fetch_add(1, std::memory_order_release);
+  }
+
+  /** @brief Copy of the current logging config */
+  inline LogConfig log_config() { return detail::log_state().current(); }
+
+  static inline bool is_log_enabled(int level) {
+    return level <= detail::log_state().current().level;
   }
 
   static inline bool is_caller_enabled(const std::string &caller) {
-    bool result = true;
+    const auto &config = detail::log_state().current();
 
-    const char *val = std::getenv(NVSL_LOG_WILDCARD_ENV);
-    if (val != nullptr) {
-      const std::string val_str = std::string(val);
+    return not config.has_wildcard or wildcard(config.wildcard, caller);
+  }
 
-      result = wildcard(val_str, caller);
+  /**
+   * @brief Check if a call site logs at a level, caching the decision
+   * @details The decision is recomputed only after reload_log_config()
+   */
+  inline bool is_log_site_enabled(LogSite &site, int level,
+                                  const char *caller) {
+    auto &state = detail::log_state();
+    const auto gen = state.generation.load(std::memory_order_acquire);
+    const auto cached = site.state.load(std::memory_order_relaxed);
+
+    if ((cached >> 1) == gen) [[likely]] {
+      return cached & 1;
     }
 
-    return result;
+    const bool enabled = is_log_enabled(level) and is_caller_enabled(caller);
+    site.state.store((gen << 1) | enabled, std::memory_order_relaxed);
+
+    return enabled;
   }
 } // namespace nvsl
 
@@ -135,20 +237,53 @@ inline std::string nvsl_cur_time_str() {
 
 /* Log to stderr with a decorator */
 struct DBGH {
-  bool enabled;
-  DBGH(const DBGH &obj) { this->enabled = obj.enabled; }
-
+  bool enabled = false;
 #ifndef RELEASE
-  explicit DBGH(uint8_t lvl, const char *caller = __builtin_FUNCTION()) {
+  /* With the async sink, the record is committed by the object that started
+     it, copies write to the same per-thread buffer */
+  bool owns_record = false;
+  uint8_t level = 0;
+  const char *caller = nullptr;
+  std::ostream *out = &DBG;
+
+  DBGH(const DBGH &obj)
+      : enabled(obj.enabled), level(obj.level), caller(obj.caller),
+        out(obj.out) {}
 #else
-  explicit DBGH(uint8_t lvl) {
+  DBGH(const DBGH &obj) { this->enabled = obj.enabled; }
 #endif
 
 #ifndef RELEASE
+  explicit DBGH(uint8_t lvl, const char *caller = __builtin_FUNCTION()) {
     this->enabled =
         nvsl::is_log_enabled(lvl) && nvsl::is_caller_enabled(caller);
+    this->prefix(lvl, caller);
+  }
 
-    if (this->enabled) [[likely]] {
+  /** @brief Used by the DBGH() macro once the call site is enabled */
+  DBGH(uint8_t lvl, const char *caller, nvsl::LogSiteEnabled) {
+    this->enabled = true;
+    this->prefix(lvl, caller);
+  }
+
+  ~DBGH() {
+    if (this->owns_record) [[unlikely]] {
+      nvsl::detail::commit_async_log(level, caller);
+    }
+  }
+#else
+  explicit DBGH(uint8_t lvl) { (void)lvl; }
+#endif
+
+#ifndef RELEASE
+  void prefix(uint8_t lvl, const char *caller) {
+    if (this->enabled and nvsl::detail::async_log_active()) {
+      /* The sink adds the timestamp, caller and level when draining */
+      this->owns_record = true;
+      this->level = lvl;
+      this->caller = caller;
+      this->out = &nvsl::detail::begin_async_log();
+    } else if (this->enabled) [[likely]] {
 #ifdef NVSL_SIMPLIFIED_TERM_IO
       DBG << lp_cur_time_str() << " | ";
 #else
@@ -160,8 +295,11 @@ struct DBGH {
           << "]:" << (int)lvl << " ";
 #endif // NVSL_SIMPLIFIED_TERM_IO
     }
-#endif // !RELEASE
   }
+#endif // !RELEASE
+
+  /** @brief Lets DBGH(lvl) short-circuit with && */
+  explicit operator bool() const { return this->enabled; }
 
   template <typename T>
   friend const DBGH &operator<<(const DBGH &dbgh, const T &obj);
@@ -175,9 +313,13 @@ struct DBGH {
 
 template <typename T>
 inline const DBGH &operator<<(const DBGH &dbgh, const T &obj) {
+#ifndef RELEASE
   if (dbgh.enabled) {
-    DBG << obj;
+    *dbgh.out << obj;
   }
+#else
+  (void)obj;
+#endif
 
   return dbgh;
 }
@@ -185,14 +327,18 @@ inline const DBGH &operator<<(const DBGH &dbgh, const T &obj) {
 inline const DBGH &operator<<(const DBGH &s,
                               std::ostream &(*f)(std::ostream &)) {
 #ifndef RELEASE
-  if (s.enabled) f(DBG);
+  if (s.enabled) f(*s.out);
+#else
+  (void)f;
 #endif
   return s;
 }
 
 inline const DBGH &operator<<(const DBGH &s, std::ostream &(*f)(std::ios &)) {
 #ifndef RELEASE
-  if (s.enabled) f(DBG);
+  if (s.enabled) f(*s.out);
+#else
+  (void)f;
 #endif
   return s;
 }
@@ -200,11 +346,70 @@ inline const DBGH &operator<<(const DBGH &s, std::ostream &(*f)(std::ios &)) {
 inline const DBGH &operator<<(const DBGH &s,
                               std::ostream &(*f)(std::ios_base &)) {
 #ifndef RELEASE
-  if (s.enabled) f(DBG);
+  if (s.enabled) f(*s.out);
+#else
+  (void)f;
 #endif
   return s;
 }
 
+#ifndef RELEASE
+/** @brief Cached decision of the call site, see is_log_site_enabled() */
+#define NVSL_LOG_SITE_ENABLED(lvl)                               \
+  nvsl::is_log_site_enabled(                                     \
+      []() -> nvsl::LogSite & {                                  \
+        static nvsl::LogSite nvsl_log_site;                      \
+        return nvsl_log_site;                                    \
+      }(),                                                       \
+      (lvl), __builtin_FUNCTION())
+
+/** @brief DBGH object for a call site that is enabled */
+#define NVSL_DBGH_AT(lvl)                                        \
+  DBGH { (uint8_t)(lvl), __builtin_FUNCTION(), nvsl::log_site_enabled }
+
+/**
+ * @brief Log at a level, e.g., DBGH(2) << "msg" << std::endl;
+ * @details Each call site keeps its enabled/disabled decision in a static.
+ * `<<` binds tighter than `&&`, so the DBGH object and the `<<` chain are only
+ * evaluated if lvl is at most NVSL_MAX_LOG_LEVEL and the cached decision of the
+ * site is to log. A disabled DBGH() costs a couple of loads and a branch, and
+ * its arguments are not evaluated.
+ */
+#define DBGH(lvl)                                                \
+  ((lvl) <= NVSL_MAX_LOG_LEVEL) && NVSL_LOG_SITE_ENABLED(lvl) && \
+      NVSL_DBGH_AT(lvl)
+
+/**
+ * @brief Log the arguments at a level, e.g., NVSL_LOG(2, "x = ", x, "\n");
+ * @details Discarded using if constexpr above NVSL_MAX_LOG_LEVEL, lvl has to
+ * be a constant expression. The arguments are only evaluated if the call site
+ * is enabled.
+ */
+#define NVSL_LOG(lvl, ...)                                      \
+  do {                                                          \
+    if constexpr ((lvl) <= NVSL_MAX_LOG_LEVEL) {                \
+      if (NVSL_LOG_SITE_ENABLED(lvl)) [[unlikely]] {            \
+        nvsl::detail::log_args(NVSL_DBGH_AT(lvl), __VA_ARGS__); \
+      }                                                         \
+    }                                                           \
+  } while (0)
+
+namespace nvsl {
+  namespace detail {
+    template <typename... Args>
+    inline void log_args(const DBGH &dbgh, const Args &...args) {
+      if (dbgh) (dbgh << ... << args);
+    }
+  } // namespace detail
+} // namespace nvsl
+#else
+/* Nothing is logged, skip evaluating the arguments */
+#define DBGH(lvl) false && DBGH { (uint8_t)(lvl) }
+#define NVSL_LOG(lvl, ...) \
+  do {                     \
+  } while (0)
+#endif
+
 #ifdef RELEASE
 
 #define DBG 0 && std::cerr
@@ -220,7 +425,7 @@ inline const DBGH &operator<<(const DBGH &s,
 
 /* Log warning to stderr with decorator */
 #ifdef NVSL_SIMPLIFIED_TERM_IO
-#define DBGW (DBGH(0) << "Warning: ")
+#define DBGW ((DBGH)(0) << "Warning: ")
 #else
 #define DBGW                                                               \
   (DBG << "[\x1B[1m" << std::setw(20) << std::string(__FUNCTION__) << "()" \
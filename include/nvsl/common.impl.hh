@@ -14,7 +14,7 @@ inline std::string nvsl::ns_to_latex(size_t ns, const std::string &name,
   std::string result = "";
   size_t us, ms, s;
 
-  const auto name_fixed = nvsl::zip(nvsl::split(name, "_"), "");
+  const auto name_fixed = nvsl::zip(nvsl::split_view(name, "_"), "");
 
   us = ns / 100;
   ms = ns / 100000;
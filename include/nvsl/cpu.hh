@@ -0,0 +1,85 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   cpu.hh
+ * @date   octobre 14, 2026
+ * @brief  Runtime detection of CPU features using CPUID
+ */
+
+#pragma once
+
+#include <cpuid.h>
+#include <cstdint>
+
+namespace nvsl {
+  /** @brief CPU features relevant to the library, detected using CPUID */
+  struct CpuFeatures {
+    bool sse2 = false;
+    bool avx = false;
+    bool avx2 = false;
+    bool avx512f = false;
+    bool clflush = false;
+    bool clflushopt = false;
+    bool clwb = false;
+    bool rdtscp = false;
+    bool waitpkg = false; /**< UMONITOR, UMWAIT and TPAUSE */
+    bool invariant_tsc = false; /**< TSC runs at a constant rate in all states */
+  };
+
+  namespace detail {
+    /** @brief Check if the OS saves the given XCR0 state components */
+    inline bool os_saves_xstate(uint64_t mask) {
+      uint32_t eax, edx;
+      asm volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+
+      const uint64_t xcr0 = ((uint64_t)edx << 32) | eax;
+      return (xcr0 & mask) == mask;
+    }
+
+    inline CpuFeatures detect_cpu_features() {
+      CpuFeatures result;
+      unsigned int eax, ebx, ecx, edx;
+
+      if (not __get_cpuid(1, &eax, &ebx, &ecx, &edx)) return result;
+
+      result.sse2 = edx & bit_SSE2;
+      result.clflush = edx & (1 << 19); /* CLFSH, no bit_ macro in cpuid.h */
+
+      /* AVX state (XMM | YMM) has to be enabled by the OS using XSAVE */
+      const bool osxsave = ecx & bit_OSXSAVE;
+      const bool ymm_ok = osxsave and os_saves_xstate(0x6);
+      /* AVX-512 additionally needs opmask, ZMM_Hi256 and Hi16_ZMM */
+      const bool zmm_ok = osxsave and os_saves_xstate(0xe6);
+
+      result.avx = (ecx & bit_AVX) and ymm_ok;
+
+      if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        result.avx2 = (ebx & bit_AVX2) and ymm_ok;
+        result.avx512f = (ebx & bit_AVX512F) and zmm_ok;
+        result.clflushopt = ebx & bit_CLFLUSHOPT;
+        result.clwb = ebx & bit_CLWB;
+        result.waitpkg = ecx & (1 << 5); /* Not in older cpuid.h */
+      }
+
+      if (__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx)) {
+        result.rdtscp = edx & (1 << 27); /* No bit_ macro in cpuid.h */
+      }
+
+      if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) {
+        result.invariant_tsc = edx & (1 << 8);
+      }
+
+      return result;
+    }
+  } // namespace detail
+
+  /**
+   * @brief Features supported by the CPU the process is running on
+   * @details CPUID is executed on the first call, later calls return the
+   * cached result.
+   */
+  inline const CpuFeatures &cpu_features() {
+    static const CpuFeatures features = detail::detect_cpu_features();
+    return features;
+  }
+} // namespace nvsl
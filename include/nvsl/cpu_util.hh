@@ -0,0 +1,224 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   cpu_util.hh
+ * @date   octobre 14, 2026
+ * @brief  Background sampler of the aggregate and per-CPU utilization
+ */
+
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nvsl/error.hh"
+#include "nvsl/stats.hh"
+
+namespace nvsl {
+  /** @brief Configuration of a CpuUtilSampler */
+  struct CpuUtilConfig {
+    std::chrono::milliseconds interval{100};
+
+    /** Record the aggregate utilization (in %) into a StatsScalar by this
+        name, registered with StatsCollection. Empty to not export it. */
+    std::string stat_name = "";
+  };
+
+  /**
+   * @brief Samples /proc/stat from a background thread
+   * @details The file is kept open and read with pread() into a buffer that is
+   * reused, the numbers are parsed in place. Readers get the utilization over
+   * the last interval with a lock-free load, never blocking on the sampler.
+   * @code
+   * nvsl::CpuUtilSampler sampler;
+   * if (sampler.utilization() > 0.9) shed_load();
+   * @endcode
+   */
+  class CpuUtilSampler {
+  private:
+    struct CpuTimes {
+      uint64_t idle = 0, total = 0;
+    };
+
+    CpuUtilConfig cfg;
+    int fd = -1;
+    std::vector<char> buf;
+
+    /* Index 0 is the aggregate, index i + 1 is CPU i */
+    std::vector<CpuTimes> prev;
+    std::vector<uint8_t> seen; /* In the current sample */
+    std::unique_ptr<std::atomic<float>[]> util;
+    size_t slots;
+    std::atomic<uint64_t> sample_cnt = 0;
+
+    std::unique_ptr<StatsScalar> stat;
+
+    std::mutex lock;
+    std::condition_variable cv;
+    bool stopping = false;
+    std::thread thread;
+
+    static uint64_t parse_u64(const char *&cur, const char *end) {
+      while (cur < end and *cur == ' ') cur++;
+
+      uint64_t result = 0;
+      while (cur < end and *cur >= '0' and *cur <= '9') {
+        result = result * 10 + (*cur - '0');
+        cur++;
+      }
+
+      return result;
+    }
+
+    /** @brief Read the whole file into buf, returns the bytes read */
+    size_t read_stat() {
+      while (true) {
+        size_t done = 0;
+        ssize_t ret;
+        while ((ret = pread(fd, buf.data() + done, buf.size() - done, done)) >
+               0) {
+          done += ret;
+          if (done == buf.size()) break;
+        }
+
+        /* Only allocates if the file outgrows the buffer */
+        if (done < buf.size()) return done;
+        buf.resize(buf.size() * 2);
+      }
+    }
+
+    void sample() {
+      const size_t len = read_stat();
+      const char *cur = buf.data();
+      const char *end = cur + len;
+      std::fill(seen.begin(), seen.end(), 0);
+
+      while (cur + 3 <= end and cur[0] == 'c' and cur[1] == 'p' and
+             cur[2] == 'u') {
+        cur += 3;
+
+        size_t slot = 0;
+        if (cur < end and *cur >= '0' and *cur <= '9') {
+          slot = parse_u64(cur, end) + 1;
+        }
+
+        /* user nice system idle iowait irq softirq steal */
+        uint64_t vals[8];
+        for (auto &val : vals) val = parse_u64(cur, end);
+
+        const CpuTimes now = {vals[3] + vals[4],
+                              vals[0] + vals[1] + vals[2] + vals[3] + vals[4] +
+                                  vals[5] + vals[6] + vals[7]};
+
+        if (slot < slots) {
+          seen[slot] = 1;
+          auto &old = prev[slot];
+          const auto total = now.total - old.total;
+
+          if (old.total != 0 and total != 0) {
+            const float busy = 1.0 - (float)(now.idle - old.idle) / total;
+            util[slot].store(busy, std::memory_order_relaxed);
+
+            /* StatsScalar locks, the exporter can read it concurrently */
+            if (slot == 0 and stat != nullptr) *stat += busy * 100;
+          }
+          old = now;
+        }
+
+        while (cur < end and *cur != '\n') cur++;
+        cur++;
+      }
+
+      /* Offline CPUs are not listed, they need a new baseline once back */
+      for (size_t slot = 1; slot < slots; slot++) {
+        if (seen[slot]) continue;
+
+        prev[slot] = {};
+        util[slot].store(-1, std::memory_order_relaxed);
+      }
+
+      sample_cnt.fetch_add(1, std::memory_order_release);
+    }
+
+    void run() {
+      std::unique_lock<std::mutex> guard(lock);
+
+      while (not stopping) {
+        cv.wait_for(guard, cfg.interval);
+        if (stopping) break;
+
+        guard.unlock();
+        sample();
+        guard.lock();
+      }
+    }
+
+  public:
+    explicit CpuUtilSampler(const CpuUtilConfig &cfg = {})
+        : cfg(cfg), buf(64 * 1024) {
+      fd = open("/proc/stat", O_RDONLY | O_CLOEXEC);
+      if (fd == -1) NVSL_ERROR("Unable to open /proc/stat: " + PSTR());
+
+      slots = std::max(sysconf(_SC_NPROCESSORS_CONF), 1L) + 1;
+      prev.resize(slots);
+      seen.resize(slots);
+      util = std::make_unique<std::atomic<float>[]>(slots);
+      for (size_t i = 0; i < slots; i++) util[i] = -1;
+
+      if (not cfg.stat_name.empty()) {
+        stat = std::make_unique<StatsScalar>();
+        stat->init(cfg.stat_name, "CPU utilization in %");
+      }
+
+      sample(); /* Baseline for the first interval */
+      thread = std::thread([this]() { run(); });
+    }
+
+    CpuUtilSampler(const CpuUtilSampler &) = delete;
+    CpuUtilSampler &operator=(const CpuUtilSampler &) = delete;
+
+    ~CpuUtilSampler() {
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+      }
+      cv.notify_all();
+      thread.join();
+
+      close(fd);
+    }
+
+    /**
+     * @brief Utilization of all CPUs over the last interval
+     * @return Between 0 and 1, -1 until the first interval is over
+     */
+    float utilization() const {
+      return util[0].load(std::memory_order_relaxed);
+    }
+
+    /** @brief Utilization of one CPU, -1 if unknown or offline */
+    float utilization(size_t cpu) const {
+      if (cpu + 1 >= slots) return -1;
+      return util[cpu + 1].load(std::memory_order_relaxed);
+    }
+
+    /** @brief Number of CPUs reported by utilization(cpu) */
+    size_t cpu_count() const { return slots - 1; }
+
+    /** @brief Number of times /proc/stat was read */
+    uint64_t samples() const {
+      return sample_cnt.load(std::memory_order_acquire);
+    }
+  };
+} // namespace nvsl
@@ -43,6 +43,7 @@ static inline std::string print_stuff__(std::string msg, std::string dec) {
 #define NVSL_ERROR(msg)       \
   do {                        \
     DBGE << msg << std::endl; \
+    nvsl::flush_log();        \
     exit(1);                  \
   } while (0);
 #elif defined(BUILDING_PUDDLED) || defined(BUILDING_LIBCOMMON)
@@ -57,6 +58,7 @@ static inline std::string print_stuff__(std::string msg, std::string dec) {
       nvsl::dump_maps();                           \
       nvsl::print_trace();                         \
     }                                              \
+    nvsl::flush_log();                             \
     exit(1);                                       \
   } while (0);
 #endif // RELEASE
@@ -65,6 +67,7 @@ static inline std::string print_stuff__(std::string msg, std::string dec) {
 #define NVSL_ERROR_CLEAN(msg) \
   do {                        \
     DBGE << msg << std::endl; \
+    nvsl::flush_log();        \
     exit(1);                  \
   } while (0);
 
@@ -73,6 +76,7 @@ static inline std::string print_stuff__(std::string msg, std::string dec) {
   if (!(cond)) [[unlikely]] {                                      \
     DBGE << __FILE__ << ":" << __LINE__ << " Assertion `" << #cond \
          << "' failed: " << msg << std::endl;                      \
+    nvsl::flush_log();                                             \
     exit(1);                                                       \
     if (not get_env_val(NVSL_NO_STACKTRACE_ENV)) {                 \
       nvsl::print_trace();                                         \
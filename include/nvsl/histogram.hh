@@ -0,0 +1,567 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   histogram.hh
+ * @date   octobre 14, 2026
+ * @brief  Log-linear (HdrHistogram style) buckets with bounded relative error
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#ifndef NVSL_ERROR
+#include <cassert>
+#endif
+
+namespace nvsl {
+  /**
+   * @brief Maps values to log-linear buckets
+   * @details Values below 2^sub_bits get a bucket each. Every power of two
+   * above that is split into 2^(sub_bits - 1) linear buckets, so a bucket's
+   * width is at most 2^-(sub_bits - 1) of its lower bound. Finding the bucket
+   * of a value takes a clz and a shift, no division.
+   */
+  class LogLinearBuckets {
+  private:
+    unsigned sub_bits_;
+    uint64_t max_value_;
+    size_t count_;
+
+  public:
+    static constexpr unsigned DEFAULT_SUB_BITS = 5; /**< ~3% relative error */
+
+    /**
+     * @param[in] max_value Largest value that gets a bucket
+     * @param[in] sub_bits Precision in bits, from 1 to 16
+     */
+    explicit LogLinearBuckets(uint64_t max_value = UINT32_MAX,
+                              unsigned sub_bits = DEFAULT_SUB_BITS)
+        : sub_bits_(std::clamp(sub_bits, 1U, 16U)),
+          max_value_(std::max(max_value, (uint64_t)1)) {
+      count_ = index(max_value_) + 1;
+    }
+
+    /** @brief Bucket of a value, val must not be larger than max_value() */
+    size_t index(uint64_t val) const {
+      if (val < (1UL << sub_bits_)) return val;
+
+      const unsigned msb = 63 - __builtin_clzl(val);
+      const unsigned shift = msb - sub_bits_ + 1;
+      const size_t group_base = (size_t)shift << (sub_bits_ - 1);
+
+      return group_base + (val >> shift);
+    }
+
+    /** @brief Smallest value in a bucket */
+    uint64_t lower(size_t idx) const {
+      const size_t half = 1UL << (sub_bits_ - 1);
+      if (idx < 2 * half) return idx;
+
+      const unsigned shift = (idx >> (sub_bits_ - 1)) - 1;
+      const uint64_t sub = (idx & (half - 1)) | half;
+
+      return sub << shift;
+    }
+
+    /** @brief Largest value in a bucket */
+    uint64_t upper(size_t idx) const {
+      const size_t half = 1UL << (sub_bits_ - 1);
+      if (idx < 2 * half) return idx;
+
+      const unsigned shift = (idx >> (sub_bits_ - 1)) - 1;
+      return lower(idx) + (1UL << shift) - 1;
+    }
+
+    size_t size() const { return count_; }
+    unsigned sub_bits() const { return sub_bits_; }
+    uint64_t max_value() const { return max_value_; }
+
+    bool operator==(const LogLinearBuckets &other) const {
+      return sub_bits_ == other.sub_bits_ and max_value_ == other.max_value_;
+    }
+  };
+
+  /**
+   * @brief Single-threaded log-linear histogram
+   * @details Values larger than max_value() are counted as overflow. The exact
+   * min and max are tracked so percentiles at the edges are exact.
+   * Histograms with the same layout can be merged, and serialize() /
+   * deserialize() move them between processes.
+   */
+  class LogLinearHistogram {
+  private:
+    LogLinearBuckets buckets;
+    std::vector<uint64_t> counts;
+    uint64_t overflow_cnt = 0, total_cnt = 0;
+    uint64_t min_val = UINT64_MAX, max_val = 0;
+    long double sum_val = 0;
+
+  public:
+    explicit LogLinearHistogram(
+        uint64_t max_value = UINT32_MAX,
+        unsigned sub_bits = LogLinearBuckets::DEFAULT_SUB_BITS)
+        : buckets(max_value, sub_bits), counts(buckets.size(), 0) {}
+
+    explicit LogLinearHistogram(const LogLinearBuckets &buckets)
+        : buckets(buckets), counts(buckets.size(), 0) {}
+
+    /** @brief Record val, count times */
+    void add(uint64_t val, uint64_t count = 1) {
+      if (count == 0) return;
+
+      if (val > buckets.max_value()) {
+        overflow_cnt += count;
+      } else {
+        counts[buckets.index(val)] += count;
+      }
+
+      total_cnt += count;
+      sum_val += (long double)val * count;
+      min_val = std::min(min_val, val);
+      max_val = std::max(max_val, val);
+    }
+
+    /** @brief Add the samples of another histogram with the same layout */
+    void merge(const LogLinearHistogram &other) {
+      if (not(buckets == other.buckets)) {
+#ifdef NVSL_ERROR
+        NVSL_ERROR("Cannot merge histograms with different buckets");
+#else
+        assert(0 && "Cannot merge histograms with different buckets");
+#endif
+      }
+
+      for (size_t i = 0; i < counts.size(); i++) {
+        counts[i] += other.counts[i];
+      }
+
+      overflow_cnt += other.overflow_cnt;
+      total_cnt += other.total_cnt;
+      sum_val += other.sum_val;
+      min_val = std::min(min_val, other.min_val);
+      max_val = std::max(max_val, other.max_val);
+    }
+
+    /**
+     * @brief Add count samples directly to a bucket
+     * @details Used to rebuild a histogram from bucket counts. The samples are
+     * assumed to be at the bucket's lower bound for the mean, and at its edges
+     * for min/max. idx == layout().size() adds to the overflow count.
+     */
+    void add_to_bucket(size_t idx, uint64_t count) {
+      if (count == 0) return;
+
+      if (idx >= counts.size()) {
+        overflow_cnt += count;
+        max_val = std::max(max_val, buckets.max_value() + 1);
+        min_val = std::min(min_val, buckets.max_value() + 1);
+        sum_val += (long double)(buckets.max_value() + 1) * count;
+      } else {
+        counts[idx] += count;
+        sum_val += (long double)buckets.lower(idx) * count;
+        min_val = std::min(min_val, buckets.lower(idx));
+        max_val = std::max(max_val, buckets.upper(idx));
+      }
+
+      total_cnt += count;
+    }
+
+    /**
+     * @brief Value at a percentile
+     * @param[in] pc Percentile out of 100
+     * @return Largest value in the bucket holding the sample at that rank,
+     * clamped to the recorded [min, max]. The minimum for pc <= 0, 0 if the
+     * histogram is empty.
+     */
+    uint64_t percentile(double pc) const {
+      if (total_cnt == 0) return 0;
+      if (pc <= 0) return min_val;
+
+      const auto rank = (uint64_t)std::clamp(
+          std::ceil((long double)pc / 100 * total_cnt), 1.0L,
+          (long double)total_cnt);
+
+      uint64_t seen = 0;
+      for (size_t i = 0; i < counts.size(); i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+          return std::clamp(buckets.upper(i), min_val, max_val);
+        }
+      }
+
+      return max_val; /* In the overflow bucket */
+    }
+
+    uint64_t total() const { return total_cnt; }
+    uint64_t overflow_count() const { return overflow_cnt; }
+    uint64_t bucket_count(size_t idx) const { return counts[idx]; }
+    uint64_t min() const { return total_cnt == 0 ? 0 : min_val; }
+    uint64_t max() const { return max_val; }
+    double mean() const {
+      return total_cnt == 0 ? 0 : (double)(sum_val / total_cnt);
+    }
+    const LogLinearBuckets &layout() const { return buckets; }
+
+    void reset() {
+      std::fill(counts.begin(), counts.end(), 0);
+      overflow_cnt = total_cnt = max_val = 0;
+      min_val = UINT64_MAX;
+      sum_val = 0;
+    }
+
+    /**
+     * @brief Compact text form, only non-empty buckets are written
+     * @details Format: `llh <sub_bits> <max_value> <overflow> <min> <max>
+     * <sum> <n> [<idx>:<count>]...`
+     */
+    std::string serialize() const {
+      std::stringstream ss;
+      size_t nonzero = 0;
+      for (const auto cnt : counts) nonzero += cnt != 0;
+
+      ss.precision(std::numeric_limits<long double>::max_digits10);
+      ss << "llh " << buckets.sub_bits() << " " << buckets.max_value() << " "
+         << overflow_cnt << " " << min_val << " " << max_val << " " << sum_val
+         << " " << nonzero;
+      for (size_t i = 0; i < counts.size(); i++) {
+        if (counts[i] != 0) ss << " " << i << ":" << counts[i];
+      }
+
+      return ss.str();
+    }
+
+    /** @brief Parse the output of serialize() */
+    static LogLinearHistogram deserialize(const std::string &str) {
+      std::stringstream ss(str);
+      std::string magic;
+      unsigned sub_bits = 0;
+      uint64_t max_value = 0;
+      size_t nonzero = 0;
+
+      ss >> magic >> sub_bits >> max_value;
+      LogLinearHistogram result(max_value, sub_bits);
+      ss >> result.overflow_cnt >> result.min_val >> result.max_val >>
+          result.sum_val >> nonzero;
+
+      result.total_cnt = result.overflow_cnt;
+      for (size_t i = 0; i < nonzero and ss; i++) {
+        size_t idx;
+        char colon;
+        uint64_t cnt;
+
+        ss >> idx >> colon >> cnt;
+        if (idx < result.counts.size()) {
+          result.counts[idx] = cnt;
+          result.total_cnt += cnt;
+        } else {
+          ss.setstate(std::ios::failbit);
+        }
+      }
+
+      if (magic != "llh" or ss.fail()) {
+#ifdef NVSL_ERROR
+        NVSL_ERROR("Malformed histogram: " << str);
+#else
+        assert(0 && "Malformed histogram");
+#endif
+      }
+
+      return result;
+    }
+  };
+
+  /**
+   * @brief Mergeable streaming quantile sketch with bounded relative error
+   * @details Works like DDSketch, but uses log-linear buckets: the bucket of
+   * a double is the exponent and the top SUB_BITS bits of the mantissa, so
+   * adding a value takes no log(). The relative error of a quantile is at most
+   * 2^-(SUB_BITS + 1) (~1.6%). Memory is bounded by max_bins per sign; when
+   * exceeded, the lowest buckets are collapsed, keeping the upper quantiles
+   * accurate.
+   *
+   * Counts are relaxed atomics and outgrown bucket arrays are only freed with
+   * the sketch, so other threads can copy the sketch while its one writer
+   * adds to it. Such a copy never touches freed memory but can be
+   * inconsistent, StatsScalar validates it with a seqlock.
+   */
+  class QuantileSketch {
+  private:
+    static constexpr unsigned SUB_BITS = 5;
+    static constexpr unsigned KEY_SHIFT = 52 - SUB_BITS;
+    static constexpr size_t DEFAULT_MAX_BINS = 2048;
+    static constexpr size_t MIN_BINS = 16;
+
+    /** @brief Dense counts for consecutive keys starting at offset */
+    class Store {
+    private:
+      struct Bins {
+        const size_t cap;
+        std::unique_ptr<std::atomic<uint64_t>[]> cnt;
+
+        explicit Bins(size_t cap)
+            : cap(cap), cnt(std::make_unique<std::atomic<uint64_t>[]>(cap)) {}
+      };
+
+      /** All the arrays ever used, the last one is cur. Writer only. */
+      std::vector<std::unique_ptr<Bins>> arrays;
+      std::atomic<Bins *> cur = nullptr;
+      std::atomic<int64_t> offset = 0;
+      std::atomic<size_t> used = 0;
+
+      static uint64_t get(const Bins *bins, size_t i) {
+        return bins->cnt[i].load(std::memory_order_relaxed);
+      }
+
+      static void set(Bins *bins, size_t i, uint64_t val) {
+        bins->cnt[i].store(val, std::memory_order_relaxed);
+      }
+
+      /**
+       * @brief Array with room for n bins, keeping the first `keep` counts
+       * @details Arrays grow by doubling up to max_bins. The old array stays
+       * allocated for readers that still use it.
+       */
+      Bins *reserve(size_t keep, size_t n, size_t max_bins) {
+        auto *bins = cur.load(std::memory_order_relaxed);
+        if (bins != nullptr and bins->cap >= n) return bins;
+
+        const size_t old_cap = bins == nullptr ? 0 : bins->cap;
+        const auto cap =
+            std::max(n, std::min(std::max(old_cap * 2, MIN_BINS), max_bins));
+        auto fresh = std::make_unique<Bins>(cap);
+        for (size_t i = 0; i < keep; i++) set(fresh.get(), i, get(bins, i));
+
+        cur.store(fresh.get(), std::memory_order_release);
+        arrays.push_back(std::move(fresh));
+        return arrays.back().get();
+      }
+
+    public:
+      /** @brief Reader's copy of the bounds of the store */
+      struct View {
+        const Bins *bins = nullptr;
+        int64_t offset = 0;
+        size_t size = 0;
+
+        uint64_t operator[](size_t i) const { return get(bins, i); }
+      };
+
+      Store() = default;
+      Store(const Store &other) { *this = other; }
+
+      Store &operator=(const Store &other) {
+        if (this == &other) return *this;
+
+        const auto view = other.view();
+        used.store(0, std::memory_order_relaxed);
+        if (view.size != 0) {
+          auto *bins = reserve(0, view.size, view.size);
+          for (size_t i = 0; i < view.size; i++) set(bins, i, view[i]);
+        }
+
+        offset.store(view.offset, std::memory_order_relaxed);
+        used.store(view.size, std::memory_order_relaxed);
+        return *this;
+      }
+
+      View view() const {
+        const auto *bins = cur.load(std::memory_order_acquire);
+        if (bins == nullptr) return {};
+
+        const auto size = std::min(used.load(std::memory_order_relaxed),
+                                   bins->cap);
+        return {bins, offset.load(std::memory_order_relaxed), size};
+      }
+
+      void add(int64_t key, uint64_t count, size_t max_bins) {
+        auto n = used.load(std::memory_order_relaxed);
+        auto off = offset.load(std::memory_order_relaxed);
+        auto *bins = cur.load(std::memory_order_relaxed);
+
+        if (n == 0) {
+          bins = reserve(0, 1, max_bins);
+          set(bins, 0, 0);
+          off = key;
+          n = 1;
+        } else if (key < off) {
+          /* Grow towards the lower keys, or collapse into the lowest bin */
+          const auto grow = (size_t)(off - key);
+          if (n + grow > max_bins) {
+            key = off;
+          } else {
+            bins = reserve(n, n + grow, max_bins);
+            for (size_t i = n; i-- > 0;) set(bins, i + grow, get(bins, i));
+            for (size_t i = 0; i < grow; i++) set(bins, i, 0);
+            off = key;
+            n += grow;
+          }
+        } else if (key >= off + (int64_t)n) {
+          auto need = (size_t)(key - off) + 1;
+
+          if (need > max_bins) {
+            /* Collapse the lowest bins, key becomes the highest bin */
+            const auto extra = need - max_bins;
+            uint64_t collapsed = 0;
+            for (size_t i = 0; i <= extra and i < n; i++) {
+              collapsed += get(bins, i);
+            }
+            for (size_t i = extra + 1; i < n; i++) {
+              set(bins, i - extra, get(bins, i));
+            }
+
+            set(bins, 0, collapsed);
+            n = n > extra ? n - extra : 1;
+            off += extra;
+            need = max_bins;
+          }
+
+          bins = reserve(n, need, max_bins);
+          for (size_t i = n; i < need; i++) set(bins, i, 0);
+          n = need;
+        }
+
+        set(bins, key - off, get(bins, key - off) + count);
+        offset.store(off, std::memory_order_relaxed);
+        used.store(n, std::memory_order_relaxed);
+      }
+
+      /** @brief Drop the counts, keeps the arrays for concurrent readers */
+      void reset() { used.store(0, std::memory_order_relaxed); }
+    };
+
+    Store pos, neg;
+    std::atomic<uint64_t> zero_cnt = 0, total_cnt = 0;
+    size_t max_bins;
+
+    static void bump(std::atomic<uint64_t> &cnt, uint64_t n) {
+      cnt.store(cnt.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+    }
+
+    static int64_t key(double val) {
+      uint64_t bits;
+      memcpy(&bits, &val, sizeof(bits));
+      return (int64_t)(bits >> KEY_SHIFT);
+    }
+
+    static double from_bits(uint64_t bits) {
+      double result;
+      memcpy(&result, &bits, sizeof(result));
+      return result;
+    }
+
+    /** @brief Middle of the bucket of a key */
+    static double value(int64_t key) {
+      const auto lo = from_bits((uint64_t)key << KEY_SHIFT);
+      const auto hi = from_bits((uint64_t)(key + 1) << KEY_SHIFT);
+      return lo + (hi - lo) / 2;
+    }
+
+  public:
+    explicit QuantileSketch(size_t max_bins = DEFAULT_MAX_BINS)
+        : max_bins(std::max(max_bins, (size_t)1)) {}
+
+    QuantileSketch(const QuantileSketch &other) : max_bins(other.max_bins) {
+      *this = other;
+    }
+
+    QuantileSketch &operator=(const QuantileSketch &other) {
+      if (this == &other) return *this;
+
+      pos = other.pos;
+      neg = other.neg;
+      zero_cnt.store(other.zero_cnt.load(std::memory_order_relaxed),
+                     std::memory_order_relaxed);
+      total_cnt.store(other.total_cnt.load(std::memory_order_relaxed),
+                      std::memory_order_relaxed);
+      max_bins = other.max_bins;
+      return *this;
+    }
+
+    /** @brief Record val, count times. NaN is ignored. */
+    void add(double val, uint64_t count = 1) {
+      if (std::isnan(val) or count == 0) return;
+
+      if (val > std::numeric_limits<double>::min()) {
+        pos.add(key(val), count, max_bins);
+      } else if (val < -std::numeric_limits<double>::min()) {
+        neg.add(key(-val), count, max_bins);
+      } else {
+        bump(zero_cnt, count);
+      }
+
+      bump(total_cnt, count);
+    }
+
+    /** @brief Add the samples of another sketch */
+    void merge(const QuantileSketch &other) {
+      const auto other_pos = other.pos.view();
+      for (size_t i = 0; i < other_pos.size; i++) {
+        if (other_pos[i] == 0) continue;
+        pos.add(other_pos.offset + (int64_t)i, other_pos[i], max_bins);
+      }
+
+      const auto other_neg = other.neg.view();
+      for (size_t i = 0; i < other_neg.size; i++) {
+        if (other_neg[i] == 0) continue;
+        neg.add(other_neg.offset + (int64_t)i, other_neg[i], max_bins);
+      }
+
+      bump(zero_cnt, other.zero_cnt.load(std::memory_order_relaxed));
+      bump(total_cnt, other.count());
+    }
+
+    /**
+     * @brief Estimated value at a quantile
+     * @param[in] q Quantile between 0 and 1
+     * @return 0 if the sketch is empty
+     */
+    double quantile(double q) const {
+      const auto total = count();
+      if (total == 0) return 0;
+
+      const auto rank =
+          (uint64_t)std::clamp(std::ceil(q * total), 1.0, (double)total);
+      const auto pos_bins = pos.view(), neg_bins = neg.view();
+      uint64_t seen = 0;
+
+      /* Most negative values first */
+      for (size_t i = neg_bins.size; i-- > 0;) {
+        seen += neg_bins[i];
+        if (seen >= rank) return -value(neg_bins.offset + (int64_t)i);
+      }
+
+      seen += zero_cnt.load(std::memory_order_relaxed);
+      if (seen >= rank) return 0;
+
+      for (size_t i = 0; i < pos_bins.size; i++) {
+        seen += pos_bins[i];
+        if (seen >= rank) return value(pos_bins.offset + (int64_t)i);
+      }
+
+      return value(pos_bins.offset + (int64_t)pos_bins.size - 1);
+    }
+
+    uint64_t count() const {
+      return total_cnt.load(std::memory_order_relaxed);
+    }
+
+    void reset() {
+      pos.reset();
+      neg.reset();
+      zero_cnt.store(0, std::memory_order_relaxed);
+      total_cnt.store(0, std::memory_order_relaxed);
+    }
+  };
+} // namespace nvsl
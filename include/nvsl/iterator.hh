@@ -3,7 +3,7 @@
 /**
  * @file   iterator.hh
  * @date   janvier 24, 2024
- * @brief  Implements indices operation
+ * @brief  Implements range(), step() and indices()
  *
  * @license Licensed under the Apache License, Version 2.0 (the "License"); from
  *          https://github.com/klmr/cpp11-range/
@@ -11,16 +11,26 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cmath>
+#include <cstddef>
+#include <initializer_list>
 #include <iterator>
 #include <type_traits>
+#include <vector>
 
 namespace nvsl {
 
   namespace detail {
 
     template <typename T>
-    struct range_iter_base : std::iterator<std::input_iterator_tag, T> {
+    struct range_iter_base {
+      using iterator_category = std::input_iterator_tag;
+      using value_type = T;
+      using difference_type = std::ptrdiff_t;
+      using pointer = T const *;
+      using reference = T;
+
       range_iter_base(T current) : current(current) {}
 
       T operator*() const { return current; }
@@ -52,65 +62,214 @@ namespace nvsl {
 
   } // namespace detail
 
+  /**
+   * @brief Random access range that advances by a step
+   * @details Elements are computed as begin + i * step, there is no error
+   * accumulated with floating point steps.
+   */
   template <typename T>
   struct step_range_proxy {
     struct iterator : detail::range_iter_base<T> {
-      iterator(T current, T step)
-          : detail::range_iter_base<T>(current), step_(step) {}
-
+      using iterator_category = std::random_access_iterator_tag;
+      using iterator_concept = std::random_access_iterator_tag;
+      using difference_type = std::ptrdiff_t;
       using detail::range_iter_base<T>::current;
 
-      iterator &operator++() {
-        current += step_;
+      iterator() : iterator(T(), T(), 0) {}
+      iterator(T start, T step, difference_type idx)
+          : detail::range_iter_base<T>(static_cast<T>(start + idx * step)),
+            start_(start), step_(step), idx_(idx) {}
+
+      iterator &operator+=(difference_type n) {
+        idx_ += n;
+        current = static_cast<T>(start_ + idx_ * step_);
         return *this;
       }
 
+      iterator &operator-=(difference_type n) { return *this += -n; }
+      iterator &operator++() { return *this += 1; }
+      iterator &operator--() { return *this -= 1; }
+
       iterator operator++(int) {
         auto copy = *this;
         ++*this;
         return copy;
       }
 
-      // Loses commutativity. Iterator-based ranges are simply broken. :-(
+      iterator operator--(int) {
+        auto copy = *this;
+        --*this;
+        return copy;
+      }
+
+      iterator operator+(difference_type n) const {
+        return iterator(start_, step_, idx_ + n);
+      }
+
+      friend iterator operator+(difference_type n, iterator const &it) {
+        return it + n;
+      }
+
+      iterator operator-(difference_type n) const { return *this + -n; }
+
+      difference_type operator-(iterator const &other) const {
+        return idx_ - other.idx_;
+      }
+
+      T operator[](difference_type n) const { return *(*this + n); }
+
       bool operator==(iterator const &other) const {
-        return step_ > 0 ? current >= other.current : current < other.current;
+        return idx_ == other.idx_;
       }
 
       bool operator!=(iterator const &other) const {
         return not(*this == other);
       }
 
-      T step_;
+      bool operator<(iterator const &other) const { return idx_ < other.idx_; }
+      bool operator>(iterator const &other) const { return other < *this; }
+      bool operator<=(iterator const &other) const {
+        return not(other < *this);
+      }
+      bool operator>=(iterator const &other) const {
+        return not(*this < other);
+      }
+
+    private:
+      T start_, step_;
+      difference_type idx_;
     };
 
     step_range_proxy(T begin, T end, T step)
-        : begin_(begin, step), end_(end, step) {}
+        : step_range_proxy(sized_tag{}, begin, step, count(begin, end, step)) {}
 
-    iterator begin() const { return begin_; }
+    iterator begin() const { return {begin_, step_, 0}; }
 
-    iterator end() const { return end_; }
+    iterator end() const { return {begin_, step_, (std::ptrdiff_t)size_}; }
 
-    std::size_t size() const {
-      if (*end_ >= *begin_) {
+    std::size_t size() const { return size_; }
+
+    T operator[](std::size_t i) const {
+      return static_cast<T>(begin_ + i * step_);
+    }
+
+    /** @brief Split into ranges of at most n elements, in order */
+    std::vector<step_range_proxy> chunks(std::size_t n) const {
+      std::vector<step_range_proxy> result;
+      n = std::max(n, (std::size_t)1);
+
+      for (std::size_t i = 0; i < size_; i += n) {
+        result.push_back(
+            step_range_proxy(sized_tag{}, (*this)[i], step_,
+                             std::min(n, size_ - i)));
+      }
+
+      return result;
+    }
+
+  private:
+    T begin_, step_;
+    std::size_t size_;
+
+    struct sized_tag {};
+
+    step_range_proxy(sized_tag, T begin, T step, std::size_t size)
+        : begin_(begin), step_(step), size_(size) {}
+
+    static std::size_t count(T begin, T end, T step) {
+      if (end >= begin) {
         // Increasing and empty range
-        if (begin_.step_ < T{0}) return 0;
+        if (not(step > T{0})) return 0;
       } else {
         // Decreasing range
-        if (begin_.step_ > T{0}) return 0;
+        if (not(step < T{0})) return 0;
       }
       return std::ceil(
-          std::abs(static_cast<double>(*end_ - *begin_) / begin_.step_));
+          std::abs(static_cast<double>(end - begin) / step));
     }
-
-  private:
-    iterator begin_;
-    iterator end_;
   };
 
+  /**
+   * @brief Random access range of [begin, end)
+   * @details size() and operator[] are O(1) and the iterators are random
+   * access, so ranges can be split with chunks() or given to parallel_for()
+   * and the parallel STL algorithms.
+   */
   template <typename T>
   struct range_proxy {
     struct iterator : detail::range_iter_base<T> {
-      iterator(T current) : detail::range_iter_base<T>(current) {}
+      using iterator_category = std::random_access_iterator_tag;
+      using iterator_concept = std::random_access_iterator_tag;
+      using difference_type = std::ptrdiff_t;
+      using detail::range_iter_base<T>::current;
+
+      iterator(T current = T()) : detail::range_iter_base<T>(current) {}
+
+      iterator &operator+=(difference_type n) {
+        current = static_cast<T>(current + n);
+        return *this;
+      }
+
+      iterator &operator-=(difference_type n) {
+        current = static_cast<T>(current - n);
+        return *this;
+      }
+
+      iterator &operator++() { return *this += 1; }
+      iterator &operator--() { return *this -= 1; }
+
+      iterator operator++(int) {
+        auto copy = *this;
+        ++*this;
+        return copy;
+      }
+
+      iterator operator--(int) {
+        auto copy = *this;
+        --*this;
+        return copy;
+      }
+
+      iterator operator+(difference_type n) const {
+        auto copy = *this;
+        return copy += n;
+      }
+
+      friend iterator operator+(difference_type n, iterator const &it) {
+        return it + n;
+      }
+
+      iterator operator-(difference_type n) const {
+        auto copy = *this;
+        return copy -= n;
+      }
+
+      difference_type operator-(iterator const &other) const {
+        return static_cast<difference_type>(current - other.current);
+      }
+
+      T operator[](difference_type n) const {
+        return static_cast<T>(current + n);
+      }
+
+      bool operator==(iterator const &other) const {
+        return current == other.current;
+      }
+
+      bool operator!=(iterator const &other) const {
+        return not(*this == other);
+      }
+
+      bool operator<(iterator const &other) const {
+        return current < other.current;
+      }
+      bool operator>(iterator const &other) const { return other < *this; }
+      bool operator<=(iterator const &other) const {
+        return not(other < *this);
+      }
+      bool operator>=(iterator const &other) const {
+        return not(*this < other);
+      }
     };
 
     range_proxy(T begin, T end) : begin_(begin), end_(end) {}
@@ -119,9 +278,25 @@ namespace nvsl {
 
     iterator begin() const { return begin_; }
 
-    iterator end() const { return end_; }
+    // An empty range if end is before begin, use step() to go backwards
+    iterator end() const { return *end_ > *begin_ ? end_ : begin_; }
+
+    std::size_t size() const { return *end() - *begin_; }
 
-    std::size_t size() const { return *end_ - *begin_; }
+    T operator[](std::size_t i) const { return static_cast<T>(*begin_ + i); }
+
+    /** @brief Split into ranges of at most n elements, in order */
+    std::vector<range_proxy> chunks(std::size_t n) const {
+      std::vector<range_proxy> result;
+      n = std::max(n, (std::size_t)1);
+
+      for (std::size_t i = 0; i < size(); i += n) {
+        result.push_back(
+            range_proxy((*this)[i], (*this)[std::min(i + n, size())]));
+      }
+
+      return result;
+    }
 
   private:
     iterator begin_;
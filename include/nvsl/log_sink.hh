@@ -0,0 +1,395 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   log_sink.hh
+ * @date   octobre 14, 2026
+ * @brief  Asynchronous sink for DBGH() using per-thread ring buffers
+ */
+
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace nvsl {
+  /** @brief Configuration of the async DBGH() sink */
+  struct AsyncLogConfig {
+    std::string path;                      /**< File to append the logs to */
+    size_t ring_bytes = 1024 * 1024;       /**< Per-thread buffer, power of 2 */
+    size_t batch_bytes = 64 * 1024;        /**< Bytes per write() */
+    std::chrono::milliseconds interval{10}; /**< Time between drains */
+  };
+
+  namespace detail {
+    /* Followed by caller_len bytes of caller name and len bytes of text */
+    struct LogRecordHeader {
+      uint64_t timestamp_ns;
+      uint32_t caller_len;
+      uint32_t len;
+      uint8_t level;
+    };
+
+    /**
+     * @brief Single-producer single-consumer ring of log records
+     * @details The owning thread pushes, the sink drains under its drain lock.
+     * Records that don't fit are dropped and counted.
+     */
+    class LogRing {
+    private:
+      std::vector<char> buf;
+      const uint64_t mask;
+
+      alignas(64) std::atomic<uint64_t> head = 0; /* Written by the producer */
+      alignas(64) std::atomic<uint64_t> tail = 0; /* Written by the consumer */
+
+      void copy_in(uint64_t pos, const void *src, size_t len) {
+        const auto off = pos & mask;
+        const auto first = std::min(len, buf.size() - off);
+
+        memcpy(&buf[off], src, first);
+        memcpy(&buf[0], (const char *)src + first, len - first);
+      }
+
+      void copy_out(uint64_t pos, void *dst, size_t len) const {
+        const auto off = pos & mask;
+        const auto first = std::min(len, buf.size() - off);
+
+        memcpy(dst, &buf[off], first);
+        memcpy((char *)dst + first, &buf[0], len - first);
+      }
+
+    public:
+      std::atomic<uint64_t> dropped = 0;
+      std::atomic<bool> closed = false; /**< Producer thread exited */
+
+      static size_t round_up_pow2(size_t val) {
+        size_t result = 64;
+        while (result < val) result <<= 1;
+        return result;
+      }
+
+      explicit LogRing(size_t bytes)
+          : buf(round_up_pow2(bytes)), mask(buf.size() - 1) {}
+
+      bool push(const LogRecordHeader &hdr, const char *caller,
+                const char *msg) {
+        const size_t total = sizeof(hdr) + hdr.caller_len + hdr.len;
+        const auto h = head.load(std::memory_order_relaxed);
+        const auto t = tail.load(std::memory_order_acquire);
+
+        if (buf.size() - (h - t) < total) {
+          dropped.fetch_add(1, std::memory_order_relaxed);
+          return false;
+        }
+
+        copy_in(h, &hdr, sizeof(hdr));
+        copy_in(h + sizeof(hdr), caller, hdr.caller_len);
+        copy_in(h + sizeof(hdr) + hdr.caller_len, msg, hdr.len);
+        head.store(h + total, std::memory_order_release);
+
+        return true;
+      }
+
+      bool empty() const {
+        return head.load(std::memory_order_acquire) ==
+               tail.load(std::memory_order_relaxed);
+      }
+
+      /** @brief Call fn(header, caller, message) for every pending record */
+      template <typename Fn>
+      void drain(Fn &&fn) {
+        auto t = tail.load(std::memory_order_relaxed);
+        const auto h = head.load(std::memory_order_acquire);
+        std::string caller, msg;
+
+        while (t < h) {
+          LogRecordHeader hdr;
+          copy_out(t, &hdr, sizeof(hdr));
+
+          caller.resize(hdr.caller_len);
+          copy_out(t + sizeof(hdr), caller.data(), hdr.caller_len);
+          msg.resize(hdr.len);
+          copy_out(t + sizeof(hdr) + hdr.caller_len, msg.data(), hdr.len);
+          fn(hdr, caller, msg);
+
+          t += sizeof(hdr) + hdr.caller_len + hdr.len;
+        }
+
+        tail.store(t, std::memory_order_release);
+      }
+    };
+
+    /**
+     * @brief Drains the rings of all threads to a file
+     * @details There is a single instance that is never freed, so a thread
+     * logging while the process exits can't use a destroyed sink.
+     */
+    class AsyncLogSink {
+    private:
+      std::mutex lock; /* Guards starting and stopping */
+      AsyncLogConfig cfg;
+      int fd = -1;
+
+      std::mutex rings_lock;
+      std::vector<std::shared_ptr<LogRing>> rings;
+
+      std::mutex drain_lock; /* Held by the single consumer of the rings */
+      std::string out;
+
+      std::mutex cv_lock;
+      std::condition_variable cv;
+      bool stopping = false;
+      std::thread thread;
+
+      void write_out() {
+        size_t done = 0;
+        while (fd != -1 and done < out.size()) {
+          const auto ret = ::write(fd, out.data() + done, out.size() - done);
+          if (ret < 0) {
+            if (errno == EINTR) continue;
+            break; /* Nowhere to report it, the logs are lost */
+          }
+          done += ret;
+        }
+        out.clear();
+      }
+
+      void format(const LogRecordHeader &hdr, const std::string &caller,
+                  const std::string &msg) {
+        char ts[32];
+        snprintf(ts, sizeof(ts), "%lu.%09lu ",
+                 (unsigned long)(hdr.timestamp_ns / 1000000000),
+                 (unsigned long)(hdr.timestamp_ns % 1000000000));
+
+        out += ts;
+#ifdef NVSL_TRACE_APP_NAME
+        out += "[" + std::string(NVSL_TRACE_APP_NAME) + "]";
+#endif
+        out += "[";
+        out += caller;
+        out += "()]:" + std::to_string(hdr.level) + " ";
+        out += msg;
+        if (msg.empty() or msg.back() != '\n') out += '\n';
+
+        if (out.size() >= cfg.batch_bytes) write_out();
+      }
+
+      void run() {
+        std::unique_lock<std::mutex> guard(cv_lock);
+
+        while (not stopping) {
+          cv.wait_for(guard, cfg.interval);
+
+          guard.unlock();
+          drain();
+          guard.lock();
+        }
+      }
+
+    public:
+      std::atomic<bool> active = false;
+      std::atomic<size_t> ring_bytes = AsyncLogConfig().ring_bytes;
+
+      /** @brief Ring of the calling thread, created on first use */
+      LogRing &this_ring() {
+        struct Owner {
+          std::shared_ptr<LogRing> ring;
+          ~Owner() {
+            if (ring) ring->closed.store(true, std::memory_order_release);
+          }
+        };
+        thread_local Owner owner;
+
+        if (owner.ring == nullptr) [[unlikely]] {
+          std::lock_guard<std::mutex> guard(rings_lock);
+          owner.ring = std::make_shared<LogRing>(ring_bytes.load());
+          rings.push_back(owner.ring);
+        }
+
+        return *owner.ring;
+      }
+
+      /** @brief Write all pending records, safe to call from any thread */
+      void drain() {
+        std::lock_guard<std::mutex> drain_guard(drain_lock);
+
+        std::vector<std::shared_ptr<LogRing>> cur;
+        {
+          std::lock_guard<std::mutex> guard(rings_lock);
+          cur = rings;
+        }
+
+        for (auto &ring : cur) {
+          ring->drain([&](const LogRecordHeader &hdr,
+                          const std::string &caller, const std::string &msg) {
+            format(hdr, caller, msg);
+          });
+
+          const auto dropped = ring->dropped.exchange(0);
+          if (dropped != 0) {
+            out += "[nvsl] dropped " + std::to_string(dropped) +
+                   " log records, ring buffer full\n";
+          }
+        }
+        write_out();
+
+        /* Forget the rings of exited threads once they are empty */
+        std::lock_guard<std::mutex> guard(rings_lock);
+        rings.erase(std::remove_if(rings.begin(), rings.end(),
+                                   [](const auto &ring) {
+                                     return ring->closed.load() and
+                                            ring->empty();
+                                   }),
+                    rings.end());
+      }
+
+      bool start(const AsyncLogConfig &config) {
+        std::lock_guard<std::mutex> guard(lock);
+        stop_locked();
+
+        const int new_fd =
+            open(config.path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (new_fd == -1) return false;
+
+        {
+          std::lock_guard<std::mutex> drain_guard(drain_lock);
+          cfg = config;
+          fd = new_fd;
+        }
+        ring_bytes = config.ring_bytes;
+
+        stopping = false;
+        thread = std::thread([this]() { run(); });
+        active.store(true, std::memory_order_release);
+
+        return true;
+      }
+
+      void stop_locked() {
+        if (not thread.joinable()) return;
+
+        active.store(false, std::memory_order_release);
+        {
+          std::lock_guard<std::mutex> guard(cv_lock);
+          stopping = true;
+        }
+        cv.notify_all();
+        thread.join();
+
+        drain();
+
+        std::lock_guard<std::mutex> drain_guard(drain_lock);
+        close(fd);
+        fd = -1;
+      }
+
+      void stop() {
+        std::lock_guard<std::mutex> guard(lock);
+        stop_locked();
+      }
+    };
+
+    inline AsyncLogSink &async_log_sink() {
+      static AsyncLogSink *sink = new AsyncLogSink();
+
+      /* Drain and join the thread at exit, the sink itself is never freed */
+      static struct Stopper {
+        ~Stopper() { async_log_sink().stop(); }
+      } stopper;
+
+      return *sink;
+    }
+
+    inline bool async_log_active() {
+      return async_log_sink().active.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Per-thread stack of buffers DBGH() formats records into
+     * @details A DBGH used while formatting another one, e.g., in an
+     * operator<<, gets the next buffer. DBGH objects are temporaries, so
+     * records are committed in the reverse order they are started.
+     */
+    struct AsyncLogBuffers {
+      std::vector<std::unique_ptr<std::ostringstream>> bufs;
+      size_t depth = 0;
+    };
+
+    inline AsyncLogBuffers &async_log_buffers() {
+      thread_local AsyncLogBuffers buffers;
+      return buffers;
+    }
+
+    /** @brief Buffer for a new record, committed by commit_async_log() */
+    inline std::ostringstream &begin_async_log() {
+      auto &buffers = async_log_buffers();
+      if (buffers.depth == buffers.bufs.size()) {
+        buffers.bufs.push_back(std::make_unique<std::ostringstream>());
+      }
+
+      return *buffers.bufs[buffers.depth++];
+    }
+
+    /** @brief Move the innermost started record to the thread's ring */
+    inline void commit_async_log(uint8_t level, const char *caller) {
+      auto &buffers = async_log_buffers();
+      auto &buf = *buffers.bufs[--buffers.depth];
+      const auto msg = buf.str();
+      buf.str("");
+
+      auto &sink = async_log_sink();
+      if (not sink.active.load(std::memory_order_acquire)) [[unlikely]] {
+        std::cerr << "[" << caller << "()]:" << (int)level << " " << msg;
+        return;
+      }
+
+      timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+
+      LogRecordHeader hdr;
+      hdr.timestamp_ns = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+      hdr.caller_len = strlen(caller);
+      hdr.len = msg.size();
+      hdr.level = level;
+
+      /* The caller is copied, it might not outlive the record */
+      sink.this_ring().push(hdr, caller, msg.data());
+    }
+  } // namespace detail
+
+  /**
+   * @brief Send DBGH() output to a file through a background thread
+   * @details Each thread formats its records into its own lock-free ring
+   * buffer, records that don't fit are dropped and the number of drops is
+   * logged. A background thread drains the rings with batched write()s.
+   * DBGW/DBGE and plain DBG are not affected.
+   * @return false if the file cannot be opened
+   */
+  inline bool start_async_log(const AsyncLogConfig &cfg) {
+    return detail::async_log_sink().start(cfg);
+  }
+
+  /** @brief Drain the pending records, stop the thread and close the file */
+  inline void stop_async_log() { detail::async_log_sink().stop(); }
+
+  /** @brief Write out all pending records now, no-op without an async sink */
+  inline void flush_log() {
+    if (detail::async_log_active()) detail::async_log_sink().drain();
+  }
+} // namespace nvsl
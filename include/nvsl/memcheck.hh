@@ -0,0 +1,408 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   memcheck.hh
+ * @date   octobre 14, 2026
+ * @brief  Parallel multi-pattern memory test for large DRAM/PMem regions
+ */
+
+#pragma once
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "nvsl/common.hh"
+#include "nvsl/constants.hh"
+#include "nvsl/cpu.hh"
+#include "nvsl/numa.hh"
+#include "nvsl/parallel.hh"
+#include "nvsl/pmemops.hh"
+#include "nvsl/utils.hh"
+
+namespace nvsl {
+  /** @brief Patterns written to every 8 byte word, at index i */
+  enum class MemcheckPattern {
+    all_ones,             /**< ~0, what the old memcheck() wrote */
+    walking_ones,         /**< 1 << (i % 64) */
+    address,              /**< The address of the word itself */
+    checkerboard,         /**< 0x55.. and 0xAA.. on alternate words */
+    inverse_checkerboard, /**< 0xAA.. and 0x55.. on alternate words */
+  };
+
+  inline std::string to_string(MemcheckPattern pattern) {
+    switch (pattern) {
+    case MemcheckPattern::all_ones:
+      return "all_ones";
+    case MemcheckPattern::walking_ones:
+      return "walking_ones";
+    case MemcheckPattern::address:
+      return "address";
+    case MemcheckPattern::checkerboard:
+      return "checkerboard";
+    case MemcheckPattern::inverse_checkerboard:
+      return "inverse_checkerboard";
+    }
+    return "unknown";
+  }
+
+  /** @brief How memcheck writes the patterns */
+  enum class MemcheckWrite {
+    streaming, /**< PMemOps::streaming_wr() */
+    cached,    /**< Regular stores, then evicted with clflushopt/clflush */
+  };
+
+  /** @brief Configuration of memcheck() */
+  struct MemcheckConfig {
+    std::vector<MemcheckPattern> patterns = {
+        MemcheckPattern::walking_ones, MemcheckPattern::address,
+        MemcheckPattern::checkerboard, MemcheckPattern::inverse_checkerboard};
+    MemcheckWrite write = MemcheckWrite::streaming;
+    /**
+     * nullptr for PMemOps::best(), or PMemOpsClflushOpt/PMemOpsClflush with
+     * MemcheckWrite::cached so the verification doesn't hit in the cache.
+     * Other backends might leave the lines cached after flush().
+     */
+    PMemOps *pmemops = nullptr;
+
+    size_t region_bytes = 64 * MiB; /**< Granularity of the error map */
+    size_t max_errors = 16;         /**< Errors recorded per region */
+
+    size_t threads = 0;  /**< 0 for one per CPU of the node */
+    int numa_node = -1;  /**< Pin the threads to this node, -1 for the node
+                              of the first page or no pinning if unknown */
+  };
+
+  /** @brief A word that didn't read back as written */
+  struct MemcheckError {
+    size_t offset; /**< From the start of the checked memory */
+    uint64_t expected, actual;
+    MemcheckPattern pattern;
+  };
+
+  /** @brief Errors found in one region of MemcheckConfig::region_bytes */
+  struct MemcheckRegion {
+    size_t offset = 0, bytes = 0;
+    size_t errors = 0;                  /**< Bad words, over all patterns */
+    std::vector<MemcheckError> samples; /**< The first max_errors errors */
+  };
+
+  /** @brief Timing of writing and verifying one pattern */
+  struct MemcheckPhase {
+    MemcheckPattern pattern;
+    size_t bytes = 0, errors = 0;
+    double write_s = 0, read_s = 0;
+
+    double write_gbps() const {
+      return write_s == 0 ? 0 : bytes / write_s / 1e9;
+    }
+
+    double read_gbps() const {
+      return read_s == 0 ? 0 : bytes / read_s / 1e9;
+    }
+  };
+
+  /** @brief Outcome of memcheck() */
+  struct MemcheckResult {
+    size_t bytes = 0;
+    std::vector<MemcheckRegion> regions;
+    std::vector<MemcheckPhase> phases;
+
+    size_t errors() const {
+      size_t result = 0;
+      for (const auto &region : regions) result += region.errors;
+      return result;
+    }
+
+    bool ok() const { return errors() == 0; }
+
+    std::string str() const {
+      std::stringstream ss;
+
+      for (const auto &phase : phases) {
+        ss << to_string(phase.pattern) << ": " << phase.errors
+           << " errors, write " << phase.write_gbps() << " GB/s, read "
+           << phase.read_gbps() << " GB/s\n";
+      }
+
+      for (const auto &region : regions) {
+        if (region.errors == 0) continue;
+        ss << "region +0x" << std::hex << region.offset << std::dec << " ("
+           << region.bytes << " bytes): " << region.errors << " errors\n";
+      }
+
+      return ss.str();
+    }
+  };
+
+  namespace detail {
+    /* Words generated at once, the buffer stays in L1 */
+    constexpr size_t MEMCHECK_CHUNK_WORDS = 2048;
+
+    /** @brief Write the pattern for the words [idx, idx + cnt) of base */
+    inline void memcheck_fill(uint64_t *dst, const uint64_t *base, size_t idx,
+                              size_t cnt, MemcheckPattern pattern) {
+      constexpr uint64_t checker = 0x5555555555555555UL;
+
+      for (size_t i = 0; i < cnt; i++) {
+        const size_t word = idx + i;
+
+        switch (pattern) {
+        case MemcheckPattern::all_ones:
+          dst[i] = ~0UL;
+          break;
+        case MemcheckPattern::walking_ones:
+          dst[i] = 1UL << (word % 64);
+          break;
+        case MemcheckPattern::address:
+          dst[i] = (uintptr_t)(base + word);
+          break;
+        case MemcheckPattern::checkerboard:
+          dst[i] = word % 2 == 0 ? checker : ~checker;
+          break;
+        case MemcheckPattern::inverse_checkerboard:
+          dst[i] = word % 2 == 0 ? ~checker : checker;
+          break;
+        }
+      }
+    }
+
+    /**
+     * @brief Bytes at the start of a and b that are equal, in vector steps
+     * @details Stops at the first vector with a mismatch, the caller finds the
+     * bad word(s) in it
+     */
+    using memcheck_cmp_fn = size_t (*)(const void *a, const void *b,
+                                       size_t bytes);
+
+    NVSL_TARGET("avx512f")
+    inline size_t memcheck_cmp_avx512(const void *a, const void *b,
+                                      size_t bytes) {
+      size_t off = 0;
+      for (; off + 64 <= bytes; off += 64) {
+        const auto va = _mm512_loadu_si512((const uint8_t *)a + off);
+        const auto vb = _mm512_loadu_si512((const uint8_t *)b + off);
+        if (_mm512_cmpneq_epu64_mask(va, vb) != 0) break;
+      }
+      return off;
+    }
+
+    NVSL_TARGET("avx2")
+    inline size_t memcheck_cmp_avx2(const void *a, const void *b,
+                                    size_t bytes) {
+      size_t off = 0;
+      for (; off + 32 <= bytes; off += 32) {
+        const auto va =
+            _mm256_loadu_si256((const __m256i *)((const uint8_t *)a + off));
+        const auto vb =
+            _mm256_loadu_si256((const __m256i *)((const uint8_t *)b + off));
+        const auto diff = _mm256_xor_si256(va, vb);
+        if (not _mm256_testz_si256(diff, diff)) break;
+      }
+      return off;
+    }
+
+    inline size_t memcheck_cmp_sse2(const void *a, const void *b,
+                                    size_t bytes) {
+      size_t off = 0;
+      for (; off + 16 <= bytes; off += 16) {
+        const auto va =
+            _mm_loadu_si128((const __m128i *)((const uint8_t *)a + off));
+        const auto vb =
+            _mm_loadu_si128((const __m128i *)((const uint8_t *)b + off));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) != 0xffff) break;
+      }
+      return off;
+    }
+
+    /** @brief Widest compare kernel the CPU supports, checked once */
+    inline memcheck_cmp_fn memcheck_cmp_kernel() {
+      static const memcheck_cmp_fn kernel = []() -> memcheck_cmp_fn {
+        const auto &feat = cpu_features();
+
+        if (feat.avx512f) return memcheck_cmp_avx512;
+        if (feat.avx2) return memcheck_cmp_avx2;
+        return memcheck_cmp_sse2;
+      }();
+
+      return kernel;
+    }
+
+    /**
+     * @brief Backend whose flush() evicts the lines from the cache
+     * @details CLWB may leave the written back lines in the cache
+     */
+    inline PMemOps *evicting_pmemops() {
+      static PMemOps *const result = []() -> PMemOps * {
+        if (cpu_features().clflushopt) return new PMemOpsClflushOpt();
+        if (cpu_features().clflush) return new PMemOpsClflush();
+        return PMemOps::best();
+      }();
+
+      return result;
+    }
+
+    inline void memcheck_write(uint64_t *base, const MemcheckRegion &region,
+                               MemcheckPattern pattern,
+                               const MemcheckConfig &cfg, PMemOps *pmem) {
+      uint64_t buf[MEMCHECK_CHUNK_WORDS];
+      const size_t first = region.offset / sizeof(uint64_t);
+      const size_t words = region.bytes / sizeof(uint64_t);
+
+      for (size_t i = 0; i < words; i += MEMCHECK_CHUNK_WORDS) {
+        const size_t cnt = std::min(MEMCHECK_CHUNK_WORDS, words - i);
+        uint64_t *dst = base + first + i;
+
+        if (cfg.write == MemcheckWrite::streaming) {
+          memcheck_fill(buf, base, first + i, cnt, pattern);
+          pmem->streaming_wr(dst, buf, cnt * sizeof(uint64_t));
+        } else {
+          memcheck_fill(dst, base, first + i, cnt, pattern);
+        }
+      }
+
+      if (cfg.write == MemcheckWrite::cached) {
+        /* Evict the lines so the verification reads the memory */
+        pmem->flush(base + first, words * sizeof(uint64_t));
+      }
+      pmem->drain();
+    }
+
+    inline size_t memcheck_verify(uint64_t *base, MemcheckRegion &region,
+                                  MemcheckPattern pattern,
+                                  const MemcheckConfig &cfg) {
+      uint64_t buf[MEMCHECK_CHUNK_WORDS];
+      const auto cmp = memcheck_cmp_kernel();
+      const size_t first = region.offset / sizeof(uint64_t);
+      const size_t words = region.bytes / sizeof(uint64_t);
+      size_t errors = 0;
+
+      for (size_t i = 0; i < words; i += MEMCHECK_CHUNK_WORDS) {
+        const size_t cnt = std::min(MEMCHECK_CHUNK_WORDS, words - i);
+        const uint64_t *src = base + first + i;
+        const size_t bytes = cnt * sizeof(uint64_t);
+
+        memcheck_fill(buf, base, first + i, cnt, pattern);
+
+        size_t off = 0;
+        while ((off += cmp((const uint8_t *)src + off,
+                           (const uint8_t *)buf + off, bytes - off)) <
+               bytes) {
+          /* Scalar check of the mismatching vector, or the tail */
+          const size_t w = off / sizeof(uint64_t);
+          const uint64_t actual = ((const volatile uint64_t *)src)[w];
+
+          if (actual != buf[w]) {
+            errors++;
+            if (region.samples.size() < cfg.max_errors) {
+              region.samples.push_back({(first + i + w) * sizeof(uint64_t),
+                                        buf[w], actual, pattern});
+            }
+          }
+
+          off = (w + 1) * sizeof(uint64_t);
+        }
+      }
+
+      region.errors += errors;
+      return errors;
+    }
+
+    inline double seconds_since(std::chrono::steady_clock::time_point start) {
+      return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                           start)
+          .count();
+    }
+  } // namespace detail
+
+  /**
+   * @brief Test memory with several patterns, from all the CPUs of its node
+   * @details Each pattern is first written to the whole memory, then read
+   * back and compared using the widest of AVX-512, AVX2 and SSE2 the CPU has.
+   * Regions of cfg.region_bytes are spread over a pool of threads pinned to
+   * the memory's NUMA node, with work stealing.
+   * @param[in] ptr Start of the memory, 8 byte aligned
+   * @param[in] bytes Bytes to check, rounded down to a multiple of 8
+   * @warning Overwrites the memory, any existing data will be lost
+   * @code
+   * nvsl::MemcheckConfig cfg;
+   * const auto res = nvsl::memcheck(pmem_ptr, 512 * nvsl::GiB, cfg);
+   * if (not res.ok()) std::cerr << res.str();
+   * @endcode
+   */
+  inline MemcheckResult memcheck(void *ptr, size_t bytes,
+                                 const MemcheckConfig &cfg) {
+    auto *base = (uint64_t *)ptr;
+    PMemOps *pmem = cfg.pmemops;
+    if (pmem == nullptr) {
+      pmem = cfg.write == MemcheckWrite::cached ? detail::evicting_pmemops()
+                                                : PMemOps::best();
+    }
+
+    MemcheckResult result;
+    result.bytes = round_down(bytes, sizeof(uint64_t));
+
+    const size_t region_bytes =
+        round_up(std::max(cfg.region_bytes, (size_t)1), sizeof(uint64_t));
+    for (size_t off = 0; off < result.bytes; off += region_bytes) {
+      MemcheckRegion region;
+      region.offset = off;
+      region.bytes = std::min(region_bytes, result.bytes - off);
+      result.regions.push_back(region);
+    }
+    if (result.regions.empty()) return result;
+
+    ThreadPoolConfig pool_cfg;
+    pool_cfg.threads = cfg.threads;
+    pool_cfg.numa_node = cfg.numa_node;
+    if (pool_cfg.numa_node < 0 and numa_available() >= 0) {
+      pool_cfg.numa_node = std::max(numa_node_of_page(ptr), -1);
+    }
+    pool_cfg.pin = pool_cfg.numa_node >= 0;
+    ThreadPool pool(pool_cfg);
+
+    const auto regions = indices(result.regions);
+
+    for (const auto pattern : cfg.patterns) {
+      MemcheckPhase phase;
+      phase.pattern = pattern;
+      phase.bytes = result.bytes;
+
+      auto start = std::chrono::steady_clock::now();
+      parallel_for(
+          regions,
+          [&](size_t r) {
+            detail::memcheck_write(base, result.regions[r], pattern, cfg,
+                                   pmem);
+          },
+          1, pool);
+      phase.write_s = detail::seconds_since(start);
+
+      std::vector<size_t> errors(result.regions.size());
+      start = std::chrono::steady_clock::now();
+      parallel_for(
+          regions,
+          [&](size_t r) {
+            errors[r] =
+                detail::memcheck_verify(base, result.regions[r], pattern, cfg);
+          },
+          1, pool);
+      phase.read_s = detail::seconds_since(start);
+
+      for (const auto err : errors) phase.errors += err;
+      result.phases.push_back(phase);
+
+      DBGH(2) << "memcheck " << to_string(pattern) << ": " << phase.errors
+              << " errors" << std::endl;
+    }
+
+    return result;
+  }
+} // namespace nvsl
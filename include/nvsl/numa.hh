@@ -9,62 +9,392 @@
 #pragma once
 
 #include "numa.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <string>
+#include <thread>
 #include <unistd.h>
+#include <vector>
+
+#include "nvsl/common.hh"
+#include "nvsl/constants.hh"
+#include "nvsl/error.hh"
+
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE       (1<<1)
+#endif
 
 #ifndef MPOL_MF_MOVE_ALL
 #define MPOL_MF_MOVE_ALL   (1<<2)
 #endif
 
-static inline int numa_node_of_page(void *page) {
-  int result;
-  const auto _ =
-      numa_move_pages(getpid(), 1, (void **)&page, nullptr, &result, 0);
-  (void)_;
+namespace nvsl {
+  /**
+   * @brief CPUs of a NUMA node, in order
+   * @param[in] numa_node Node, or -1 for the CPUs the thread may run on
+   */
+  inline std::vector<int> node_cpus(int numa_node) {
+    std::vector<int> result;
 
-  return result;
-}
+    if (numa_node >= 0) {
+      if (numa_available() < 0) {
+        NVSL_ERROR("libnuma not available, cannot run on node " +
+                   std::to_string(numa_node));
+      }
 
-static inline bool move_region_to_node(int node, void *start, size_t size,
-                                       size_t page_size = 4096) {
-  bool result = true;
-
-  const auto page_cnt = size < page_size ? 1 : size / page_size;
-  int *nodes = new int[page_cnt];
-  int *status = new int[page_cnt];
-  void **pages = new void *[page_cnt];
-  for (auto i = 0UL; i < page_cnt; i++) {
-    nodes[i] = node;
-    status[i] = 1000;
-    pages[i] = (void *)((char *)start + i * page_size);
+      auto *mask = numa_allocate_cpumask();
+      if (numa_node_to_cpus(numa_node, mask) != 0) {
+        numa_free_cpumask(mask);
+        NVSL_ERROR("Unable to get the CPUs of node " +
+                   std::to_string(numa_node));
+      }
+
+      for (int cpu = 0; cpu < numa_num_possible_cpus(); cpu++) {
+        if (numa_bitmask_isbitset(mask, cpu)) result.push_back(cpu);
+      }
+      numa_free_cpumask(mask);
+    } else {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+          if (CPU_ISSET(cpu, &set)) result.push_back(cpu);
+        }
+      }
+    }
+
+    return result;
   }
 
-  const auto err = numa_move_pages(getpid(), page_cnt, pages, nodes, status, 
-                                   MPOL_MF_MOVE_ALL);
+  /** @brief Pin the calling thread to a CPU, warns if it can't */
+  inline void pin_thread(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    const int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (ret != 0) {
+      DBGW << "Unable to pin thread to CPU " << cpu << ": " << strerror(ret)
+           << std::endl;
+    }
+  }
+
+  /** @brief Number of pages of a region on each node */
+  struct NodeHistogram {
+    std::map<int, size_t> nodes; /**< Node -> pages on it */
+    size_t unmapped = 0;         /**< Pages not faulted in yet */
+    size_t failed = 0;           /**< Pages the kernel couldn't report */
+    size_t page_size = SMALL_PG_SZ;
+
+    size_t total() const {
+      size_t result = unmapped + failed;
+      for (const auto &[node, cnt] : nodes) result += cnt;
+      return result;
+    }
+
+    /** @brief Pages on node, or not on node if `invert` */
+    size_t on(int node, bool invert = false) const {
+      size_t result = 0;
+      for (const auto &[nd, cnt] : nodes) {
+        if ((nd == node) != invert) result += cnt;
+      }
+      return result;
+    }
+
+    std::string str() const {
+      std::stringstream ss;
+      for (const auto &[node, cnt] : nodes) {
+        ss << "node " << node << ": " << cnt << " pages\n";
+      }
+      if (unmapped != 0) ss << "unmapped: " << unmapped << " pages\n";
+      if (failed != 0) ss << "failed: " << failed << " pages\n";
+      return ss.str();
+    }
+  };
+
+  /** @brief How to migrate or query a region */
+  struct NumaMoveConfig {
+    size_t nthreads = 0;      /**< 0 to use all the CPUs */
+    size_t batch_pages = 4096; /**< Pages per numa_move_pages() call */
+    size_t page_size = 0;     /**< 0 to detect 2 MiB (THP/hugetlb) mappings */
+    bool move_all = true;     /**< MPOL_MF_MOVE_ALL, else MPOL_MF_MOVE */
+    bool verify = false;      /**< Query the placement after moving */
+  };
+
+  /** @brief Outcome of move_region() */
+  struct NumaMoveResult {
+    size_t pages = 0;  /**< Pages asked to move */
+    size_t failed = 0; /**< Pages the kernel didn't move */
+    size_t page_size = SMALL_PG_SZ;
+    NodeHistogram placement; /**< Only with NumaMoveConfig::verify */
+
+    bool ok() const { return failed == 0; }
+  };
+
+  namespace detail {
+    /**
+     * @brief Page size backing [start, start + size) according to smaps
+     * @return LARGE_PG_SZ if the mapping holding start uses 2 MiB hugetlb
+     * pages or is fully backed by THPs, SMALL_PG_SZ otherwise
+     */
+    inline size_t mapping_page_size(void *start, size_t size) {
+      std::ifstream smaps("/proc/self/smaps");
+      const auto addr = (uintptr_t)start;
+
+      std::string line;
+      bool in_vma = false;
+      size_t rss_kb = 0, thp_kb = 0, kernel_pg_kb = 0;
+
+      while (std::getline(smaps, line)) {
+        uintptr_t vma_start, vma_end;
+        char dash;
+        std::stringstream ss(line);
+
+        if (line.find(':') == std::string::npos or
+            line.find('-') < line.find(':')) {
+          /* Header of a mapping: start-end perms offset dev inode path */
+          if (in_vma) break;
+          if (ss >> std::hex >> vma_start >> dash >> vma_end and
+              vma_start <= addr and addr < vma_end) {
+            if (addr + size > vma_end) return SMALL_PG_SZ;
+            in_vma = true;
+          }
+          continue;
+        }
+
+        if (not in_vma) continue;
+
+        std::string key;
+        size_t val;
+        if (not(ss >> key >> val)) continue;
+
+        if (key == "Rss:") rss_kb = val;
+        if (key == "AnonHugePages:") thp_kb = val;
+        if (key == "KernelPageSize:") kernel_pg_kb = val;
+      }
+
+      if (kernel_pg_kb * KiB == LARGE_PG_SZ) return LARGE_PG_SZ;
+      if (rss_kb != 0 and thp_kb == rss_kb) return LARGE_PG_SZ;
+      return SMALL_PG_SZ;
+    }
+
+    /**
+     * @brief Pages of a region, addressed without materializing them
+     * @details With 2 MiB pages, the unaligned head and tail use 4 KiB pages
+     */
+    struct RegionPages {
+      uint8_t *start = nullptr;      /* First 4 KiB page */
+      uint8_t *huge_start = nullptr; /* [huge_start, huge_end) in 2 MiB pages */
+      uint8_t *huge_end = nullptr;
+      size_t head = 0, huge = 0, tail = 0; /* Pages in each part */
+
+      size_t size() const { return head + huge + tail; }
+
+      void *operator[](size_t i) const {
+        if (i < head) return start + i * SMALL_PG_SZ;
+        if (i < head + huge) return huge_start + (i - head) * LARGE_PG_SZ;
+        return huge_end + (i - head - huge) * SMALL_PG_SZ;
+      }
+    };
 
-  if (err != 0) {
-    std::cerr << "perror: " << strerror(errno) << std::endl;
-    std::cerr << "Warning: first page might not be on the target node. ";
-    std::cerr << "Expected: " << node << ", got: " << status[0] << std::endl;
+    inline RegionPages region_pages(void *start, size_t size,
+                                    size_t page_size) {
+      RegionPages result;
+      result.start = (uint8_t *)((uintptr_t)start & ~(SMALL_PG_SZ - 1));
+      auto *end = (uint8_t *)start + size;
 
-    result = false;
+      auto *huge_start = (uint8_t *)align_2mb(result.start);
+      auto *huge_end = (uint8_t *)((uintptr_t)end & ~(LARGE_PG_SZ - 1));
+      if (page_size != LARGE_PG_SZ or huge_start >= huge_end) {
+        huge_start = huge_end = end;
+      }
+
+      const auto small_pages = [](uint8_t *from, uint8_t *to) {
+        return to > from ? (size_t)(to - from + SMALL_PG_SZ - 1) / SMALL_PG_SZ
+                         : 0;
+      };
+
+      result.huge_start = huge_start;
+      result.huge_end = huge_end;
+      result.head = small_pages(result.start, huge_start);
+      result.huge = (size_t)(huge_end - huge_start) / LARGE_PG_SZ;
+      result.tail = small_pages(huge_end, end);
+
+      return result;
+    }
+
+    /**
+     * @brief Call numa_move_pages() on batches of pages from several threads
+     * @details Each thread builds the addresses of one batch at a time and
+     * folds the statuses into its own histogram, memory use doesn't grow with
+     * the size of the region.
+     * @param[in] node Target node, or nullptr to only query the placement
+     * @return Where the kernel reported the pages to be
+     */
+    inline NodeHistogram move_pages_batched(const RegionPages &pages,
+                                            const int *node,
+                                            const NumaMoveConfig &cfg) {
+      const size_t total = pages.size();
+      const size_t batch = std::max(cfg.batch_pages, (size_t)1);
+      const size_t batches = (total + batch - 1) / batch;
+      const int move_flags = cfg.move_all ? MPOL_MF_MOVE_ALL : MPOL_MF_MOVE;
+      const int flags = node == nullptr ? 0 : move_flags;
+
+      size_t nthreads = cfg.nthreads;
+      if (nthreads == 0) {
+        nthreads = std::max(1U, std::thread::hardware_concurrency());
+      }
+      nthreads = std::max((size_t)1, std::min(nthreads, batches));
+
+      NodeHistogram result;
+      std::mutex result_lock;
+
+      std::atomic<size_t> next = 0;
+      const auto worker = [&]() {
+        const size_t len = std::min(batch, total);
+        std::vector<void *> addrs(len);
+        std::vector<int> status(len), nodes;
+        if (node != nullptr) nodes.assign(len, *node);
+
+        NodeHistogram mine;
+        for (size_t b = next++; b < batches; b = next++) {
+          const size_t first = b * batch;
+          const size_t cnt = std::min(batch, total - first);
+          for (size_t i = 0; i < cnt; i++) addrs[i] = pages[first + i];
+
+          const auto err = numa_move_pages(
+              getpid(), cnt, addrs.data(),
+              node == nullptr ? nullptr : nodes.data(), status.data(), flags);
+
+          if (err < 0) {
+            /* The whole call failed, the statuses are not filled in */
+            std::fill_n(status.begin(), cnt, -errno);
+          }
+
+          for (size_t i = 0; i < cnt; i++) {
+            const auto st = status[i];
+            if (st >= 0) {
+              mine.nodes[st]++;
+            } else if (st == -ENOENT or st == -EFAULT) {
+              mine.unmapped++;
+            } else {
+              mine.failed++;
+            }
+          }
+        }
+
+        std::lock_guard<std::mutex> guard(result_lock);
+        for (const auto &[nd, cnt] : mine.nodes) result.nodes[nd] += cnt;
+        result.unmapped += mine.unmapped;
+        result.failed += mine.failed;
+      };
+
+      std::vector<std::thread> workers;
+      for (size_t t = 1; t < nthreads; t++) workers.emplace_back(worker);
+      worker();
+      for (auto &w : workers) w.join();
+
+      return result;
+    }
+
+    inline size_t resolve_page_size(void *start, size_t size,
+                                    const NumaMoveConfig &cfg) {
+      return cfg.page_size != 0 ? cfg.page_size
+                                : mapping_page_size(start, size);
+    }
+  } // namespace detail
+
+  /**
+   * @brief Count the pages of a region on each node
+   * @details Queries the kernel in batches of cfg.batch_pages, from
+   * cfg.nthreads threads.
+   */
+  inline NodeHistogram region_node_histogram(void *start, size_t size,
+                                             const NumaMoveConfig &cfg = {}) {
+    const auto page_size = detail::resolve_page_size(start, size, cfg);
+    const auto pages = detail::region_pages(start, size, page_size);
+
+    auto result = detail::move_pages_batched(pages, nullptr, cfg);
+    result.page_size = page_size;
+
+    return result;
   }
 
-  for (auto i = 0UL; i < page_cnt; i++) {
-    if (status[i] != node) {
-      std::cerr << "Warning: page " << i << " might not be on the target node. " << std::endl;
-      std::cerr << "perror: " << strerror(-status[i]) << std::endl;
-      std::cerr << "Expected: " << node << ", got: " << status[i] << std::endl;
-      std::cerr << "Not checking further pages." << std::endl;
+  /**
+   * @brief Check that every mapped page of a region is on node
+   * @param[out] placement Where the pages are, if not nullptr
+   */
+  inline bool verify_placement(void *start, size_t size, int node,
+                               NodeHistogram *placement = nullptr,
+                               const NumaMoveConfig &cfg = {}) {
+    const auto hist = region_node_histogram(start, size, cfg);
+    if (placement != nullptr) *placement = hist;
+
+    return hist.failed == 0 and hist.on(node, true) == 0;
+  }
+
+  /**
+   * @brief Migrate a region to a node
+   * @details Pages are moved in batches of cfg.batch_pages from cfg.nthreads
+   * threads. Mappings backed by 2 MiB pages are moved one huge page at a time.
+   * With cfg.verify, the placement is queried once the move is done.
+   */
+  inline NumaMoveResult move_region(void *start, size_t size, int node,
+                                    const NumaMoveConfig &cfg = {}) {
+    NumaMoveResult result;
+    result.page_size = detail::resolve_page_size(start, size, cfg);
+
+    const auto pages = detail::region_pages(start, size, result.page_size);
+    const auto moved = detail::move_pages_batched(pages, &node, cfg);
 
-      result = false;
+    result.pages = pages.size();
+    result.failed = result.pages - moved.on(node);
 
-      break;
+    if (cfg.verify) {
+      NumaMoveConfig query = cfg;
+      query.page_size = result.page_size;
+      result.placement = region_node_histogram(start, size, query);
     }
+
+    return result;
   }
+} // namespace nvsl
 
-  delete[] nodes;
-  delete[] status;
-  delete[] pages;
+static inline int numa_node_of_page(void *page) {
+  int result;
+  const auto _ =
+      numa_move_pages(getpid(), 1, (void **)&page, nullptr, &result, 0);
+  (void)_;
 
   return result;
 }
+
+static inline bool move_region_to_node(int node, void *start, size_t size,
+                                       size_t page_size = 4096) {
+  nvsl::NumaMoveConfig cfg;
+  cfg.page_size = page_size;
+  cfg.nthreads = 1;
+
+  const auto result = nvsl::move_region(start, size, node, cfg);
+
+  if (not result.ok()) {
+    std::cerr << "Warning: " << result.failed << " of " << result.pages
+              << " pages might not be on the target node " << node << ". "
+              << std::endl;
+    std::cerr << "Placement:\n"
+              << nvsl::region_node_histogram(start, size, cfg).str();
+  }
+
+  return result.ok();
+}
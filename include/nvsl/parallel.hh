@@ -0,0 +1,242 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   parallel.hh
+ * @date   octobre 14, 2026
+ * @brief  Pinned thread pool and a work-stealing parallel_for()
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "nvsl/iterator.hh"
+#include "nvsl/numa.hh"
+
+namespace nvsl {
+  /** @brief Configuration of a ThreadPool */
+  struct ThreadPoolConfig {
+    size_t threads = 0;  /**< Including the caller, 0 for one per CPU */
+    int numa_node = -1;  /**< Only use the CPUs of this node */
+    bool pin = true;     /**< Pin worker i to the i-th CPU */
+  };
+
+  /**
+   * @brief Fixed set of threads that all run the same job
+   * @details The thread calling run() takes part as thread 0, the workers are
+   * created once and pinned to the CPUs of cfg.numa_node.
+   */
+  class ThreadPool {
+  private:
+    std::vector<std::thread> workers;
+
+    std::mutex run_lock; /* One job at a time */
+
+    std::mutex lock;
+    std::condition_variable start_cv, done_cv;
+    const std::function<void(size_t)> *job = nullptr;
+    uint64_t generation = 0;
+    size_t running = 0;
+    bool stopping = false;
+
+    static bool &in_pool() {
+      thread_local bool result = false;
+      return result;
+    }
+
+    void work(size_t tid) {
+      in_pool() = true;
+      uint64_t seen = 0;
+
+      while (true) {
+        const std::function<void(size_t)> *cur;
+        {
+          std::unique_lock<std::mutex> guard(lock);
+          start_cv.wait(guard,
+                        [&]() { return stopping or generation != seen; });
+          if (stopping) return;
+
+          seen = generation;
+          cur = job;
+        }
+
+        (*cur)(tid);
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (--running == 0) done_cv.notify_one();
+      }
+    }
+
+  public:
+    explicit ThreadPool(const ThreadPoolConfig &cfg = {}) {
+      const auto cpus = node_cpus(cfg.numa_node);
+
+      size_t threads = cfg.threads;
+      if (threads == 0) threads = std::max(cpus.size(), (size_t)1);
+
+      for (size_t t = 1; t < threads; t++) {
+        workers.emplace_back([this, t, cpus, pin = cfg.pin]() {
+          if (pin and not cpus.empty()) pin_thread(cpus[t % cpus.size()]);
+          work(t);
+        });
+      }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    ~ThreadPool() {
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+      }
+      start_cv.notify_all();
+      for (auto &worker : workers) worker.join();
+    }
+
+    /** @brief Number of threads a job runs on, including the caller */
+    size_t size() const { return workers.size() + 1; }
+
+    /** @brief True on the pool's workers and inside of run() */
+    static bool on_pool_thread() { return in_pool(); }
+
+    /**
+     * @brief Call fn(tid) on every thread of the pool and wait for them
+     * @details From inside a job, fn(0) is called on the current thread only
+     */
+    void run(const std::function<void(size_t)> &fn) {
+      if (in_pool() or workers.empty()) {
+        fn(0);
+        return;
+      }
+
+      std::lock_guard<std::mutex> run_guard(run_lock);
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        job = &fn;
+        running = workers.size();
+        generation++;
+      }
+      start_cv.notify_all();
+
+      in_pool() = true;
+      fn(0);
+      in_pool() = false;
+
+      std::unique_lock<std::mutex> guard(lock);
+      done_cv.wait(guard, [&]() { return running == 0; });
+    }
+  };
+
+  /** @brief Pool used by parallel_for(), one thread per allowed CPU */
+  inline ThreadPool &default_pool() {
+    static ThreadPool pool;
+    return pool;
+  }
+
+  namespace detail {
+    /** @brief Chunks [lo, hi) left to a thread, packed for a single CAS */
+    struct alignas(64) StealRange {
+      std::atomic<uint64_t> bounds = 0;
+
+      static uint64_t pack(uint64_t lo, uint64_t hi) { return hi << 32 | lo; }
+      static uint64_t lo(uint64_t val) { return val & UINT32_MAX; }
+      static uint64_t hi(uint64_t val) { return val >> 32; }
+
+      /** @brief Take the first chunk, returns false if there is none */
+      bool take(uint64_t &chunk) {
+        auto cur = bounds.load(std::memory_order_relaxed);
+
+        while (lo(cur) < hi(cur)) {
+          if (bounds.compare_exchange_weak(cur, pack(lo(cur) + 1, hi(cur)))) {
+            chunk = lo(cur);
+            return true;
+          }
+        }
+
+        return false;
+      }
+
+      /** @brief Move the second half of victim's chunks to this range */
+      bool steal_from(StealRange &victim) {
+        auto cur = victim.bounds.load(std::memory_order_relaxed);
+
+        while (lo(cur) < hi(cur)) {
+          const auto mid = lo(cur) + (hi(cur) - lo(cur)) / 2;
+
+          if (victim.bounds.compare_exchange_weak(cur, pack(lo(cur), mid))) {
+            bounds.store(pack(mid, hi(cur)));
+            return true;
+          }
+        }
+
+        return false;
+      }
+    };
+  } // namespace detail
+
+  /**
+   * @brief Call fn(range[i]) for every element of range, in parallel
+   * @details The range is cut into chunks of grain elements, each thread of
+   * the pool starts with a contiguous share of the chunks and steals half of
+   * another thread's remaining chunks when it runs out. Works with any range
+   * with size() and operator[], e.g., range(), step() and indices().
+   * @param[in] grain Elements per chunk, 0 for about 8 chunks per thread
+   * @code
+   * nvsl::parallel_for(nvsl::indices(entries), [&](size_t i) {
+   *   replay(entries[i]);
+   * });
+   * @endcode
+   */
+  template <typename Range, typename Fn>
+  void parallel_for(const Range &range, Fn &&fn, size_t grain = 0,
+                    ThreadPool &pool = default_pool()) {
+    const size_t n = range.size();
+    if (n == 0) return;
+
+    const size_t threads = pool.size();
+    if (grain == 0) grain = std::max(n / (threads * 8), (size_t)1);
+
+    /* Chunk indices have to fit in half of StealRange::bounds */
+    grain = std::max(grain, n / UINT32_MAX + 1);
+    const size_t chunks = (n + grain - 1) / grain;
+
+    if (chunks == 1 or threads == 1 or ThreadPool::on_pool_thread()) {
+      for (size_t i = 0; i < n; i++) fn(range[i]);
+      return;
+    }
+
+    auto ranges = std::make_unique<detail::StealRange[]>(threads);
+    for (size_t t = 0; t < threads; t++) {
+      ranges[t].bounds = detail::StealRange::pack(chunks * t / threads,
+                                                  chunks * (t + 1) / threads);
+    }
+
+    pool.run([&](size_t tid) {
+      auto &mine = ranges[tid];
+
+      while (true) {
+        uint64_t chunk;
+        while (mine.take(chunk)) {
+          const size_t last = std::min(n, (chunk + 1) * grain);
+          for (size_t i = chunk * grain; i < last; i++) fn(range[i]);
+        }
+
+        bool stole = false;
+        for (size_t v = 1; v < threads and not stole; v++) {
+          stole = mine.steal_from(ranges[(tid + v) % threads]);
+        }
+        if (not stole) break;
+      }
+    });
+  }
+} // namespace nvsl
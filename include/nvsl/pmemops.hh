@@ -16,9 +16,14 @@
 #define NVSL_PMEMOPS_MASTER_FILE
 
 #include "nvsl/pmemops/declarations.hh"
+#include "nvsl/pmemops/streaming.hh"
+#include "nvsl/pmemops/policy.hh"
+#include "nvsl/pmemops/pmemops_clflush.hh"
 #include "nvsl/pmemops/pmemops_clflushopt.hh"
 #include "nvsl/pmemops/pmemops_clwb.hh"
 #include "nvsl/pmemops/pmemops_msync.hh"
 #include "nvsl/pmemops/pmemops_nopersist.hh"
+#include "nvsl/pmemops/dispatch.hh"
+#include "nvsl/pmemops/persist_batch.hh"
 
 #undef NVSL_PMEMOPS_MASTER_FILE
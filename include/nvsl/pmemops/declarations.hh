@@ -9,17 +9,50 @@
 #pragma once
 
 #include <cassert>
+#include <cstdint>
+#include <mutex>
 #include <unistd.h>
+#include <utility>
+#include <vector>
 
 #ifndef NVSL_PMEMOPS_MASTER_FILE
 #error Do not include this file directly. Include "pmemops.hh" instead.
 #endif
 
 namespace nvsl {
+  /**
+   * @brief Receives the flushes, NT stores and fences of a PMemOps call
+   * @details Passed to the memmove()/memset() overloads that take hooks, e.g.,
+   * by PMemOpsInstrumented to count what the backend does.
+   */
+  class PMemOpsHooks {
+  public:
+    virtual ~PMemOpsHooks() = default;
+
+    /** @brief The backend flushed [base, base + size) */
+    virtual void on_flush(const void *base, size_t size) const = 0;
+
+    /** @brief The backend wrote bytes starting at base using NT stores */
+    virtual void on_nt_store(const void *base, size_t bytes) const = 0;
+
+    /** @brief The backend issued a drain (fence) */
+    virtual void on_drain() const = 0;
+  };
+
   class PMemOps {
   public:
     static const size_t CL_SIZE = 64;
 
+    virtual ~PMemOps() = default;
+
+    /**
+     * @brief Get the fastest backend supported by the running CPU
+     * @details Checks CPUID once and picks CLWB > CLFLUSHOPT > CLFLUSH, falls
+     * back to msync if none of them are available. The returned object is
+     * owned by the library and must not be deleted.
+     */
+    static PMemOps *best();
+
     /** @brief Flush and drain in a single call */
     virtual void persist(void *base, size_t size) const = 0;
 
@@ -48,11 +81,38 @@ namespace nvsl {
     virtual void memmove(void *dest, void *src, size_t size) const = 0;
     virtual void memset(void *base, char c, size_t size) const = 0;
 
+    /**
+     * @brief memmove() that reports what it does to hooks, if not null
+     * @details The library's backends report every flush, NT store and fence.
+     * The default reports a flush of the whole range and a fence.
+     */
+    virtual void memmove(void *dest, void *src, size_t size,
+                         const PMemOpsHooks *hooks) const {
+      this->memmove(dest, src, size);
+      if (hooks != nullptr) {
+        hooks->on_flush(dest, size);
+        hooks->on_drain();
+      }
+    }
+
+    /** @brief memset() that reports what it does to hooks, see memmove() */
+    virtual void memset(void *base, char c, size_t size,
+                        const PMemOpsHooks *hooks) const {
+      this->memset(base, c, size);
+      if (hooks != nullptr) {
+        hooks->on_flush(base, size);
+        hooks->on_drain();
+      }
+    }
+
     virtual void flush(void *base, size_t size) const = 0;
   };
 
   class PMemOpsClwb : public PMemOps {
   private:
+    /** @brief Copies of at least these many bytes use NT stores */
+    size_t nt_threshold;
+
     /** @brief Clwb on a single addr, to flush a range use flush() */
     void clwb(void *addr) const;
 
@@ -60,20 +120,53 @@ namespace nvsl {
     void clflush(void *addr) const;
   
   public:
+    PMemOpsClwb();
+
+    /**
+     * @brief Set the size from which memcpy/memmove/memset use NT stores
+     * @param[in] bytes Threshold in bytes, SIZE_MAX disables NT stores
+     */
+    void set_nt_threshold(size_t bytes) { this->nt_threshold = bytes; }
+    size_t get_nt_threshold() const { return this->nt_threshold; }
+
+    /**
+     * @brief Measure the smallest copy size for which NT stores are faster
+     * @details Times cached and NT copies of increasing size and updates the
+     * threshold of this object.
+     * @param[in] scratch Region to copy into (e.g., PMem), nullptr to
+     * use an anonymous mapping
+     * @param[in] scratch_sz Size of the scratch region
+     * @return The new threshold
+     */
+    size_t calibrate_nt_threshold(void *scratch = nullptr,
+                                  size_t scratch_sz = 0);
+
     void flush(void *base, size_t size) const;
     void persist(void *base, size_t size) const;
     void drain() const;
     void memcpy(void *dest, void *src, size_t size) const;
     void memmove(void *dest, void *src, size_t size) const;
     void memset(void *base, char c, size_t size) const;
+    void memmove(void *dest, void *src, size_t size,
+                 const PMemOpsHooks *hooks) const;
+    void memset(void *base, char c, size_t size,
+                const PMemOpsHooks *hooks) const;
     void streaming_wr(void *dest, const void *src, size_t bytes) const;
     void evict(void *base, size_t size) const;
   };
 
+  /**
+   * @brief PMemOps using msync, for systems without DAX
+   * @details flush() only records the dirty pages. drain() merges them and
+   * issues one msync() per contiguous run.
+   */
   class PMemOpsMsync : public PMemOps {
   private:
-    /** @brief Clflusopt on single addr, to flush range, use flush() */
-    void clwb(void *addr) const;
+    /** @brief Page aligned [start, end) ranges flushed since last drain() */
+    mutable std::vector<std::pair<uintptr_t, uintptr_t>> dirty;
+
+    /** @brief Protects dirty, held while syncing in drain() */
+    mutable std::mutex lock;
 
   public:
     void flush(void *base, size_t size) const;
@@ -82,12 +175,11 @@ namespace nvsl {
     void memcpy(void *dest, void *src, size_t size) const;
     void memmove(void *dest, void *src, size_t size) const;
     void memset(void *base, char c, size_t size) const;
-    void streaming_wr(void *dest, const void *src, size_t bytes) const {
-      (void)dest;
-      (void)src;
-      (void)bytes;
-      assert(0 && "unimplemented");
-    }
+    void memmove(void *dest, void *src, size_t size,
+                 const PMemOpsHooks *hooks) const;
+    void memset(void *base, char c, size_t size,
+                const PMemOpsHooks *hooks) const;
+    void streaming_wr(void *dest, const void *src, size_t bytes) const;
   };
 
   class PMemOpsClflushOpt : public PMemOps {
@@ -95,18 +187,39 @@ namespace nvsl {
     void clflush_opt(void *addr) const;
 
   public:
+    PMemOpsClflushOpt();
+
     void flush(void *base, size_t size) const;
     void persist(void *base, size_t size) const;
     void drain() const;
     void memcpy(void *dest, void *src, size_t size) const;
     void memmove(void *dest, void *src, size_t size) const;
     void memset(void *base, char c, size_t size) const;
-    void streaming_wr(void *dest, const void *src, size_t bytes) const {
-      (void)dest;
-      (void)src;
-      (void)bytes;
-      assert(0 && "unimplemented");
-    }
+    void memmove(void *dest, void *src, size_t size,
+                 const PMemOpsHooks *hooks) const;
+    void memset(void *base, char c, size_t size,
+                const PMemOpsHooks *hooks) const;
+    void streaming_wr(void *dest, const void *src, size_t bytes) const;
+  };
+
+  class PMemOpsClflush : public PMemOps {
+  private:
+    void clflush(void *addr) const;
+
+  public:
+    PMemOpsClflush();
+
+    void flush(void *base, size_t size) const;
+    void persist(void *base, size_t size) const;
+    void drain() const;
+    void memcpy(void *dest, void *src, size_t size) const;
+    void memmove(void *dest, void *src, size_t size) const;
+    void memset(void *base, char c, size_t size) const;
+    void memmove(void *dest, void *src, size_t size,
+                 const PMemOpsHooks *hooks) const;
+    void memset(void *base, char c, size_t size,
+                const PMemOpsHooks *hooks) const;
+    void streaming_wr(void *dest, const void *src, size_t bytes) const;
   };
 
   class PMemOpsNoPersist : public PMemOps {
@@ -116,11 +229,10 @@ namespace nvsl {
     void memcpy(void *dest, void *src, size_t size) const;
     void memmove(void *dest, void *src, size_t size) const;
     void memset(void *base, char c, size_t size) const;
-    void streaming_wr(void *dest, const void *src, size_t bytes) const {
-      (void)dest;
-      (void)src;
-      (void)bytes;
-      assert(0 && "unimplemented");
-    }
+    void memmove(void *dest, void *src, size_t size,
+                 const PMemOpsHooks *hooks) const;
+    void memset(void *base, char c, size_t size,
+                const PMemOpsHooks *hooks) const;
+    void streaming_wr(void *dest, const void *src, size_t bytes) const;
   };
 } // namespace nvsl
@@ -0,0 +1,37 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   dispatch.hh
+ * @date   octobre 14, 2026
+ * @brief  Runtime selection of the PMemOps backend
+ */
+
+#include "nvsl/cpu.hh"
+#include "nvsl/pmemops/declarations.hh"
+
+#ifndef NVSL_PMEMOPS_MASTER_FILE
+#error Do not include this file directly. Include "pmemops.hh" instead.
+#endif
+
+inline nvsl::PMemOps *nvsl::PMemOps::best() {
+  static PMemOps *const result = []() -> PMemOps * {
+    const auto &feat = nvsl::cpu_features();
+
+    if (feat.clwb) {
+      DBGH(2) << "Using clwb for PMemOps" << std::endl;
+      return new PMemOpsClwb();
+    } else if (feat.clflushopt) {
+      DBGH(2) << "Using clflushopt for PMemOps" << std::endl;
+      return new PMemOpsClflushOpt();
+    } else if (feat.clflush) {
+      DBGH(2) << "Using clflush for PMemOps" << std::endl;
+      return new PMemOpsClflush();
+    }
+
+    DBGH(2) << "No cache flush instruction available, using msync"
+            << std::endl;
+    return new PMemOpsMsync();
+  }();
+
+  return result;
+}
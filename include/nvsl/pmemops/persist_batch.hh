@@ -0,0 +1,137 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   persist_batch.hh
+ * @date   octobre 14, 2026
+ * @brief  Collect ranges to persist and flush them with a single fence
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "nvsl/pmemops/declarations.hh"
+
+#ifndef NVSL_PMEMOPS_MASTER_FILE
+#error Do not include this file directly. Include "pmemops.hh" instead.
+#endif
+
+namespace nvsl {
+  /**
+   * @brief Batch of ranges persisted together using a single drain()
+   * @details Ranges are recorded at cacheline granularity. commit() sorts them,
+   * merges overlapping and adjacent ranges, flushes each merged run once in
+   * address order and issues a single drain().
+   *
+   * Not thread-safe, use one batch per thread.
+   *
+   * @code
+   * nvsl::PersistBatch batch(pmemops);
+   * batch.add(&node->key, sizeof(node->key));
+   * batch.add(&node->val, sizeof(node->val));
+   * batch.commit();
+   * @endcode
+   */
+  class PersistBatch {
+  public:
+    /** @brief Counters for a committed batch */
+    struct Stats {
+      size_t ranges_added = 0;  /**< Calls to add() */
+      size_t ranges_merged = 0; /**< Ranges merged into another range */
+      size_t lines_flushed = 0; /**< Cachelines flushed */
+      size_t lines_deduped = 0; /**< Cachelines not flushed again */
+    };
+
+  private:
+    static constexpr size_t CL_SIZE = PMemOps::CL_SIZE;
+
+    const PMemOps *pmemops;
+
+    /** @brief [first line, last line + 1) pairs of cacheline addresses */
+    std::vector<std::pair<uintptr_t, uintptr_t>> ranges;
+    size_t lines_added = 0;
+
+  public:
+    /**
+     * @param[in] pmemops Backend used to flush and drain
+     * @param[in] reserve Number of ranges to reserve space for
+     */
+    explicit PersistBatch(const PMemOps *pmemops, size_t reserve = 16)
+        : pmemops(pmemops) {
+      ranges.reserve(reserve);
+    }
+
+    /** @brief Add a range to the batch, nothing is flushed until commit() */
+    void add(const void *ptr, size_t size) {
+      if (size == 0) return;
+
+      const auto start = (uintptr_t)ptr & ~(CL_SIZE - 1);
+      const auto end = ((uintptr_t)ptr + size + CL_SIZE - 1) & ~(CL_SIZE - 1);
+
+      ranges.emplace_back(start, end);
+      lines_added += (end - start) / CL_SIZE;
+    }
+
+    /** @brief Add an object to the batch */
+    template <typename T>
+    void add(const T *obj) {
+      add(obj, sizeof(T));
+    }
+
+    /** @brief Number of ranges waiting for commit() */
+    size_t size() const { return ranges.size(); }
+    bool empty() const { return ranges.empty(); }
+
+    /** @brief Drop all the ranges without flushing them */
+    void clear() {
+      ranges.clear();
+      lines_added = 0;
+    }
+
+    /**
+     * @brief Flush all the ranges in address order and drain once
+     * @details The batch is empty and can be reused after commit()
+     * @return Counters for this batch
+     */
+    Stats commit() {
+      Stats result;
+      result.ranges_added = ranges.size();
+
+      if (ranges.empty()) return result;
+
+      if (ranges.size() > 1) {
+        std::sort(ranges.begin(), ranges.end());
+      }
+
+      auto [run_start, run_end] = ranges.front();
+      const auto flush_run = [&]() {
+        pmemops->flush((void *)run_start, run_end - run_start);
+        result.lines_flushed += (run_end - run_start) / CL_SIZE;
+      };
+
+      for (size_t i = 1; i < ranges.size(); i++) {
+        const auto [start, end] = ranges[i];
+
+        if (start <= run_end) {
+          run_end = std::max(run_end, end);
+          result.ranges_merged++;
+        } else {
+          flush_run();
+          run_start = start;
+          run_end = end;
+        }
+      }
+      flush_run();
+
+      pmemops->drain();
+
+      result.lines_deduped = lines_added - result.lines_flushed;
+      clear();
+
+      return result;
+    }
+  };
+} // namespace nvsl
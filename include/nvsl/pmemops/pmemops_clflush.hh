@@ -0,0 +1,77 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   pmemops_clflush.hh
+ * @date   octobre 14, 2026
+ * @brief  Persistent memory operations using clflush instruction
+ */
+
+#include <cstring>
+#include <sys/mman.h>
+#include <xmmintrin.h>
+
+#include "nvsl/cpu.hh"
+#include "nvsl/error.hh"
+#include "nvsl/pmemops/declarations.hh"
+#include "nvsl/pmemops/policy.hh"
+
+inline nvsl::PMemOpsClflush::PMemOpsClflush() {
+  if (not nvsl::cpu_features().clflush) {
+    NVSL_ERROR("PMemOpsClflush used on a processor that doesn't support "
+               "clflush");
+  }
+}
+
+inline void nvsl::PMemOpsClflush::persist(void *base, size_t size) const {
+  DBGH(4) << "Persisting " << (base) << "of size " << (void *)(size)
+          << std::endl;
+  pmem::ops<pmem::Clflush>::persist(base, size);
+}
+
+inline void nvsl::PMemOpsClflush::clflush(void *addr) const {
+  pmem::Clflush::flush_line(addr);
+}
+
+inline void nvsl::PMemOpsClflush::flush(void *base, size_t size) const {
+  pmem::ops<pmem::Clflush>::flush(base, size);
+}
+
+inline void nvsl::PMemOpsClflush::drain() const {
+  pmem::ops<pmem::Clflush>::drain();
+}
+
+inline void nvsl::PMemOpsClflush::memcpy(void *dest, void *src,
+                                         size_t size) const {
+  DBGH(4) << "MEMCPY :: pmemdest " << (void *)(dest) << " src " << (void *)(src)
+          << " len " << size << std::endl;
+
+  this->memmove(dest, src, size);
+}
+
+inline void nvsl::PMemOpsClflush::memmove(void *dest, void *src,
+                                          size_t size) const {
+  this->memmove(dest, src, size, nullptr);
+}
+
+inline void nvsl::PMemOpsClflush::memmove(void *dest, void *src, size_t size,
+                                          const PMemOpsHooks *hooks) const {
+  pmem::ops<pmem::Clflush>::memmove(dest, src, size, SIZE_MAX, hooks);
+}
+
+inline void nvsl::PMemOpsClflush::memset(void *base, char c,
+                                         size_t size) const {
+  DBGH(4) << "MEMSET :: start " << (void *)(base) << " size " << (void *)(size)
+          << " char " << c << std::endl;
+
+  this->memset(base, c, size, nullptr);
+}
+
+inline void nvsl::PMemOpsClflush::memset(void *base, char c, size_t size,
+                                         const PMemOpsHooks *hooks) const {
+  pmem::ops<pmem::Clflush>::memset(base, c, size, SIZE_MAX, hooks);
+}
+
+inline void nvsl::PMemOpsClflush::streaming_wr(void *dest, const void *src,
+                                               size_t bytes) const {
+  pmem::ops<pmem::Clflush>::streaming_wr(dest, src, bytes);
+}
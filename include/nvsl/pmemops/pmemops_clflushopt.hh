@@ -10,46 +10,34 @@
 #include <sys/mman.h>
 #include <xmmintrin.h>
 
+#include "nvsl/cpu.hh"
 #include "nvsl/error.hh"
 #include "nvsl/pmemops/declarations.hh"
+#include "nvsl/pmemops/policy.hh"
+
+inline nvsl::PMemOpsClflushOpt::PMemOpsClflushOpt() {
+  if (not nvsl::cpu_features().clflushopt) {
+    NVSL_ERROR("PMemOpsClflushOpt used on a processor that doesn't support "
+               "clflushopt");
+  }
+}
 
 inline void nvsl::PMemOpsClflushOpt::persist(void *base, size_t size) const {
   DBGH(4) << "Persisting " << (base) << "of size " << (void *)(size)
           << std::endl;
-  this->flush(base, size);
-  this->drain();
+  pmem::ops<pmem::ClflushOpt>::persist(base, size);
 }
 
 inline void nvsl::PMemOpsClflushOpt::clflush_opt(void *addr) const {
-  asm volatile(".byte 0x66; clflush %0" : "+m"(*(volatile char *)(addr)));
+  pmem::ClflushOpt::flush_line(addr);
 }
 
 inline void nvsl::PMemOpsClflushOpt::flush(void *base, size_t size) const {
-  uintptr_t uptr;
-
-  /*
-   * Loop through cache-line-size (typically 64B) aligned chunks
-   * covering the given range.
-   */
-  for (uptr = (uintptr_t)base & ~(CL_SIZE - 1); uptr < (uintptr_t)base + size;
-       uptr += CL_SIZE) {
-
-#ifdef CLFLUSHOPT_AVAIL
-    this->clflush_opt((void *)uptr);
-#else
-    NVSL_ERROR("This version of libpuddles was built on a platform "
-               "that doesn't support clflushopt");
-#endif
-  }
+  pmem::ops<pmem::ClflushOpt>::flush(base, size);
 }
 
 inline void nvsl::PMemOpsClflushOpt::drain() const {
-#ifdef SFENCE_AVAIL
-  _mm_sfence();
-#else
-  NVSL_ERROR("This version of libpuddles was built on a platform "
-             "that doesn't support sfence");
-#endif
+  pmem::ops<pmem::ClflushOpt>::drain();
 }
 
 inline void nvsl::PMemOpsClflushOpt::memcpy(void *dest, void *src,
@@ -62,10 +50,13 @@ inline void nvsl::PMemOpsClflushOpt::memcpy(void *dest, void *src,
 
 inline void nvsl::PMemOpsClflushOpt::memmove(void *dest, void *src,
                                              size_t size) const {
-  std::memmove(dest, src, size);
+  this->memmove(dest, src, size, nullptr);
+}
 
-  this->flush(dest, size);
-  this->drain();
+inline void nvsl::PMemOpsClflushOpt::memmove(void *dest, void *src,
+                                             size_t size,
+                                             const PMemOpsHooks *hooks) const {
+  pmem::ops<pmem::ClflushOpt>::memmove(dest, src, size, SIZE_MAX, hooks);
 }
 
 inline void nvsl::PMemOpsClflushOpt::memset(void *base, char c,
@@ -73,7 +64,15 @@ inline void nvsl::PMemOpsClflushOpt::memset(void *base, char c,
   DBGH(4) << "MEMSET :: start " << (void *)(base) << " size " << (void *)(size)
           << " char " << c << std::endl;
 
-  std::memset(base, c, size);
-  flush(base, size);
-  drain();
+  this->memset(base, c, size, nullptr);
+}
+
+inline void nvsl::PMemOpsClflushOpt::memset(void *base, char c, size_t size,
+                                            const PMemOpsHooks *hooks) const {
+  pmem::ops<pmem::ClflushOpt>::memset(base, c, size, SIZE_MAX, hooks);
+}
+
+inline void nvsl::PMemOpsClflushOpt::streaming_wr(void *dest, const void *src,
+                                                  size_t bytes) const {
+  pmem::ops<pmem::ClflushOpt>::streaming_wr(dest, src, bytes);
 }
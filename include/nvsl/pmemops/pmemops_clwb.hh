@@ -10,191 +10,138 @@
 #include <chrono>
 #include <cstdint>
 #include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
 #include <emmintrin.h>
-#include <immintrin.h>
-#include <mmintrin.h>
-#include <ratio>
 #include <sys/mman.h>
 #include <xmmintrin.h>
 
+#include "nvsl/cpu.hh"
 #include "nvsl/error.hh"
 #include "nvsl/pmemops/declarations.hh"
+#include "nvsl/pmemops/policy.hh"
+#include "nvsl/pmemops/streaming.hh"
 
-/** @brief Streaming copy 4B */
-inline void streaming_wr_4B(void *dest, const void *src) {
-  DBGH(4) << "Streaming write 4B: " << dest << " -> " << src << "\n";
-  _mm_stream_si32((int *)dest, *(int *)src);
-}
+inline nvsl::PMemOpsClwb::PMemOpsClwb()
+    : nt_threshold(nvsl::NT_THRESHOLD_DEFAULT) {
+  if (not nvsl::cpu_features().clwb) {
+    NVSL_ERROR("PMemOpsClwb used on a processor that doesn't support clwb");
+  }
 
-/** @brief Streaming copy 8B */
-inline void streaming_wr_8B(void *dest, const void *src) {
-  DBGH(4) << "Streaming write 8B: " << dest << " -> " << src << "\n";
-  _mm_stream_si64((long long *)dest, *(long long *)src);
+  const std::string threshold_str = get_env_str(NVSL_NT_THRESHOLD_ENV, "");
+  if (threshold_str == "auto") {
+    /* Calibrate once per process */
+    static const size_t calibrated = this->calibrate_nt_threshold();
+    this->nt_threshold = calibrated;
+  } else if (threshold_str != "") {
+    try {
+      size_t end = 0;
+      this->nt_threshold = std::stoul(threshold_str, &end, 10);
+
+      if (end != threshold_str.size()) {
+        throw std::invalid_argument("Trailing characters");
+      }
+    } catch (std::out_of_range &e) {
+      NVSL_ERROR(std::string(NVSL_NT_THRESHOLD_ENV) + " is out of range: " +
+                 threshold_str);
+    } catch (std::invalid_argument &e) {
+      NVSL_ERROR("Unable to parse " + std::string(NVSL_NT_THRESHOLD_ENV) +
+                 " env variable, expected bytes or \"auto\": " +
+                 threshold_str);
+    }
+  }
 }
 
-/** @brief Streaming copy 16B */
-inline void streaming_wr_16B(void *dest, const void *src) {
-  DBGH(4) << "Streaming write 16B: " << dest << " -> " << src << "\n";
-  __m128i xmm0 = _mm_loadu_si128((__m128i *)src);
+inline size_t nvsl::PMemOpsClwb::calibrate_nt_threshold(void *scratch,
+                                                        size_t scratch_sz) {
+  using namespace std::chrono;
 
-  _mm_stream_si128((__m128i *)dest, xmm0);
-}
+  constexpr size_t MIN_SZ = 256, MAX_SZ = 4 * MiB;
+  constexpr size_t BYTES_PER_ROUND = 32 * MiB;
 
-/** @brief Streaming copy 32B */
-inline void streaming_wr_32B(void *dest, const void *src) {
-  DBGH(4) << "Streaming write 32B: " << dest << " -> " << src << "\n";
-#ifdef __AVX__
-  __m256i ymm0 = _mm256_loadu_si256((__m256i *)src);
+  const bool own_scratch = scratch == nullptr;
+  if (own_scratch) {
+    scratch_sz = 2 * MAX_SZ;
+    scratch = mmap(nullptr, scratch_sz, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (scratch == MAP_FAILED) {
+      DBGW << "Unable to map scratch region for calibration, using "
+           << this->nt_threshold << std::endl;
+      return this->nt_threshold;
+    }
+  }
 
-  _mm256_stream_si256((__m256i *)dest, ymm0);
-#else
-  assert(0 && "AVX512F function called on unsupported processor");
-#endif
-}
+  const size_t max_sz = std::min(MAX_SZ, scratch_sz);
+  auto src = std::make_unique<uint8_t[]>(max_sz);
+  std::memset(src.get(), 0xAB, max_sz);
+  std::memset(scratch, 0, scratch_sz);
+
+  /* Time copying BYTES_PER_ROUND bytes in sz sized copies, round robin */
+  const auto time_copies = [&](size_t sz, bool nt) {
+    const size_t slots = scratch_sz / sz;
+    const auto start = steady_clock::now();
+    for (size_t done = 0, i = 0; done < BYTES_PER_ROUND; done += sz, i++) {
+      auto *dest = (uint8_t *)scratch + (i % slots) * sz;
+      if (nt) {
+        nvsl::detail::nt_memcpy(pmem::Clwb::flush, dest, src.get(), sz);
+      } else {
+        std::memcpy(dest, src.get(), sz);
+        this->flush(dest, sz);
+      }
+      this->drain();
+    }
+    return duration_cast<nanoseconds>(steady_clock::now() - start).count();
+  };
 
-/** @brief Streaming copy 1 cachelines (64B) */
-inline void streaming_wr_64B(void *dest, const void *src) {
-  DBGH(4) << "Streaming write 64B: " << dest << " -> " << src << "\n";
-#ifdef __AVX512F__
-  __m512i zmm0 = _mm512_loadu_si512((const __m512i *)src);
+  size_t result = SIZE_MAX;
+  for (size_t sz = MIN_SZ; sz <= max_sz; sz *= 2) {
+    const auto cached_ns = time_copies(sz, false);
+    const auto nt_ns = time_copies(sz, true);
 
-  _mm512_stream_si512((__m512i *)dest, zmm0);
-#else
-  assert(0 && "AVX512F function called on unsupported processor");
-#endif
-}
+    DBGH(2) << "NT calibration: " << sz << " B, cached " << cached_ns
+            << " ns, nt " << nt_ns << " ns" << std::endl;
 
-/** @brief Streaming copy 2 cachelines (128B) */
-inline void streaming_wr_128B(void *dest, const void *src) {
-  DBGH(4) << "Streaming write 128B: " << dest << " -> " << src << "\n";
-#ifdef __AVX512F__
-  __m512i zmm0 = _mm512_loadu_si512((const __m512i *)src);
-  __m512i zmm1 = _mm512_loadu_si512((const __m512i *)src + 1);
-
-  _mm512_stream_si512((__m512i *)dest, zmm0);
-  _mm512_stream_si512((__m512i *)dest + 1, zmm1);
-#else
-  assert(0 && "AVX512F function called on unsupported processor");
-#endif
-}
+    if (nt_ns < cached_ns) {
+      result = sz;
+      break;
+    }
+  }
+
+  if (own_scratch) munmap(scratch, scratch_sz);
 
-/** @brief Streaming copy 2 cachelines (128B) */
-inline void streaming_wr_256B(void *dest, const void *src) {
-  DBGH(4) << "Streaming write 256B: " << dest << " -> " << src << "\n";
-#ifdef __AVX512F__
-  __m512i zmm0 = _mm512_loadu_si512((const __m512i *)src);
-  __m512i zmm1 = _mm512_loadu_si512((const __m512i *)src + 1);
-  __m512i zmm2 = _mm512_loadu_si512((const __m512i *)src + 2);
-  __m512i zmm3 = _mm512_loadu_si512((const __m512i *)src + 3);
-
-  _mm512_stream_si512((__m512i *)dest, zmm0);
-  _mm512_stream_si512((__m512i *)dest + 1, zmm1);
-  _mm512_stream_si512((__m512i *)dest + 2, zmm2);
-  _mm512_stream_si512((__m512i *)dest + 3, zmm3);
-#else
-  assert(0 && "AVX512F function called on unsupported processor");
-#endif
+  this->nt_threshold = result;
+  return result;
 }
 
 inline void nvsl::PMemOpsClwb::streaming_wr(void *dest, const void *src,
                                             size_t bytes) const {
-  size_t remaining_bytes = bytes;
-  size_t cur_off_bytes = 0;
-
-  const auto src_bp = (const uint8_t *)src;
-  auto dest_bp = (uint8_t *)dest;
-
-  while (remaining_bytes > 0) {
-#ifdef __AVX512F__
-    if (remaining_bytes >= 256) {
-      streaming_wr_256B(dest_bp + cur_off_bytes, src_bp + cur_off_bytes);
-      cur_off_bytes += 256;
-      remaining_bytes -= 256;
-    } else if (remaining_bytes >= 128) {
-      streaming_wr_128B(dest_bp + cur_off_bytes, src_bp + cur_off_bytes);
-      cur_off_bytes += 128;
-      remaining_bytes -= 128;
-    } else if (remaining_bytes >= 64) {
-      streaming_wr_64B(dest_bp + cur_off_bytes, src_bp + cur_off_bytes);
-      cur_off_bytes += 64;
-      remaining_bytes -= 64;
-    } else
-#endif
-#if __AVX__
-        if (remaining_bytes >= 32) {
-      streaming_wr_32B(dest_bp + cur_off_bytes, src_bp + cur_off_bytes);
-      cur_off_bytes += 32;
-      remaining_bytes -= 32;
-    } else
-#endif
-        if (remaining_bytes >= 16) {
-      streaming_wr_16B(dest_bp + cur_off_bytes, src_bp + cur_off_bytes);
-      cur_off_bytes += 16;
-      remaining_bytes -= 16;
-    } else if (remaining_bytes >= 8) {
-      streaming_wr_8B(dest_bp + cur_off_bytes, src_bp + cur_off_bytes);
-      cur_off_bytes += 8;
-      remaining_bytes -= 8;
-    } else if (remaining_bytes >= 4) {
-      streaming_wr_4B(dest_bp + cur_off_bytes, src_bp + cur_off_bytes);
-      cur_off_bytes += 4;
-      remaining_bytes -= 4;
-    }
-  }
+  pmem::ops<pmem::Clwb>::streaming_wr(dest, src, bytes);
 }
 
 inline void nvsl::PMemOpsClwb::persist(void *base, size_t size) const {
-  this->flush(base, size);
-  this->drain();
+  pmem::ops<pmem::Clwb>::persist(base, size);
 }
 
 inline void nvsl::PMemOpsClwb::clwb(void *addr) const {
-  _mm_clwb(addr);
+  pmem::Clwb::flush_line(addr);
 }
 
 inline void nvsl::PMemOpsClwb::clflush(void *addr) const {
-  _mm_clflush(addr);
+  pmem::Clflush::flush_line(addr);
 }
 
 inline void nvsl::PMemOpsClwb::flush(void *base, size_t size) const {
-  uintptr_t uptr;
-
-  /*
-   * Loop through cache-line-size (typically 64B) aligned chunks
-   * covering the given range.
-   */
-  for (uptr = (uintptr_t)base & ~(CL_SIZE - 1); uptr < (uintptr_t)base + size;
-       uptr += CL_SIZE) {
-#ifdef CLWB_AVAIL
-    this->clwb((void *)uptr);
-#else
-    NVSL_ERROR("This version of libpuddles was built on a platform "
-               "that doesn't support clwb");
-#endif
-  }
+  pmem::ops<pmem::Clwb>::flush(base, size);
 }
 
 /** @brief Evict the given range from the cache */
 inline void nvsl::PMemOpsClwb::evict(void *base, size_t size) const {
-  uintptr_t uptr;
-
-  /*
-   * Loop through cache-line-size (typically 64B) aligned chunks
-   * covering the given range.
-   */
-  for (uptr = (uintptr_t)base & ~(CL_SIZE - 1); uptr < (uintptr_t)base + size;
-       uptr += CL_SIZE) {
-    this->clflush((void *)uptr);
-  }
+  pmem::ops<pmem::Clflush>::flush(base, size);
 }
 
 inline void nvsl::PMemOpsClwb::drain() const {
-#ifdef SFENCE_AVAIL
-  _mm_sfence();
-#else
-  NVSL_ERROR("This version of libpuddles was built on a platform "
-             "that doesn't support sfence");
-#endif
+  pmem::ops<pmem::Clwb>::drain();
 }
 
 inline void nvsl::PMemOpsClwb::memcpy(void *dest, void *src,
@@ -207,17 +154,22 @@ inline void nvsl::PMemOpsClwb::memcpy(void *dest, void *src,
 
 inline void nvsl::PMemOpsClwb::memmove(void *dest, void *src,
                                        size_t size) const {
-  std::memmove(dest, src, size);
+  this->memmove(dest, src, size, nullptr);
+}
 
-  flush(dest, size);
-  drain();
+inline void nvsl::PMemOpsClwb::memmove(void *dest, void *src, size_t size,
+                                       const PMemOpsHooks *hooks) const {
+  pmem::ops<pmem::Clwb>::memmove(dest, src, size, this->nt_threshold, hooks);
 }
 
 inline void nvsl::PMemOpsClwb::memset(void *base, char c, size_t size) const {
   DBGH(4) << "MEMSET :: start " << (void *)(base) << " size " << (void *)(size)
           << " char " << c << std::endl;
 
-  std::memset(base, c, size);
-  flush(base, size);
-  drain();
+  this->memset(base, c, size, nullptr);
+}
+
+inline void nvsl::PMemOpsClwb::memset(void *base, char c, size_t size,
+                                      const PMemOpsHooks *hooks) const {
+  pmem::ops<pmem::Clwb>::memset(base, c, size, this->nt_threshold, hooks);
 }
@@ -6,22 +6,73 @@
  * @brief  Persistent memory operations using msync
  */
 
+#include <algorithm>
 #include <cstring>
 #include <sys/mman.h>
 
 #include "nvsl/error.hh"
 #include "nvsl/pmemops/declarations.hh"
+#include "nvsl/pmemops/policy.hh"
+#include "nvsl/pmemops/streaming.hh"
 
 inline void nvsl::PMemOpsMsync::persist(void *base, size_t size) const {
   this->flush(base, size);
+  this->drain();
 }
 
 inline void nvsl::PMemOpsMsync::flush(void *base, size_t size) const {
-  msync(base, size, MS_SYNC);
+  if (size == 0) return;
+
+  const uintptr_t pg_mask = pmem::page_size() - 1;
+  const uintptr_t start = (uintptr_t)base & ~pg_mask;
+  const uintptr_t end = ((uintptr_t)base + size + pg_mask) & ~pg_mask;
+
+  NVSL_GUARD(this->lock);
+
+  /* Extend the last range for sequential flushes */
+  if (not dirty.empty() and dirty.back().first <= start and
+      start <= dirty.back().second) {
+    dirty.back().second = std::max(dirty.back().second, end);
+  } else {
+    dirty.emplace_back(start, end);
+  }
 }
 
 inline void nvsl::PMemOpsMsync::drain() const {
-  /* Do nothing */
+  /*
+   * Hold the lock while syncing so a concurrent drain() doesn't return
+   * before the pages it didn't sync itself are durable
+   */
+  NVSL_GUARD(this->lock);
+
+  if (dirty.empty()) return;
+
+  std::sort(dirty.begin(), dirty.end());
+
+  auto [run_start, run_end] = dirty.front();
+  for (size_t i = 1; i <= dirty.size(); i++) {
+    if (i < dirty.size() and dirty[i].first <= run_end) {
+      run_end = std::max(run_end, dirty[i].second);
+      continue;
+    }
+
+    pmem::Msync::flush((void *)run_start, run_end - run_start);
+
+    if (i < dirty.size()) {
+      run_start = dirty[i].first;
+      run_end = dirty[i].second;
+    }
+  }
+
+  dirty.clear();
+}
+
+inline void nvsl::PMemOpsMsync::streaming_wr(void *dest, const void *src,
+                                             size_t bytes) const {
+  nvsl::detail::nt_write([](void *, size_t) {}, dest, src, bytes);
+
+  /* NT stores still go through the page cache, mark the pages dirty */
+  this->flush(dest, bytes);
 }
 
 inline void nvsl::PMemOpsMsync::memcpy(void *dest, void *src,
@@ -34,8 +85,17 @@ inline void nvsl::PMemOpsMsync::memcpy(void *dest, void *src,
 
 inline void nvsl::PMemOpsMsync::memmove(void *dest, void *src,
                                         size_t size) const {
+  this->memmove(dest, src, size, nullptr);
+}
+
+inline void nvsl::PMemOpsMsync::memmove(void *dest, void *src, size_t size,
+                                        const PMemOpsHooks *hooks) const {
   std::memmove(dest, src, size);
 
+  if (hooks != nullptr) {
+    hooks->on_flush(dest, size);
+    hooks->on_drain();
+  }
   this->flush(dest, size);
   this->drain();
 }
@@ -44,7 +104,17 @@ inline void nvsl::PMemOpsMsync::memset(void *base, char c, size_t size) const {
   DBGH(4) << "MEMSET :: start " << (void *)(base) << " size " << (void *)(size)
           << " char " << c << std::endl;
 
+  this->memset(base, c, size, nullptr);
+}
+
+inline void nvsl::PMemOpsMsync::memset(void *base, char c, size_t size,
+                                       const PMemOpsHooks *hooks) const {
   std::memset(base, c, size);
+
+  if (hooks != nullptr) {
+    hooks->on_flush(base, size);
+    hooks->on_drain();
+  }
   this->flush(base, size);
   this->drain();
 }
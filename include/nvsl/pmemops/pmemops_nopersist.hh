@@ -11,6 +11,7 @@
 
 #include "nvsl/error.hh"
 #include "nvsl/pmemops/declarations.hh"
+#include "nvsl/pmemops/policy.hh"
 
 inline void nvsl::PMemOpsNoPersist::persist(void *base, size_t size) const {
   (void)(base);
@@ -37,6 +38,13 @@ inline void nvsl::PMemOpsNoPersist::memmove(void *dest, void *src,
   std::memmove(dest, src, size);
 }
 
+/* Nothing is flushed or drained, so there is nothing to report */
+inline void nvsl::PMemOpsNoPersist::memmove(void *dest, void *src, size_t size,
+                                            const PMemOpsHooks *hooks) const {
+  (void)hooks;
+  this->memmove(dest, src, size);
+}
+
 inline void nvsl::PMemOpsNoPersist::memset(void *base, char c,
                                            size_t size) const {
   DBGH(4) << "MEMSET :: start " << (void *)(base) << " size " << (void *)(size)
@@ -44,3 +52,14 @@ inline void nvsl::PMemOpsNoPersist::memset(void *base, char c,
 
   std::memset(base, c, size);
 }
+
+inline void nvsl::PMemOpsNoPersist::memset(void *base, char c, size_t size,
+                                           const PMemOpsHooks *hooks) const {
+  (void)hooks;
+  this->memset(base, c, size);
+}
+
+inline void nvsl::PMemOpsNoPersist::streaming_wr(void *dest, const void *src,
+                                                 size_t bytes) const {
+  pmem::ops<pmem::NoPersist>::streaming_wr(dest, src, bytes);
+}
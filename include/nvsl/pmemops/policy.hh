@@ -0,0 +1,238 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   policy.hh
+ * @date   octobre 14, 2026
+ * @brief  Compile-time (non-virtual) PMemOps policies
+ */
+
+#pragma once
+
+#include <cerrno>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <xmmintrin.h>
+
+#include "nvsl/pmemops/declarations.hh"
+#include "nvsl/pmemops/streaming.hh"
+
+#ifndef NVSL_PMEMOPS_MASTER_FILE
+#error Do not include this file directly. Include "pmemops.hh" instead.
+#endif
+
+namespace nvsl::pmem {
+  constexpr size_t CL_SIZE = PMemOps::CL_SIZE;
+
+  /** @brief A backend usable as a static type with nvsl::pmem::ops */
+  template <typename P>
+  concept PMemOpsPolicy = requires(void *base, size_t size) {
+    { P::flush(base, size) };
+    { P::drain() };
+  };
+
+  /** @brief Policy that can flush a single cacheline */
+  template <typename P>
+  concept LinePolicy = PMemOpsPolicy<P> && requires(void *addr) {
+    { P::flush_line(addr) };
+  };
+
+  /**
+   * @brief CRTP base, implements flush() of a range using Impl::flush_line()
+   */
+  template <typename Impl>
+  struct LineFlush {
+    static void flush(void *base, size_t size) {
+      /*
+       * Loop through cache-line-size (typically 64B) aligned chunks
+       * covering the given range.
+       */
+      for (uintptr_t uptr = (uintptr_t)base & ~(CL_SIZE - 1);
+           uptr < (uintptr_t)base + size; uptr += CL_SIZE) {
+        Impl::flush_line((void *)uptr);
+      }
+    }
+  };
+
+  /** @brief clwb + sfence */
+  struct Clwb : LineFlush<Clwb> {
+    static void flush_line(void *addr) {
+      /* clwb encoded as 66 xsaveopt, builds without -mclwb */
+      asm volatile(".byte 0x66; xsaveopt %0" : "+m"(*(volatile char *)(addr)));
+    }
+
+    static void drain() { _mm_sfence(); }
+  };
+
+  /** @brief clflushopt + sfence */
+  struct ClflushOpt : LineFlush<ClflushOpt> {
+    static void flush_line(void *addr) {
+      asm volatile(".byte 0x66; clflush %0" : "+m"(*(volatile char *)(addr)));
+    }
+
+    static void drain() { _mm_sfence(); }
+  };
+
+  /** @brief clflush, drain() only orders NT stores */
+  struct Clflush : LineFlush<Clflush> {
+    static void flush_line(void *addr) { _mm_clflush(addr); }
+
+    static void drain() { _mm_sfence(); }
+  };
+
+  /** @brief System page size */
+  inline size_t page_size() {
+    static const size_t result = sysconf(_SC_PAGESIZE);
+    return result;
+  }
+
+  /** @brief msync(MS_SYNC) of the pages covering the range on every flush */
+  struct Msync {
+    static void flush(void *base, size_t size) {
+      if (size == 0) return;
+
+      /* msync() fails with EINVAL on unaligned addresses */
+      const uintptr_t pg_mask = page_size() - 1;
+      const uintptr_t start = (uintptr_t)base & ~pg_mask;
+      const uintptr_t end = ((uintptr_t)base + size + pg_mask) & ~pg_mask;
+
+      if (msync((void *)start, end - start, MS_SYNC) != 0) {
+        DBGW << "msync(" << (void *)start << ", " << end - start
+             << ") failed: " << strerror(errno) << std::endl;
+      }
+    }
+
+    static void drain() {}
+  };
+
+  /** @brief No persistency guarantee */
+  struct NoPersist {
+    static void flush(void *base, size_t size) {
+      (void)base;
+      (void)size;
+    }
+
+    static void drain() {}
+  };
+
+  /**
+   * @brief PMemOps with all the calls resolved at compile time
+   * @details Same operations as nvsl::PMemOps, but static and inlinable:
+   *
+   * @code
+   * using pm = nvsl::pmem::ops<nvsl::pmem::Clwb>;
+   * pm::persist(&node->next);  // Single clwb + sfence
+   * @endcode
+   *
+   * The caller is responsible for checking that the CPU supports the
+   * policy's instructions (see nvsl::cpu_features()).
+   */
+  template <PMemOpsPolicy P>
+  struct ops {
+    using policy = P;
+
+    static void flush(void *base, size_t size) { P::flush(base, size); }
+
+    static void drain() { P::drain(); }
+
+    /** @brief Flush and drain in a single call */
+    static void persist(void *base, size_t size) {
+      P::flush(base, size);
+      P::drain();
+    }
+
+    /**
+     * @brief Persist a single object
+     * @details Naturally aligned objects of up to a cacheline (e.g., 8B
+     * pointers) never straddle two lines and need a single flush.
+     */
+    template <typename T>
+    static void persist(T *obj) {
+      if constexpr (LinePolicy<P> and sizeof(T) <= alignof(T) and
+                    alignof(T) <= CL_SIZE) {
+        P::flush_line((void *)obj);
+      } else {
+        P::flush((void *)obj, sizeof(T));
+      }
+      P::drain();
+    }
+
+    /** @brief Perform writes directly to the memory skipping caches */
+    static void streaming_wr(void *dest, const void *src, size_t bytes) {
+      if constexpr (LinePolicy<P>) {
+        detail::nt_write(P::flush, dest, src, bytes);
+      } else {
+        /* NT stores still need a writeback for non-cacheline backends */
+        detail::nt_write([](void *, size_t) {}, dest, src, bytes);
+        P::flush(dest, bytes);
+      }
+    }
+
+    /** @brief Persistent version of memcpy, flushes and drains */
+    static void memcpy(void *dest, const void *src, size_t size) {
+      std::memcpy(dest, src, size);
+      persist(dest, size);
+    }
+
+    /** @brief Persistent version of memmove, flushes and drains */
+    static void memmove(void *dest, const void *src, size_t size) {
+      std::memmove(dest, src, size);
+      persist(dest, size);
+    }
+
+    /** @brief Persistent version of memset, flushes and drains */
+    static void memset(void *base, char c, size_t size) {
+      std::memset(base, c, size);
+      persist(base, size);
+    }
+
+    /**
+     * @brief memmove() of the virtual backends
+     * @details With a line policy, copies of at least nt_threshold bytes
+     * between disjoint ranges use NT stores for the whole cachelines. Every
+     * flush, NT store and the fence are reported to hooks if not null.
+     */
+    static void memmove(void *dest, const void *src, size_t size,
+                        size_t nt_threshold, const PMemOpsHooks *hooks) {
+      const auto flush = [hooks](void *base, size_t sz) {
+        if (hooks != nullptr) hooks->on_flush(base, sz);
+        P::flush(base, sz);
+      };
+
+      /* NT copies go front to back, only use them for disjoint ranges */
+      if (LinePolicy<P> and size >= nt_threshold and
+          not detail::overlaps(dest, src, size)) {
+        const auto streamed = detail::nt_memcpy(flush, dest, src, size);
+        if (hooks != nullptr) hooks->on_nt_store(dest, streamed);
+      } else {
+        std::memmove(dest, src, size);
+        flush(dest, size);
+      }
+
+      if (hooks != nullptr) hooks->on_drain();
+      P::drain();
+    }
+
+    /** @brief memset() of the virtual backends, see memmove() */
+    static void memset(void *base, char c, size_t size, size_t nt_threshold,
+                       const PMemOpsHooks *hooks) {
+      const auto flush = [hooks](void *start, size_t sz) {
+        if (hooks != nullptr) hooks->on_flush(start, sz);
+        P::flush(start, sz);
+      };
+
+      if (LinePolicy<P> and size >= nt_threshold) {
+        const auto streamed = detail::nt_memset(flush, base, c, size);
+        if (hooks != nullptr) hooks->on_nt_store(base, streamed);
+      } else {
+        std::memset(base, c, size);
+        flush(base, size);
+      }
+
+      if (hooks != nullptr) hooks->on_drain();
+      P::drain();
+    }
+  };
+} // namespace nvsl::pmem
@@ -0,0 +1,413 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   streaming.hh
+ * @date   octobre 14, 2026
+ * @brief  Streaming (NT store) kernels with runtime SIMD dispatch
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <emmintrin.h>
+#include <immintrin.h>
+#include <xmmintrin.h>
+
+#include "nvsl/cpu.hh"
+#include "nvsl/envvars.hh"
+#include "nvsl/error.hh"
+#include "nvsl/pmemops/declarations.hh"
+
+#ifndef NVSL_PMEMOPS_MASTER_FILE
+#error Do not include this file directly. Include "pmemops.hh" instead.
+#endif
+
+/** @brief Streaming copy 4B */
+inline void streaming_wr_4B(void *dest, const void *src) {
+  DBGH(4) << "Streaming write 4B: " << dest << " -> " << src << "\n";
+  _mm_stream_si32((int *)dest, *(int *)src);
+}
+
+/** @brief Streaming copy 8B */
+inline void streaming_wr_8B(void *dest, const void *src) {
+  DBGH(4) << "Streaming write 8B: " << dest << " -> " << src << "\n";
+  _mm_stream_si64((long long *)dest, *(long long *)src);
+}
+
+/** @brief Streaming copy 16B, dest should be 16B aligned */
+inline void streaming_wr_16B(void *dest, const void *src) {
+  DBGH(4) << "Streaming write 16B: " << dest << " -> " << src << "\n";
+  __m128i xmm0 = _mm_loadu_si128((__m128i *)src);
+
+  _mm_stream_si128((__m128i *)dest, xmm0);
+}
+
+/** @brief Streaming copy 32B, dest should be 32B aligned, requires AVX */
+NVSL_TARGET("avx")
+inline void streaming_wr_32B(void *dest, const void *src) {
+  DBGH(4) << "Streaming write 32B: " << dest << " -> " << src << "\n";
+  __m256i ymm0 = _mm256_loadu_si256((__m256i *)src);
+
+  _mm256_stream_si256((__m256i *)dest, ymm0);
+}
+
+/** @brief Streaming copy 1 cacheline (64B), dest 64B aligned, AVX-512F */
+NVSL_TARGET("avx512f")
+inline void streaming_wr_64B(void *dest, const void *src) {
+  DBGH(4) << "Streaming write 64B: " << dest << " -> " << src << "\n";
+  __m512i zmm0 = _mm512_loadu_si512((const __m512i *)src);
+
+  _mm512_stream_si512((__m512i *)dest, zmm0);
+}
+
+/** @brief Streaming copy 2 cachelines (128B), dest 64B aligned, AVX-512F */
+NVSL_TARGET("avx512f")
+inline void streaming_wr_128B(void *dest, const void *src) {
+  DBGH(4) << "Streaming write 128B: " << dest << " -> " << src << "\n";
+  __m512i zmm0 = _mm512_loadu_si512((const __m512i *)src);
+  __m512i zmm1 = _mm512_loadu_si512((const __m512i *)src + 1);
+
+  _mm512_stream_si512((__m512i *)dest, zmm0);
+  _mm512_stream_si512((__m512i *)dest + 1, zmm1);
+}
+
+/** @brief Streaming copy 4 cachelines (256B), dest 64B aligned, AVX-512F */
+NVSL_TARGET("avx512f")
+inline void streaming_wr_256B(void *dest, const void *src) {
+  DBGH(4) << "Streaming write 256B: " << dest << " -> " << src << "\n";
+  __m512i zmm0 = _mm512_loadu_si512((const __m512i *)src);
+  __m512i zmm1 = _mm512_loadu_si512((const __m512i *)src + 1);
+  __m512i zmm2 = _mm512_loadu_si512((const __m512i *)src + 2);
+  __m512i zmm3 = _mm512_loadu_si512((const __m512i *)src + 3);
+
+  _mm512_stream_si512((__m512i *)dest, zmm0);
+  _mm512_stream_si512((__m512i *)dest + 1, zmm1);
+  _mm512_stream_si512((__m512i *)dest + 2, zmm2);
+  _mm512_stream_si512((__m512i *)dest + 3, zmm3);
+}
+
+/** @brief Streaming set 4B */
+inline void streaming_set_4B(void *dest, char c) {
+  _mm_stream_si32((int *)dest, (int)(0x01010101U * (uint8_t)c));
+}
+
+/** @brief Streaming set 8B */
+inline void streaming_set_8B(void *dest, char c) {
+  _mm_stream_si64((long long *)dest,
+                  (long long)(0x0101010101010101ULL * (uint8_t)c));
+}
+
+/** @brief Streaming set 16B, dest should be 16B aligned */
+inline void streaming_set_16B(void *dest, char c) {
+  _mm_stream_si128((__m128i *)dest, _mm_set1_epi8(c));
+}
+
+/** @brief Streaming set 32B, dest should be 32B aligned, requires AVX */
+NVSL_TARGET("avx")
+inline void streaming_set_32B(void *dest, char c) {
+  _mm256_stream_si256((__m256i *)dest, _mm256_set1_epi8(c));
+}
+
+/** @brief Streaming set 1 cacheline, dest should be 64B aligned, AVX-512F */
+NVSL_TARGET("avx512f")
+inline void streaming_set_64B(void *dest, char c) {
+  const int pattern = (int)(0x01010101U * (uint8_t)c);
+
+  _mm512_stream_si512((__m512i *)dest, _mm512_set1_epi32(pattern));
+}
+
+NVSL_DECL_ENV(NVSL_NT_THRESHOLD);
+
+namespace nvsl {
+  /**
+   * @brief Default size from which PMemOps::memcpy/memset use NT stores
+   * @details Override using NVSL_NT_THRESHOLD=<bytes>, or
+   * NVSL_NT_THRESHOLD=auto to calibrate the threshold on first use.
+   */
+  constexpr size_t NT_THRESHOLD_DEFAULT = 4 * KiB;
+
+  /** @brief Widest SIMD extension used by the streaming kernels */
+  enum class SimdLevel {
+    sse2 = 16,
+    avx = 32,
+    avx512 = 64,
+  };
+
+  /**
+   * @brief Signature of a streaming write kernel
+   * @return Number of bytes written. Kernels only write in 4B or larger chunks,
+   * the remaining (bytes % 4) bytes are left for the caller.
+   */
+  using streaming_wr_fn = size_t (*)(void *dest, const void *src,
+                                     size_t bytes);
+
+  /** @brief Signature of a streaming set kernel, see \ref streaming_wr_fn */
+  using streaming_set_fn = size_t (*)(void *dest, char c, size_t bytes);
+
+  namespace detail {
+    /** @brief Largest chunk the kernels can write at off with rem bytes left */
+    template <size_t MaxVec>
+    __attribute__((always_inline)) inline size_t
+    streaming_chunk(uintptr_t addr, size_t rem) {
+      /* Vector NT stores fault on unaligned addresses, movnti does not */
+      if (MaxVec >= 64 and rem >= 256 and addr % 64 == 0) return 256;
+      if (MaxVec >= 64 and rem >= 128 and addr % 64 == 0) return 128;
+      if (MaxVec >= 64 and rem >= 64 and addr % 64 == 0) return 64;
+      if (MaxVec >= 32 and rem >= 32 and addr % 32 == 0) return 32;
+      if (rem >= 16 and addr % 16 == 0) return 16;
+      if (rem >= 8) return 8;
+      return 4;
+    }
+
+    /**
+     * @brief Streaming write loop using vectors of at most MaxVec bytes
+     * @details Always inlined into the target specific wrappers below so the
+     * kernels get compiled with the right instruction set. Smaller stores are
+     * used until dest is aligned for the vector stores.
+     */
+    template <size_t MaxVec>
+    __attribute__((always_inline)) inline size_t
+    streaming_wr_loop(void *dest, const void *src, size_t bytes) {
+      size_t cur_off_bytes = 0;
+
+      const auto src_bp = (const uint8_t *)src;
+      auto dest_bp = (uint8_t *)dest;
+
+      while (bytes - cur_off_bytes >= 4) {
+        uint8_t *d = dest_bp + cur_off_bytes;
+        const uint8_t *s = src_bp + cur_off_bytes;
+        const size_t chunk =
+            streaming_chunk<MaxVec>((uintptr_t)d, bytes - cur_off_bytes);
+
+        switch (chunk) {
+        case 256:
+          streaming_wr_256B(d, s);
+          break;
+        case 128:
+          streaming_wr_128B(d, s);
+          break;
+        case 64:
+          streaming_wr_64B(d, s);
+          break;
+        case 32:
+          streaming_wr_32B(d, s);
+          break;
+        case 16:
+          streaming_wr_16B(d, s);
+          break;
+        case 8:
+          streaming_wr_8B(d, s);
+          break;
+        default:
+          streaming_wr_4B(d, s);
+          break;
+        }
+
+        cur_off_bytes += chunk;
+      }
+
+      return cur_off_bytes;
+    }
+
+    /** @brief Streaming set loop, see \ref streaming_wr_loop */
+    template <size_t MaxVec>
+    __attribute__((always_inline)) inline size_t
+    streaming_set_loop(void *dest, char c, size_t bytes) {
+      size_t cur_off_bytes = 0;
+      auto dest_bp = (uint8_t *)dest;
+
+      while (bytes - cur_off_bytes >= 4) {
+        uint8_t *d = dest_bp + cur_off_bytes;
+        size_t chunk =
+            streaming_chunk<MaxVec>((uintptr_t)d, bytes - cur_off_bytes);
+
+        if (chunk >= 64) {
+          chunk = 64;
+          streaming_set_64B(d, c);
+        } else if (chunk == 32) {
+          streaming_set_32B(d, c);
+        } else if (chunk == 16) {
+          streaming_set_16B(d, c);
+        } else if (chunk == 8) {
+          streaming_set_8B(d, c);
+        } else {
+          streaming_set_4B(d, c);
+        }
+
+        cur_off_bytes += chunk;
+      }
+
+      return cur_off_bytes;
+    }
+
+    NVSL_TARGET("avx512f")
+    inline size_t streaming_wr_avx512(void *dest, const void *src,
+                                      size_t bytes) {
+      return streaming_wr_loop<64>(dest, src, bytes);
+    }
+
+    NVSL_TARGET("avx")
+    inline size_t streaming_wr_avx(void *dest, const void *src, size_t bytes) {
+      return streaming_wr_loop<32>(dest, src, bytes);
+    }
+
+    inline size_t streaming_wr_sse2(void *dest, const void *src, size_t bytes) {
+      return streaming_wr_loop<16>(dest, src, bytes);
+    }
+
+    NVSL_TARGET("avx512f")
+    inline size_t streaming_set_avx512(void *dest, char c, size_t bytes) {
+      return streaming_set_loop<64>(dest, c, bytes);
+    }
+
+    NVSL_TARGET("avx")
+    inline size_t streaming_set_avx(void *dest, char c, size_t bytes) {
+      return streaming_set_loop<32>(dest, c, bytes);
+    }
+
+    inline size_t streaming_set_sse2(void *dest, char c, size_t bytes) {
+      return streaming_set_loop<16>(dest, c, bytes);
+    }
+
+    inline SimdLevel detect_simd_level() {
+      const auto &feat = cpu_features();
+
+      if (feat.avx512f) return SimdLevel::avx512;
+      if (feat.avx) return SimdLevel::avx;
+      return SimdLevel::sse2;
+    }
+  } // namespace detail
+
+  /**
+   * @brief SIMD extension picked for streaming writes on this CPU
+   * @details AVX-512 > AVX > SSE2. Checked once using CPUID.
+   */
+  inline SimdLevel simd_level() {
+    static const SimdLevel level = detail::detect_simd_level();
+    return level;
+  }
+
+  /** @brief Streaming write kernel for the widest available SIMD extension */
+  inline streaming_wr_fn streaming_wr_kernel() {
+    static const streaming_wr_fn kernel = []() -> streaming_wr_fn {
+      switch (simd_level()) {
+      case SimdLevel::avx512:
+        return detail::streaming_wr_avx512;
+      case SimdLevel::avx:
+        return detail::streaming_wr_avx;
+      case SimdLevel::sse2:
+        break;
+      }
+      return detail::streaming_wr_sse2;
+    }();
+
+    return kernel;
+  }
+
+  /** @brief Streaming set kernel for the widest available SIMD extension */
+  inline streaming_set_fn streaming_set_kernel() {
+    static const streaming_set_fn kernel = []() -> streaming_set_fn {
+      switch (simd_level()) {
+      case SimdLevel::avx512:
+        return detail::streaming_set_avx512;
+      case SimdLevel::avx:
+        return detail::streaming_set_avx;
+      case SimdLevel::sse2:
+        break;
+      }
+      return detail::streaming_set_sse2;
+    }();
+
+    return kernel;
+  }
+
+  namespace detail {
+    /**
+     * @brief Copy using NT stores for the whole cachelines in the range
+     * @details The partial head and tail cachelines are copied using regular
+     * stores and flushed using flush(base, size). Does not drain.
+     * @return Number of bytes written using NT stores
+     */
+    template <typename Flush>
+    inline size_t nt_memcpy(Flush &&flush, void *dest, const void *src,
+                          size_t size) {
+      constexpr size_t CL_SIZE = PMemOps::CL_SIZE;
+
+      const auto dest_bp = (uint8_t *)dest;
+      const auto src_bp = (const uint8_t *)src;
+
+      const size_t head =
+          std::min(size, (size_t)(-(uintptr_t)dest_bp & (CL_SIZE - 1)));
+      const size_t body = (size - head) & ~(CL_SIZE - 1);
+      const size_t tail = size - head - body;
+
+      if (head != 0) {
+        std::memcpy(dest_bp, src_bp, head);
+        flush(dest_bp, head);
+      }
+
+      streaming_wr_kernel()(dest_bp + head, src_bp + head, body);
+
+      if (tail != 0) {
+        std::memcpy(dest_bp + head + body, src_bp + head + body, tail);
+        flush(dest_bp + head + body, tail);
+      }
+
+      return body;
+    }
+
+    /** @brief Set using NT stores, see \ref nt_memcpy */
+    template <typename Flush>
+    inline size_t nt_memset(Flush &&flush, void *dest, char c, size_t size) {
+      constexpr size_t CL_SIZE = PMemOps::CL_SIZE;
+
+      const auto dest_bp = (uint8_t *)dest;
+
+      const size_t head =
+          std::min(size, (size_t)(-(uintptr_t)dest_bp & (CL_SIZE - 1)));
+      const size_t body = (size - head) & ~(CL_SIZE - 1);
+      const size_t tail = size - head - body;
+
+      if (head != 0) {
+        std::memset(dest_bp, c, head);
+        flush(dest_bp, head);
+      }
+
+      streaming_set_kernel()(dest_bp + head, c, body);
+
+      if (tail != 0) {
+        std::memset(dest_bp + head + body, c, tail);
+        flush(dest_bp + head + body, tail);
+      }
+
+      return body;
+    }
+
+    /**
+     * @brief Streaming write of any size and alignment
+     * @details The kernels write in 4B chunks, the last (bytes % 4) bytes are
+     * written using regular stores and flushed using flush(base, size). Does
+     * not drain.
+     */
+    template <typename Flush>
+    inline void nt_write(Flush &&flush, void *dest, const void *src,
+                         size_t bytes) {
+      const size_t done = streaming_wr_kernel()(dest, src, bytes);
+
+      if (done != bytes) {
+        std::memcpy((uint8_t *)dest + done, (const uint8_t *)src + done,
+                    bytes - done);
+        flush((uint8_t *)dest + done, bytes - done);
+      }
+    }
+
+    /** @brief Check if two ranges overlap */
+    inline bool overlaps(const void *a, const void *b, size_t size) {
+      const auto a_u = (uintptr_t)a, b_u = (uintptr_t)b;
+      return a_u < b_u + size and b_u < a_u + size;
+    }
+  } // namespace detail
+} // namespace nvsl
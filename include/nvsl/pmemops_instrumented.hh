@@ -0,0 +1,176 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   pmemops_instrumented.hh
+ * @date   octobre 14, 2026
+ * @brief  PMemOps decorator that counts flushes, fences and NT-store bytes
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "nvsl/pmemops.hh"
+#include "nvsl/stats.hh"
+
+namespace nvsl {
+  /**
+   * @brief Wraps a PMemOps backend and records what it does into stats
+   * @details Counts cachelines flushed, fences issued, NT-store bytes and bytes
+   * copied/set, and keeps histograms of the flush and NT-store sizes. The stats
+   * are named <name>.flush_lines, <name>.fences, ... and are registered with
+   * StatsCollection like any other stat. Recording doesn't take locks or
+   * share cachelines between threads.
+   *
+   * memcpy(), memmove() and memset() are forwarded to the backend, which
+   * reports the lines it flushes, the bytes it streams and its fences through
+   * PMemOpsHooks, so they are counted like explicit calls.
+   *
+   * Use at() to get a wrapper keyed by the calling function, like DBGH uses
+   * __builtin_FUNCTION():
+   * @code
+   * nvsl::PMemOpsInstrumented pmemops(nvsl::PMemOps::best(), "pm");
+   *
+   * void insert(...) {
+   *   static const auto &pm = pmemops.at(); // Counts in pm.insert.*
+   *   pm.persist(&node->next, sizeof(node->next));
+   * }
+   * @endcode
+   */
+  class PMemOpsInstrumented : public PMemOps, private PMemOpsHooks {
+  private:
+    static constexpr size_t SIZE_BUCKETS = 64;
+    static constexpr size_t SIZE_BUCKET_MAX = 64 * CL_SIZE;
+
+    const PMemOps *backend;
+    std::string name;
+
+    mutable ShardedCounter flush_lines, fences, nt_bytes, copy_bytes;
+    mutable StatsFreq<size_t> flush_sizes, nt_sizes;
+
+    mutable std::mutex sites_lock;
+    mutable std::map<std::string, std::unique_ptr<PMemOpsInstrumented>> sites;
+
+    static size_t lines_in(const void *base, size_t size) {
+      if (size == 0) return 0;
+
+      const auto start = (uintptr_t)base & ~(CL_SIZE - 1);
+      const auto end = (uintptr_t)base + size;
+      return (end - start + CL_SIZE - 1) / CL_SIZE;
+    }
+
+    void count_flush(const void *base, size_t size) const {
+      flush_lines += lines_in(base, size);
+      flush_sizes.add(size);
+    }
+
+    void on_flush(const void *base, size_t size) const override {
+      count_flush(base, size);
+    }
+
+    void on_nt_store(const void *base, size_t size) const override {
+      (void)base;
+      nt_bytes += size;
+      nt_sizes.add(size);
+    }
+
+    void on_drain() const override { ++fences; }
+
+  public:
+    /**
+     * @param[in] backend Backend that performs the operations
+     * @param[in] name Prefix for the name of the stats
+     */
+    PMemOpsInstrumented(const PMemOps *backend,
+                        const std::string &name = "pmemops")
+        : backend(backend), name(name) {
+      flush_lines.init(name + ".flush_lines", "Cachelines flushed");
+      fences.init(name + ".fences", "Fences (drain) issued");
+      nt_bytes.init(name + ".nt_bytes", "Bytes written using NT stores");
+      copy_bytes.init(name + ".copy_bytes", "Bytes copied or set");
+      flush_sizes.init(name + ".flush_sizes", "Size of flushes in bytes",
+                       SIZE_BUCKETS, 0, SIZE_BUCKET_MAX);
+      nt_sizes.init(name + ".nt_sizes", "Size of NT writes in bytes",
+                    SIZE_BUCKETS, 0, SIZE_BUCKET_MAX);
+    }
+
+    /**
+     * @brief Get a wrapper that records into stats keyed by the caller
+     * @details Looking up a caller takes a lock, cache the returned reference
+     * in a static at the call site. The reference is valid for the lifetime of
+     * this object.
+     */
+    const PMemOpsInstrumented &
+    at(const char *caller = __builtin_FUNCTION()) const {
+      NVSL_GUARD(sites_lock);
+
+      auto &site = sites[caller];
+      if (site == nullptr) {
+        site = std::make_unique<PMemOpsInstrumented>(backend,
+                                                     name + "." + caller);
+      }
+
+      return *site;
+    }
+
+    size_t flushed_lines() const { return flush_lines.value(); }
+    size_t fence_count() const { return fences.value(); }
+    size_t nt_bytes_written() const { return nt_bytes.value(); }
+    size_t bytes_copied() const { return copy_bytes.value(); }
+
+    void flush(void *base, size_t size) const override {
+      count_flush(base, size);
+      backend->flush(base, size);
+    }
+
+    void persist(void *base, size_t size) const override {
+      count_flush(base, size);
+      ++fences;
+      backend->persist(base, size);
+    }
+
+    void drain() const override {
+      ++fences;
+      backend->drain();
+    }
+
+    void streaming_wr(void *dest, const void *src,
+                      size_t bytes) const override {
+      nt_bytes += bytes;
+      nt_sizes.add(bytes);
+      backend->streaming_wr(dest, src, bytes);
+    }
+
+    void memcpy(void *dest, void *src, size_t size) const override {
+      this->memmove(dest, src, size);
+    }
+
+    void memmove(void *dest, void *src, size_t size) const override {
+      this->memmove(dest, src, size, nullptr);
+    }
+
+    void memset(void *base, char c, size_t size) const override {
+      this->memset(base, c, size, nullptr);
+    }
+
+    /** @brief Counts into this wrapper, `hooks` is ignored */
+    void memmove(void *dest, void *src, size_t size,
+                 const PMemOpsHooks *hooks) const override {
+      (void)hooks;
+      copy_bytes += size;
+      backend->memmove(dest, src, size, this);
+    }
+
+    /** @brief Counts into this wrapper, `hooks` is ignored */
+    void memset(void *base, char c, size_t size,
+                const PMemOpsHooks *hooks) const override {
+      (void)hooks;
+      copy_bytes += size;
+      backend->memset(base, c, size, this);
+    }
+  };
+} // namespace nvsl
@@ -0,0 +1,112 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   pmemops_parallel.hh
+ * @date   octobre 14, 2026
+ * @brief  Multi-threaded, NUMA-aware persist/memcpy/memset for large regions
+ * @details Requires linking with -lnuma
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "nvsl/constants.hh"
+#include "nvsl/numa.hh"
+#include "nvsl/pmemops.hh"
+
+namespace nvsl {
+  /** @brief Regions smaller than this per thread use fewer threads */
+  constexpr size_t PARALLEL_MIN_CHUNK = 1 * MiB;
+
+  namespace detail {
+    /** @brief Pin the calling thread to the NUMA node owning addr, if any */
+    inline void run_on_node_of(void *addr) {
+      if (numa_available() == -1) return;
+
+      /* Negative if the page is not mapped in yet */
+      const int node = numa_node_of_page(addr);
+      if (node >= 0) {
+        numa_run_on_node(node);
+      }
+    }
+
+    /**
+     * @brief Split [0, size) into page aligned chunks and call fn(off, len)
+     * from one thread per chunk
+     * @param[in] placement Address used to pick the NUMA node of a chunk, the
+     * chunk boundaries are 4 KiB aligned addresses relative to it
+     * @details With an unaligned placement, the first and last chunks are
+     * shorter, so no two threads flush or NT-write the same cacheline or page.
+     * Returns once all the threads have joined.
+     */
+    template <typename Fn>
+    inline void parallel_chunks(void *placement, size_t size, size_t nthreads,
+                                Fn &&fn) {
+      if (nthreads == 0) {
+        nthreads = std::max(1U, std::thread::hardware_concurrency());
+      }
+      nthreads = std::max(1UL, std::min(nthreads, size / PARALLEL_MIN_CHUNK));
+
+      /* Chunks are cut from the page holding placement */
+      const size_t head = (uintptr_t)placement & (SMALL_PG_SZ - 1);
+      const size_t span = head + size;
+      const size_t per_thread = (span + nthreads - 1) / nthreads;
+      const size_t chunk = (per_thread + SMALL_PG_SZ - 1) & ~(SMALL_PG_SZ - 1);
+
+      std::vector<std::thread> workers;
+      workers.reserve(nthreads);
+
+      for (size_t start = 0; start < span; start += chunk) {
+        const size_t off = std::max(start, head) - head;
+        const size_t len = std::min(start + chunk, span) - head - off;
+
+        workers.emplace_back([=, &fn]() {
+          run_on_node_of((uint8_t *)placement + off);
+          fn(off, len);
+        });
+      }
+
+      for (auto &worker : workers) {
+        worker.join();
+      }
+    }
+  } // namespace detail
+
+  /**
+   * @brief Persist a large region using multiple threads
+   * @details Each thread flushes a page aligned chunk from the NUMA node that
+   * owns it and drains. The call returns once every chunk is durable.
+   * @param[in] nthreads Number of threads, 0 to use all the CPUs
+   */
+  inline void persist_parallel(const PMemOps *pmemops, void *base, size_t size,
+                               size_t nthreads = 0) {
+    detail::parallel_chunks(base, size, nthreads, [&](size_t off, size_t len) {
+      pmemops->flush((uint8_t *)base + off, len);
+      pmemops->drain();
+    });
+  }
+
+  /**
+   * @brief Persistent memcpy of a large region using multiple threads
+   * @details Chunks are placed using the NUMA node of the destination. dest
+   * and src must not overlap.
+   */
+  inline void memcpy_parallel(const PMemOps *pmemops, void *dest, void *src,
+                              size_t size, size_t nthreads = 0) {
+    detail::parallel_chunks(dest, size, nthreads, [&](size_t off, size_t len) {
+      pmemops->memcpy((uint8_t *)dest + off, (uint8_t *)src + off, len);
+    });
+  }
+
+  /** @brief Persistent memset of a large region using multiple threads */
+  inline void memset_parallel(const PMemOps *pmemops, void *base, char c,
+                              size_t size, size_t nthreads = 0) {
+    detail::parallel_chunks(base, size, nthreads, [&](size_t off, size_t len) {
+      pmemops->memset((uint8_t *)base + off, c, len);
+    });
+  }
+} // namespace nvsl
@@ -0,0 +1,184 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   scope_timer.hh
+ * @date   octobre 14, 2026
+ * @brief  Sampled RAII timers that record into per-call-site stats
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "nvsl/clock.hh"
+#include "nvsl/common.hh"
+#include "nvsl/envvars.hh"
+#include "nvsl/error.hh"
+#include "nvsl/stats.hh"
+
+/**
+ * @brief 1-in-N sampling rate of the NVSL_TIME_SCOPE() sites without their own
+ * variable, 1 times every call and 0 disables them
+ */
+NVSL_DECL_ENV(NVSL_TIME_SCOPE_SAMPLE);
+
+namespace nvsl {
+  /**
+   * @brief Sampling rate used when no variable is set
+   * @details Keeps the two clock reads and the stat update off 63 out of 64
+   * calls of a hot path.
+   */
+  constexpr uint32_t DEFAULT_SCOPE_SAMPLE_PERIOD = 64;
+
+  /**
+   * @brief Stat of one NVSL_TIME_SCOPE() call site
+   * @details Keeps the sampled durations in ns in a StatsScalar with quantiles.
+   * Samples come from many threads, each records into its own shard of the
+   * scalar without a lock.
+   */
+  class StatsScopeTimer : public StatsBase {
+  private:
+    StatsScalar samples{false};
+    uint32_t sample_period = DEFAULT_SCOPE_SAMPLE_PERIOD;
+
+    static uint32_t parse_period(const char *env) {
+      std::string val = env == nullptr ? "" : get_env_str(env, "");
+      if (val.empty()) val = get_env_str(NVSL_TIME_SCOPE_SAMPLE_ENV, "");
+      if (val.empty()) return DEFAULT_SCOPE_SAMPLE_PERIOD;
+
+      try {
+        const auto result = std::stoul(val);
+        if (result > UINT32_MAX) throw std::out_of_range(val);
+        return result;
+      } catch (std::exception &e) {
+        NVSL_ERROR("Invalid sampling rate '" + val + "' for " +
+                   std::string(env == nullptr ? NVSL_TIME_SCOPE_SAMPLE_ENV
+                                              : env));
+      }
+    }
+
+  public:
+    /**
+     * @param[in] name Name of the stat
+     * @param[in] env Env variable with the 1-in-N sampling rate of the site,
+     * falls back to NVSL_TIME_SCOPE_SAMPLE and then to
+     * DEFAULT_SCOPE_SAMPLE_PERIOD
+     */
+    explicit StatsScopeTimer(const std::string &name,
+                             const char *env = nullptr)
+        : StatsBase(true) {
+      sample_period = parse_period(env);
+
+      const auto desc = "Time in ns, sampled 1 in " + std::to_string(period());
+      StatsBase::init(name, desc);
+      samples.init(name, desc, true, time_unit::ns_unit, true);
+      this->publish();
+    }
+
+    ~StatsScopeTimer() { this->deregister(); }
+
+    /** @brief 1-in-N sampling rate, 0 if disabled */
+    uint32_t period() const { return sample_period; }
+
+    void add(double ns) {
+      samples += ns;
+    }
+
+    /** @brief Number of sampled calls */
+    size_t sampled() const {
+      return samples.counts();
+    }
+
+    double avg() const override {
+      return samples.avg();
+    }
+
+    std::string str() const override {
+      return samples.str();
+    }
+
+    std::string latex(const std::string &prefix = "") const override {
+      return samples.latex(prefix);
+    }
+
+    void reset() override {
+      samples.reset();
+    }
+
+    void export_entries(std::vector<StatsEntry> &out) const override {
+      samples.export_entries(out);
+    }
+  };
+
+  /**
+   * @brief RAII timer used by NVSL_TIME_SCOPE()
+   * @details `countdown` is a thread-local of the call site. Unsampled calls
+   * only decrement it, get_site() is called for sampled calls only.
+   */
+  class ScopeTimer {
+  private:
+    StatsScopeTimer *site = nullptr;
+    uint64_t start = 0;
+
+  public:
+    template <typename GetSite>
+    ScopeTimer(uint32_t &countdown, GetSite &&get_site) {
+      if (--countdown != 0) [[likely]] {
+        return;
+      }
+
+      site = get_site();
+      if (site->period() == 0) {
+        countdown = UINT32_MAX;
+        site = nullptr;
+        return;
+      }
+
+      countdown = site->period();
+      start = TscClockSource::start();
+    }
+
+    ScopeTimer(const ScopeTimer &) = delete;
+    ScopeTimer &operator=(const ScopeTimer &) = delete;
+
+    ~ScopeTimer() {
+      if (site != nullptr) [[unlikely]] {
+        site->add(TscClockSource::to_ns(TscClockSource::stop() - start));
+      }
+    }
+  };
+} // namespace nvsl
+
+/**
+ * @brief Time the rest of the scope into a stat named `name`
+ * @details The stat is created and registered with StatsCollection the first
+ * time the site is sampled. One in NVSL_TIME_SCOPE_SAMPLE calls per thread is
+ * timed (default: DEFAULT_SCOPE_SAMPLE_PERIOD, set the variable to 1 to time
+ * every call), the others cost a decrement and a branch.
+ * @code
+ * void put(...) {
+ *   NVSL_TIME_SCOPE("kv.put");
+ *   ...
+ * }
+ * @endcode
+ */
+#define NVSL_TIME_SCOPE(name) NVSL_TIME_SCOPE_ENV(name, nullptr)
+
+/**
+ * @brief NVSL_TIME_SCOPE() with a per-site sampling rate
+ * @param[in] name Name of the stat
+ * @param[in] env Env variable with the rate, e.g., KV_PUT_SAMPLE_ENV after
+ * NVSL_DECL_ENV(KV_PUT_SAMPLE)
+ */
+#define NVSL_TIME_SCOPE_ENV(name, env)                                  \
+  thread_local uint32_t NVSL_LINE_NAME(nvsl_time_scope_countdown) = 1;  \
+  nvsl::ScopeTimer NVSL_LINE_NAME(nvsl_time_scope)(                     \
+      NVSL_LINE_NAME(nvsl_time_scope_countdown),                        \
+      []() -> nvsl::StatsScopeTimer * {                                 \
+        static nvsl::StatsScopeTimer nvsl_time_scope_site((name), (env)); \
+        return &nvsl_time_scope_site;                                   \
+      })
@@ -0,0 +1,120 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   shard.hh
+ * @date   octobre 14, 2026
+ * @brief  Per-thread shard selection for contention-free stats
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace nvsl {
+  /** @brief Upper bound on the default number of shards */
+  constexpr size_t MAX_DEFAULT_SHARDS = 128;
+
+  namespace detail {
+    /**
+     * @brief Hands out small dense indices, the lowest released one first
+     * @details Used for thread indices and Arena ids.
+     */
+    class IndexPool {
+    private:
+      std::mutex lock;
+      std::priority_queue<size_t, std::vector<size_t>, std::greater<size_t>>
+          free_idx;
+      size_t next = 0;
+
+    public:
+      size_t acquire() {
+        std::lock_guard<std::mutex> guard(lock);
+
+        if (free_idx.empty()) return next++;
+
+        const auto result = free_idx.top();
+        free_idx.pop();
+        return result;
+      }
+
+      void release(size_t idx) {
+        std::lock_guard<std::mutex> guard(lock);
+        free_idx.push(idx);
+      }
+    };
+
+    inline IndexPool &thread_index_pool() {
+      static IndexPool pool;
+      return pool;
+    }
+
+    struct ThreadIndex {
+      const size_t idx;
+
+      ThreadIndex() : idx(thread_index_pool().acquire()) {}
+      ~ThreadIndex() { thread_index_pool().release(idx); }
+    };
+  } // namespace detail
+
+  /**
+   * @brief Index of the calling thread among the live threads
+   * @details Indices are dense and the lowest free index is handed out first,
+   * so no two live threads share an index.
+   */
+  inline size_t thread_index() {
+    thread_local const detail::ThreadIndex idx;
+    return idx.idx;
+  }
+
+  /** @brief Number of shards to use when the user doesn't pick one */
+  inline size_t default_shard_count() {
+    const size_t cpus = std::thread::hardware_concurrency();
+    return std::clamp(cpus, (size_t)1, MAX_DEFAULT_SHARDS);
+  }
+
+  /** @brief Shard picked for the calling thread */
+  struct ShardRef {
+    size_t idx;     /**< Shard to update */
+    bool exclusive; /**< Calling thread is the only writer of the shard */
+  };
+
+  /**
+   * @brief Pick the shard of the calling thread out of `shard_cnt` + 1 shards
+   * @details The first `shard_cnt` live threads own a shard each and can update
+   * it without atomic read-modify-writes. Other threads share the last shard.
+   */
+  inline ShardRef this_shard(size_t shard_cnt) {
+    const auto tidx = thread_index();
+
+    if (tidx < shard_cnt) return {tidx, true};
+    return {shard_cnt, false};
+  }
+
+  /**
+   * @brief Add to a shard slot
+   * @details Exclusive slots are updated with a relaxed load and store, shared
+   * slots with an atomic add.
+   */
+  template <typename U>
+  inline void shard_add(std::atomic<U> &slot, U n, bool exclusive) {
+    if (exclusive) {
+      slot.store(slot.load(std::memory_order_relaxed) + n,
+                 std::memory_order_relaxed);
+    } else if constexpr (std::is_integral_v<U>) {
+      slot.fetch_add(n, std::memory_order_relaxed);
+    } else {
+      U cur = slot.load(std::memory_order_relaxed);
+      while (not slot.compare_exchange_weak(cur, cur + n,
+                                            std::memory_order_relaxed)) {
+      }
+    }
+  }
+} // namespace nvsl
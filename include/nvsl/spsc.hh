@@ -0,0 +1,177 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   spsc.hh
+ * @date   octobre 14, 2026
+ * @brief  Bounded single-producer single-consumer channel
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include "nvsl/error.hh"
+#include "nvsl/waitpkg.hh"
+
+namespace nvsl {
+  /**
+   * @brief Cacheline-padded SPSC ring with blocking push() and pop()
+   * @details The producer and consumer indices live on their own lines, next
+   * to a cached copy of the other side's index so try_push()/try_pop() only
+   * touch the shared line when the ring looks full/empty. A blocked side waits
+   * with wait_until() on the other side's index, so UMWAIT wakes it up with
+   * the index store itself. Once sleeping on the futex, the other side wakes
+   * it up with its next operation.
+   * @code
+   * nvsl::SpscRing<Task> ring(1024);
+   * // Stage 1                    // Stage 2
+   * ring.push(std::move(task));  auto task = ring.pop();
+   * @endcode
+   */
+  template <typename T>
+  class SpscRing {
+  private:
+    struct alignas(64) Index {
+      std::atomic<uint64_t> val = 0;
+      std::atomic<uint32_t> sleepers = 0;
+
+      /* Futexes wait on the low half of the index (x86 is little-endian) */
+      const void *futex_word() const { return &val; }
+    };
+
+    struct alignas(64) Cached {
+      uint64_t val = 0;
+    };
+
+    const size_t cap;
+    const uint64_t mask;
+    std::unique_ptr<T[]> slots;
+    WaitPolicy policy;
+
+    Index head;         /* Written by the producer */
+    Cached cached_tail; /* Producer's copy of tail */
+    Index tail;         /* Written by the consumer */
+    Cached cached_head; /* Consumer's copy of head */
+
+    static size_t round_up_pow2(size_t val) {
+      size_t result = 1;
+      while (result < val) result <<= 1;
+      return result;
+    }
+
+    /**
+     * @brief Store the index and wake up a sleeping other side
+     * @details Both the store and the load of sleepers are seq_cst, pairing
+     * with the fetch_add and index load in wait_on(): either the waiter sees
+     * the new index or publish() sees the sleeper, as in WaitSlot::notify().
+     */
+    static void publish(Index &idx, uint64_t val) {
+      idx.val.store(val, std::memory_order_seq_cst);
+      if (idx.sleepers.load(std::memory_order_seq_cst) != 0) [[unlikely]] {
+        detail::futex_wake(idx.futex_word());
+      }
+    }
+
+    /** @brief Wait until pred() using the index the other side updates */
+    template <typename Pred>
+    void wait_on(Index &idx, Pred &&pred) {
+      if (detail::wait_before_sleep(&idx.val, pred, policy)) return;
+
+      idx.sleepers.fetch_add(1, std::memory_order_seq_cst);
+      while (true) {
+        const auto val = (uint32_t)idx.val.load(std::memory_order_seq_cst);
+        if (pred()) break;
+
+        detail::futex_wait(idx.futex_word(), val, policy.futex_timeout_ns);
+      }
+      idx.sleepers.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+  public:
+    /** @param[in] capacity Rounded up to a power of 2 */
+    explicit SpscRing(size_t capacity, const WaitPolicy &policy = {})
+        : cap(round_up_pow2(capacity)), mask(cap - 1),
+          slots(std::make_unique<T[]>(cap)), policy(policy) {
+      if (capacity == 0) NVSL_ERROR("SpscRing needs a non-zero capacity");
+    }
+
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    size_t capacity() const { return cap; }
+
+    /** @brief Elements in the ring, exact only from the producer/consumer */
+    size_t size() const {
+      return head.val.load(std::memory_order_acquire) -
+             tail.val.load(std::memory_order_acquire);
+    }
+
+    /** @brief Producer only, false if the ring is full */
+    template <typename U>
+    bool try_push(U &&elem) {
+      const auto h = head.val.load(std::memory_order_relaxed);
+
+      if (h - cached_tail.val == cap) {
+        cached_tail.val = tail.val.load(std::memory_order_acquire);
+        if (h - cached_tail.val == cap) return false;
+      }
+
+      slots[h & mask] = std::forward<U>(elem);
+      publish(head, h + 1);
+
+      return true;
+    }
+
+    /** @brief Consumer only, false if the ring is empty */
+    bool try_pop(T &elem) {
+      const auto t = tail.val.load(std::memory_order_relaxed);
+
+      if (t == cached_head.val) {
+        cached_head.val = head.val.load(std::memory_order_acquire);
+        if (t == cached_head.val) return false;
+      }
+
+      elem = std::move(slots[t & mask]);
+      publish(tail, t + 1);
+
+      return true;
+    }
+
+    /** @brief Producer only, waits for space */
+    template <typename U>
+    void push(U &&elem) {
+      const auto h = head.val.load(std::memory_order_relaxed);
+
+      if (h - cached_tail.val == cap) {
+        wait_on(tail, [&]() {
+          cached_tail.val = tail.val.load(std::memory_order_acquire);
+          return h - cached_tail.val != cap;
+        });
+      }
+
+      slots[h & mask] = std::forward<U>(elem);
+      publish(head, h + 1);
+    }
+
+    /** @brief Consumer only, waits for an element */
+    T pop() {
+      const auto t = tail.val.load(std::memory_order_relaxed);
+
+      if (t == cached_head.val) {
+        wait_on(head, [&]() {
+          cached_head.val = head.val.load(std::memory_order_acquire);
+          return t != cached_head.val;
+        });
+      }
+
+      T result = std::move(slots[t & mask]);
+      publish(tail, t + 1);
+
+      return result;
+    }
+  };
+} // namespace nvsl
@@ -8,42 +8,223 @@
  * @brief  Class to collect stats, generate summary and latex code
  */
 
+#include "nvsl/constants.hh"
 #include "nvsl/error.hh"
+#include "nvsl/histogram.hh"
+#include "nvsl/shard.hh"
 #include "nvsl/string.hh"
 
+#include <atomic>
 #include <cassert>
+#include <cctype>
 #include <cfloat>
+#include <chrono>
+#include <cmath>
 #include <concepts>
+#include <condition_variable>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <immintrin.h>
 #include <filesystem>
+#include <fstream>
+#include <iomanip>
 #include <ios>
+#include <limits>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <numeric>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
 #include <vector>
 
 #include "nvsl/envvars.hh"
 
+NVSL_DECL_ENV(NVSL_STAT_DUMP_INTERVAL);
+NVSL_DECL_ENV(NVSL_STAT_SHM);
+
+/** @brief Replaced by NVSL_STAT_DUMP_INTERVAL, rejected when set */
 NVSL_DECL_ENV(NVSL_STAT_DUMP_PERIOD);
 
 namespace nvsl {
-  static size_t STAT_DUMP_PERIOD = 16 * 1024UL; // # Samples
+  /** @brief Default interval of the background exporter (ms) */
+  constexpr size_t STAT_DUMP_INTERVAL_MS = 1000;
 #ifdef NVSL_PERIODIC_STAT_DUMP
   constexpr bool periodic_stat_dump = true;
 #else
   constexpr bool periodic_stat_dump = false;
 #endif
 
+  /** @brief Kind of a stat, used to interpret a \ref StatsEntry */
+  enum class StatsKind : uint32_t {
+    other = 0,
+    counter = 1,
+    scalar = 2,
+    freq = 3,
+  };
+
+  /**
+   * @brief Numbers of a stat at one point in time
+   * @details Percentiles are 0 for stats that don't track them.
+   */
+  struct StatsEntry {
+    std::string name;
+    std::string desc;
+    StatsKind kind = StatsKind::other;
+    uint64_t count = 0; /**< Samples or increments */
+    double sum = 0, min = 0, max = 0;
+    bool has_quantiles = false;
+    double p50 = 0, p90 = 0, p99 = 0, p999 = 0;
+
+    double mean() const { return count == 0 ? 0 : sum / count; }
+  };
+
+  inline const char *to_string(StatsKind kind) {
+    switch (kind) {
+    case StatsKind::counter: return "counter";
+    case StatsKind::scalar: return "scalar";
+    case StatsKind::freq: return "freq";
+    case StatsKind::other: break;
+    }
+    return "other";
+  }
+
+  /**
+   * @brief Value copy of the registered stats at one point in time
+   * @details Returned by StatsCollection::snapshot(). delta() turns two
+   * snapshots into per-interval numbers.
+   */
+  struct StatsSnapshot {
+    uint64_t timestamp_ns = 0; /**< Wall clock time */
+    std::chrono::steady_clock::time_point taken_at;
+
+    /** @brief Length of the interval for a delta(), 0 otherwise */
+    double interval_s = 0;
+
+    /** @brief Made by delta(), counts are not cumulative */
+    bool is_delta = false;
+
+    std::vector<StatsEntry> entries;
+
+    /**
+     * @brief Numbers for the interval since prev
+     * @details count and sum become the change since prev, so mean() is the
+     * interval's mean and rate() its throughput. min, max and percentiles
+     * are kept as is, they cannot be computed for the interval alone. Stats
+     * that are not in prev are reported whole.
+     */
+    StatsSnapshot delta(const StatsSnapshot &prev) const;
+
+    /** @brief Count per second, only for a delta() */
+    double rate(const StatsEntry &entry) const {
+      return interval_s == 0 ? 0 : entry.count / interval_s;
+    }
+
+    /** @brief First entry with the name, nullptr if none */
+    const StatsEntry *find(std::string_view name) const {
+      for (const auto &entry : entries) {
+        if (entry.name == name) return &entry;
+      }
+      return nullptr;
+    }
+
+    std::string json() const;
+    std::string csv() const;
+
+    /**
+     * @brief Prometheus text exposition format, names prefixed with nvsl_
+     * @details Counters and summaries need cumulative values, a delta() is
+     * exported as gauges instead. Prefer scraping cumulative snapshots and
+     * letting Prometheus compute rates.
+     */
+    std::string prometheus() const;
+  };
+
+  /** @brief Options for the background stats exporter */
+  struct StatsExporterConfig {
+    /** @brief Time between two exports */
+    std::chrono::milliseconds interval{STAT_DUMP_INTERVAL_MS};
+
+    /** @brief Write each stat's str() to /tmp/<name>.nvsl-stats */
+    bool dump_files = true;
+
+    /** @brief Publish entries to the shm object /dev/shm/<shm_name> */
+    std::string shm_name = "";
+
+    /** @brief Max entries in the shm region, extra entries are dropped */
+    size_t shm_capacity = 1024;
+  };
+
+  /** @brief Max length of a stat name in the shm region, including the NUL */
+  constexpr size_t STATS_SHM_NAME_LEN = 96;
+  constexpr uint32_t STATS_SHM_VERSION = 1;
+
+  /**
+   * @brief Header of the shm region published by the stats exporter
+   * @details The region is a StatsShmHeader followed by `capacity`
+   * StatsShmEntry. The exporter makes `seq` odd before updating the entries
+   * and even once done. Readers copy the entries, and retry if `seq` was odd
+   * or changed while copying. All fields are in native byte order.
+   */
+  struct alignas(CL_SIZE) StatsShmHeader {
+    char magic[8];      /**< "NVSLSTAT", not NUL terminated */
+    uint32_t version;   /**< STATS_SHM_VERSION */
+    uint32_t entry_size; /**< sizeof(StatsShmEntry) */
+    uint32_t capacity;  /**< Number of entries the region has space for */
+    uint32_t count;     /**< Number of valid entries */
+    std::atomic<uint64_t> seq;
+    uint64_t timestamp_ns; /**< Wall clock time of the last export */
+  };
+
+  /** @brief A \ref StatsEntry in the shm region */
+  struct StatsShmEntry {
+    char name[STATS_SHM_NAME_LEN]; /**< NUL terminated, truncated if longer */
+    uint32_t kind;                 /**< StatsKind */
+    uint32_t flags;                /**< Bit 0: has percentiles */
+    uint64_t count;
+    double sum, min, max;
+    double p50, p90, p99, p999;
+  };
+
+  static_assert(std::atomic<uint64_t>::is_always_lock_free);
+  static_assert(sizeof(StatsShmEntry) == STATS_SHM_NAME_LEN + 72);
+
   /** @brief Class to track all the stats in a process */
   class StatsBase;
   class StatsCollection {
   public:
     static std::vector<StatsBase *> *stats;
 
+    /** @brief Guards stats, held while (de)registering and exporting */
+    static inline std::mutex stats_lock;
+
     ~StatsCollection();
     static void dump_stats();
+
+    /** @brief Value copy of the numbers of all registered stats */
+    static StatsSnapshot snapshot();
+
+    static void register_stat(StatsBase *stat);
+    static void deregister_stat(StatsBase *stat);
+
+    /**
+     * @brief Start a background thread that exports all registered stats
+     * @details Replaces a running exporter. With NVSL_PERIODIC_STAT_DUMP
+     * defined, an exporter configured from NVSL_STAT_DUMP_INTERVAL (ms) and
+     * NVSL_STAT_SHM is started when the first stat is registered.
+     */
+    static void start_exporter(const StatsExporterConfig &cfg = {});
+
+    /** @brief Stop the background exporter and wait for it to exit */
+    static void stop_exporter();
   };
 
   /** @brief Base class for \ref Stats */
@@ -51,23 +232,58 @@ namespace nvsl {
   protected:
     std::string stat_name;
     std::string stat_desc;
-    size_t sample_count = 0;
+    bool reg_on_init = false;
+    bool registered = false;
 
-  public:
-    StatsBase(bool reg) {
-      if (reg) {
+    /**
+     * @brief Remove the stat from StatsCollection
+     * @details Stats should call this first thing in their destructor, so the
+     * exporter never sees a partially destroyed stat.
+     */
+    void deregister() {
 #ifdef NVSL_ENABLE_COLLECTION_REGISTRATION
-        StatsCollection::stats->push_back(this);
+      if (registered) {
+        StatsCollection::deregister_stat(this);
+        registered = false;
+      }
 #endif
+    }
+
+    /**
+     * @brief Add the stat to StatsCollection if it was built with reg
+     * @details Stats call this last thing in their init(), once the stat is
+     * fully constructed and initialized, so the exporter only ever sees stats
+     * it can read.
+     */
+    void publish() {
+#ifdef NVSL_ENABLE_COLLECTION_REGISTRATION
+      if (reg_on_init and not registered) {
+        StatsCollection::register_stat(this);
+        registered = true;
       }
+#endif
+    }
 
-      const auto stat_dump_prd_def = std::to_string(STAT_DUMP_PERIOD);
-      const auto stat_dump_prd_str =
-          get_env_str(NVSL_STAT_DUMP_PERIOD_ENV, stat_dump_prd_def);
-      STAT_DUMP_PERIOD = std::stoul(stat_dump_prd_str);
-    };
+  public:
+    /** @param[in] reg Register the stat with StatsCollection in init() */
+    StatsBase(bool reg) : reg_on_init(reg){};
 
+    /** @brief Copies are not registered */
+    StatsBase(const StatsBase &other)
+        : stat_name(other.stat_name), stat_desc(other.stat_desc) {}
+
+    StatsBase &operator=(const StatsBase &other) {
+      stat_name = other.stat_name;
+      stat_desc = other.stat_desc;
+      return *this;
+    }
+
+    virtual ~StatsBase() { deregister(); }
+
+    /** @brief Set the name and description, unregisters until publish() */
     void init(const std::string &name, const std::string &desc) {
+      deregister();
+
       this->stat_name = name;
       this->stat_desc = desc;
     }
@@ -80,47 +296,89 @@ namespace nvsl {
     }
     virtual void reset() {}
     virtual std::string dump_file_name() {
-      const auto basename = nvsl::replace(stat_name, " ", "_");
+      const auto basename = nvsl::replace_all(stat_name, " ", "_");
       return basename + ".nvsl-stats";
     }
 
-    /**
-     * @brief Notify the stat base about a sample
-     * @details Used for stuff like dumping stats occasionally
-     */
-    void notify_sample() {
-      if constexpr (periodic_stat_dump) {
-        if (sample_count++ % STAT_DUMP_PERIOD == 0) {
-          const std::filesystem::path STAT_DUMP_DIR("/tmp/");
-          const auto ofstream_flags = std::ios::out | std::ios::trunc;
-          std::ofstream dump_file(STAT_DUMP_DIR / this->dump_file_name(),
-                                  ofstream_flags);
-
-          dump_file << "name: \"" << this->stat_name << "\"" << std::endl
-                    << "desc: \"" << this->stat_desc << "\"" << std::endl
-                    << "---" << std::endl
-                    << this->str() << std::endl;
-        }
-      }
+    /** @brief Append the current numbers of the stat to out */
+    virtual void export_entries(std::vector<StatsEntry> &out) const {
+      StatsEntry entry;
+      entry.name = stat_name;
+      entry.count = 1;
+      entry.sum = entry.min = entry.max = avg();
+
+      out.push_back(entry);
     }
+
+    const std::string &name() const { return stat_name; }
+    const std::string &desc() const { return stat_desc; }
   };
 
   /**
    * @brief Stat to measure freq of elements with a name and a description
-   * @details
+   * @details add() is lock-free. Each thread records into its own
+   * cacheline-aligned shard of the buckets and the shards are merged when the
+   * stat is read (total(), bucket_count(), str()).
+   *
+   * Buckets are either linear between bucket_min and bucket_max (init()) or
+   * log-linear with a bounded relative error (init_log_linear()). Log-linear
+   * buckets cover a wide range (e.g., 100ns to 100ms) with a few hundred
+   * buckets and find the bucket of a sample without a division.
    */
   template <typename T = size_t>
   class StatsFreq : public StatsBase {
   private:
-    size_t bucket_cnt;
-    T bucket_min, bucket_max, bucket_sz, sum;
-    size_t *counts, underflow_cnt, overflow_cnt;
-    std::mutex lock;
+    static constexpr size_t SLOTS_PER_LINE = CL_SIZE / sizeof(size_t);
+
+    /** @brief One cacheline of bucket counters */
+    struct alignas(CL_SIZE) CountLine {
+      std::atomic<size_t> cnt[SLOTS_PER_LINE];
+    };
+
+    /** @brief Per-shard totals, kept on a separate cacheline */
+    struct alignas(CL_SIZE) ShardTotals {
+      std::atomic<size_t> underflow_cnt, overflow_cnt;
+      std::atomic<T> sum;
+    };
+
+    size_t bucket_cnt = 0;
+    T bucket_min = 0, bucket_max = 0, bucket_sz = 0;
+
+    bool log_linear = false;
+    LogLinearBuckets ll_buckets;
+
+    /** Shards owned by a thread, plus one shared by the remaining threads */
+    size_t shard_cnt = 0, lines_per_shard = 0;
+    std::unique_ptr<CountLine[]> lines;
+    std::unique_ptr<ShardTotals[]> totals;
+
+    std::atomic<size_t> &slot(size_t shard, size_t bucket) const {
+      auto &line = lines[shard * lines_per_shard + bucket / SLOTS_PER_LINE];
+      return line.cnt[bucket % SLOTS_PER_LINE];
+    }
+
+    void alloc_shards(size_t shards) {
+      this->shard_cnt = shards == 0 ? default_shard_count() : shards;
+      this->lines_per_shard = (bucket_cnt + SLOTS_PER_LINE - 1) / SLOTS_PER_LINE;
+      this->lines =
+          std::make_unique<CountLine[]>((shard_cnt + 1) * lines_per_shard);
+      this->totals = std::make_unique<ShardTotals[]>(shard_cnt + 1);
+    }
+
+    T sum() const {
+      T result = 0;
+      if (totals == nullptr) return result; /* Not initialized */
+
+      for (size_t s = 0; s <= shard_cnt; s++) {
+        result += totals[s].sum.load(std::memory_order_relaxed);
+      }
+      return result;
+    }
 
   public:
     StatsFreq(bool reg = true) : StatsBase(reg){};
 
-    ~StatsFreq() { delete[] counts; }
+    ~StatsFreq() { this->deregister(); }
 
     /**
      * @brief Initialize the stats' buckets
@@ -129,9 +387,12 @@ namespace nvsl {
      * @param bucket_cnt Number of buckets
      * @param bucket_min Minimum value of the bucket
      * @param bucket_max Maximum value of the bucket
+     * @param shards Number of threads that get a private shard, 0 picks one
+     * per CPU. Other threads share one shard using atomic adds.
      */
     void init(const std::string &name, const std::string &desc,
-              size_t bucket_cnt, T bucket_min, T bucket_max) {
+              size_t bucket_cnt, T bucket_min, T bucket_max,
+              size_t shards = 0) {
 #if defined(DBGE)
       NVSL_ASSERT(bucket_cnt != 0, "Bucket size cannot be zero");
       NVSL_ASSERT(bucket_max > bucket_min,
@@ -148,12 +409,36 @@ namespace nvsl {
       this->bucket_min = bucket_min;
       this->bucket_max = bucket_max;
       this->bucket_sz = (bucket_max - bucket_min) / bucket_cnt;
-      this->underflow_cnt = 0;
-      this->overflow_cnt = 0;
-      this->sum = 0;
+      this->log_linear = false;
 
-      this->counts = new size_t[bucket_cnt];
-      memset(counts, 0, sizeof(counts[0]) * bucket_cnt);
+      alloc_shards(shards);
+      this->publish();
+    }
+
+    /**
+     * @brief Initialize the stat with log-linear buckets
+     * @param name Name of the stat
+     * @param desc Description of the stat
+     * @param max_value Largest value that is not counted as an overflow
+     * @param sub_bits Precision, buckets are at most 2^-(sub_bits-1) of their
+     * value wide
+     * @param shards Same as init()
+     */
+    void init_log_linear(const std::string &name, const std::string &desc,
+                         uint64_t max_value,
+                         unsigned sub_bits = LogLinearBuckets::DEFAULT_SUB_BITS,
+                         size_t shards = 0) {
+      StatsBase::init(name, desc);
+
+      this->ll_buckets = LogLinearBuckets(max_value, sub_bits);
+      this->log_linear = true;
+      this->bucket_cnt = ll_buckets.size();
+      this->bucket_min = 0;
+      this->bucket_max = (T)max_value;
+      this->bucket_sz = 0;
+
+      alloc_shards(shards);
+      this->publish();
     }
 
     /**
@@ -162,19 +447,27 @@ namespace nvsl {
      * @param[in] count=1 Number of times to add this value to the map
      */
     void add(T val, size_t count = 1) {
-      std::lock_guard<std::mutex> _auto_mutex(lock);
+      const auto shard = this_shard(shard_cnt);
+      auto &tot = totals[shard.idx];
 
       if (val < bucket_min) {
-        underflow_cnt++;
+        shard_add(tot.underflow_cnt, count, shard.exclusive);
+      } else if (log_linear) {
+        if ((uint64_t)val > ll_buckets.max_value()) {
+          shard_add(tot.overflow_cnt, count, shard.exclusive);
+        } else {
+          shard_add(slot(shard.idx, ll_buckets.index((uint64_t)val)), count,
+                    shard.exclusive);
+        }
       } else if (val >= bucket_max) {
-        overflow_cnt++;
+        shard_add(tot.overflow_cnt, count, shard.exclusive);
       } else {
-        size_t bucket_idx = (val - bucket_min) / bucket_sz;
-        counts[bucket_idx]++;
+        const size_t bucket_idx = (val - bucket_min) / bucket_sz;
+        shard_add(slot(shard.idx, std::min(bucket_idx, bucket_cnt - 1)), count,
+                  shard.exclusive);
       }
 
-      this->sum += val;
-      this->notify_sample();
+      shard_add(tot.sum, (T)(val * count), shard.exclusive);
     }
 
     /**
@@ -182,8 +475,11 @@ namespace nvsl {
      * @return Total number of samples
      */
     size_t total() const {
-      return underflow_cnt + overflow_cnt +
-             std::accumulate(counts, counts + bucket_cnt, 0);
+      size_t result = uoflow_count(true, true);
+      for (size_t b = 0; b < bucket_cnt; b++) {
+        result += bucket_count(b);
+      }
+      return result;
     }
 
     /**
@@ -191,7 +487,76 @@ namespace nvsl {
      * @param[in] bucket Bucket index
      * @return Number of samples in the bucket
      */
-    size_t bucket_count(size_t bucket) const { return counts[bucket]; }
+    size_t bucket_count(size_t bucket) const {
+      size_t result = 0;
+      if (lines == nullptr or bucket >= bucket_cnt) return result;
+
+      for (size_t s = 0; s <= shard_cnt; s++) {
+        result += slot(s, bucket).load(std::memory_order_relaxed);
+      }
+      return result;
+    }
+
+    /**
+     * @brief Merge all the shards into a histogram
+     * @details Only for stats initialized with init_log_linear(). Samples are
+     * placed at their bucket's bounds, underflows are dropped.
+     */
+    LogLinearHistogram histogram() const {
+      LogLinearHistogram result(ll_buckets);
+
+      for (size_t b = 0; b < bucket_cnt; b++) {
+        result.add_to_bucket(b, bucket_count(b));
+      }
+      result.add_to_bucket(bucket_cnt, uoflow_count(false, true));
+
+      return result;
+    }
+
+    /**
+     * @brief Add the samples of a histogram, e.g., from another process
+     * @details Only for stats initialized with init_log_linear() with the
+     * same max_value and sub_bits.
+     */
+    void merge(const LogLinearHistogram &other) {
+      if (not log_linear or not(other.layout() == ll_buckets)) {
+        NVSL_ERROR("Cannot merge histograms with different buckets into "
+                   << stat_name);
+      }
+
+      auto &tot = totals[shard_cnt];
+      for (size_t b = 0; b < bucket_cnt; b++) {
+        shard_add(slot(shard_cnt, b), (size_t)other.bucket_count(b), false);
+      }
+      shard_add(tot.overflow_cnt, (size_t)other.overflow_count(), false);
+      shard_add(tot.sum, (T)(other.mean() * other.total()), false);
+    }
+
+    void merge(const StatsFreq &other) { merge(other.histogram()); }
+
+    /**
+     * @brief Sample value at a percentile
+     * @param[in] pc Percentile out of 100
+     * @return Upper bound of the bucket that holds the sample at that rank
+     */
+    T percentile(double pc) const {
+      if (log_linear) return (T)histogram().percentile(pc);
+
+      const auto samples = total();
+      if (samples == 0) return 0;
+
+      const auto rank = (size_t)std::clamp(
+          std::ceil(pc / 100 * samples), 1.0, (double)samples);
+      size_t seen = uoflow_count(true, false);
+      if (seen >= rank) return bucket_min;
+
+      for (size_t b = 0; b < bucket_cnt; b++) {
+        seen += bucket_count(b);
+        if (seen >= rank) return bucket_min + (b + 1) * bucket_sz;
+      }
+
+      return bucket_max;
+    }
 
     /**
      * @brief Get the number of samples in overflow and underflow buckets
@@ -201,16 +566,58 @@ namespace nvsl {
      * enabled)
      */
     size_t uoflow_count(bool underflow_cnt, bool overflow_cnt) const {
-      return (underflow_cnt ? this->underflow_cnt : 0) +
-             (overflow_cnt ? this->overflow_cnt : 0);
+      size_t result = 0;
+      if (totals == nullptr) return result; /* Not initialized */
+
+      for (size_t s = 0; s <= shard_cnt; s++) {
+        const auto &tot = totals[s];
+        if (underflow_cnt) {
+          result += tot.underflow_cnt.load(std::memory_order_relaxed);
+        }
+        if (overflow_cnt) {
+          result += tot.overflow_cnt.load(std::memory_order_relaxed);
+        }
+      }
+      return result;
+    }
+
+    void export_entries(std::vector<StatsEntry> &out) const override {
+      if (totals == nullptr) return; /* Not initialized */
+
+      StatsEntry entry;
+      entry.name = stat_name;
+      entry.kind = StatsKind::freq;
+      entry.count = total();
+      entry.sum = sum();
+      entry.min = bucket_min;
+      entry.max = bucket_max;
+      entry.p50 = percentile(50);
+      entry.p90 = percentile(90);
+      entry.p99 = percentile(99);
+      entry.p999 = percentile(99.9);
+      entry.has_quantiles = true;
+
+      out.push_back(entry);
     }
 
     /**
      * @brief Generate a string representation of the frequency map
      */
     std::string str() const {
+      std::vector<size_t> counts(bucket_cnt);
+      for (size_t i = 0; i < bucket_cnt; i++) {
+        counts[i] = bucket_count(i);
+      }
+
+      const auto underflow = uoflow_count(true, false);
+      const auto overflow = uoflow_count(false, true);
+      const auto samples =
+          underflow + overflow +
+          std::accumulate(counts.begin(), counts.end(), (size_t)0);
+      const T mean = samples == 0 ? 0 : sum() / samples;
+
       std::stringstream ss;
-      ss << stat_name + ".sample_count: " << total() << "\t# " + stat_desc
+      ss << stat_name + ".sample_count: " << samples << "\t# " + stat_desc
          << "\n"
          << stat_name + ".bucket_count: " << bucket_cnt << "\t# " + stat_desc
          << "\n"
@@ -220,13 +627,30 @@ namespace nvsl {
          << "\n"
          << stat_name + ".bucket_size: " << bucket_sz << "\t# " + stat_desc
          << "\n"
-         << stat_name + ".mean: " << sum / total() << "\t# " + stat_desc << "\n"
-         << stat_name + ".mean_per_k: " << (sum / total()) / 1000
-         << "\t# " + stat_desc << " (= mean/1000)\n"
-         << stat_name + ".underflow_count: " << underflow_cnt
-         << "\t# " + stat_desc << "\n"
-         << stat_name + ".overflow_count: " << overflow_cnt
-         << "\t# " + stat_desc << "\n";
+         << stat_name + ".mean: " << mean << "\t# " + stat_desc << "\n"
+         << stat_name + ".mean_per_k: " << mean / 1000 << "\t# " + stat_desc
+         << " (= mean/1000)\n"
+         << stat_name + ".underflow_count: " << underflow << "\t# " + stat_desc
+         << "\n"
+         << stat_name + ".overflow_count: " << overflow << "\t# " + stat_desc
+         << "\n";
+
+      if (log_linear) {
+        const auto hist = histogram();
+        for (const double pc : {50.0, 90.0, 99.0, 99.9}) {
+          ss << stat_name + ".p" << pc << ": " << hist.percentile(pc)
+             << "\t# " + stat_desc << "\n";
+        }
+
+        /* Most of the log-linear buckets are usually empty */
+        for (size_t i = 0; i < bucket_cnt; i++) {
+          if (counts[i] == 0) continue;
+          ss << stat_name + ".bucket[" << ll_buckets.lower(i) << ":"
+             << ll_buckets.upper(i) + 1 << "]: " << counts[i] << std::endl;
+        }
+
+        return ss.str();
+      }
 
       for (size_t i = 0; i < bucket_cnt; i++) {
         const T bkt_lo = bucket_min + i * bucket_sz;
@@ -239,37 +663,63 @@ namespace nvsl {
     }
   };
 
-  /** @brief Counts operations */
+  /**
+   * @brief Counts operations
+   * @details Increments are atomic (relaxed), safe to bump from multiple
+   * threads. Use ShardedCounter if many threads bump it concurrently.
+   */
   class Counter : public StatsBase {
   private:
-    size_t counter;
+    std::atomic<size_t> counter;
 
   public:
     Counter(bool reg = true) : StatsBase(reg), counter(0){};
 
+    Counter(const Counter &other) : StatsBase(other), counter(other.value()) {}
+
+    ~Counter() { this->deregister(); }
+
     void init(const std::string &name, const std::string &desc) {
       StatsBase::init(name, desc);
+      this->publish();
     }
 
     Counter &operator++() {
-      this->counter++;
-
-      this->notify_sample();
+      this->counter.fetch_add(1, std::memory_order_relaxed);
       return *this;
     }
 
     Counter operator++(int) {
       Counter result = *this;
-      ++this->counter;
+      ++*this;
 
-      this->notify_sample();
       return result;
     }
 
-    size_t value() const { return this->counter; }
+    /** @brief Count n operations at once */
+    Counter &operator+=(size_t n) { return add(n); }
+
+    Counter &add(size_t n) {
+      this->counter.fetch_add(n, std::memory_order_relaxed);
+      return *this;
+    }
+
+    size_t value() const {
+      return this->counter.load(std::memory_order_relaxed);
+    }
 
     void reset() override { this->counter = 0; }
 
+    void export_entries(std::vector<StatsEntry> &out) const override {
+      StatsEntry entry;
+      entry.name = stat_name;
+      entry.kind = StatsKind::counter;
+      entry.count = value();
+      entry.sum = (double)value();
+
+      out.push_back(entry);
+    }
+
     /** @brief Get the string representation of the stat */
     std::string str() const override {
       std::stringstream ss;
@@ -283,71 +733,80 @@ namespace nvsl {
     }
   };
 
-  /** @brief Represents a single stat with a name and a description */
-  class StatsScalar : public StatsBase {
+  /**
+   * @brief Counter that scales with the number of threads incrementing it
+   * @details Each thread increments its own cacheline-aligned slot and value()
+   * sums the slots. Use over Counter when many threads bump the same counter
+   * on a hot path. reset() racing with increments may lose some of them.
+   */
+  class ShardedCounter : public StatsBase {
   private:
-    double total;
-    size_t count;
-    double max_v = -DBL_MAX;
-    double min_v = DBL_MAX;
+    struct alignas(CL_SIZE) Slot {
+      std::atomic<size_t> val;
+    };
 
-    bool is_time;
-    time_unit unit;
+    size_t shard_cnt;
+    std::unique_ptr<Slot[]> slots;
 
   public:
-    StatsScalar(bool reg = true) : StatsBase(reg), total(0), count(0){};
+    /**
+     * @param[in] reg Register the counter with StatsCollection in init()
+     * @param[in] shards Number of threads that get a private slot, 0 picks
+     * one per CPU. Other threads share one slot using atomic adds.
+     */
+    ShardedCounter(bool reg = true, size_t shards = 0)
+        : StatsBase(reg),
+          shard_cnt(shards == 0 ? default_shard_count() : shards),
+          slots(std::make_unique<Slot[]>(shard_cnt + 1)) {}
 
-    void init(const std::string &name, const std::string &desc,
-              bool is_time = false, time_unit unit = time_unit::any_unit) {
+    ~ShardedCounter() { this->deregister(); }
+
+    ShardedCounter(const ShardedCounter &) = delete;
+    ShardedCounter &operator=(const ShardedCounter &) = delete;
+
+    void init(const std::string &name, const std::string &desc) {
       StatsBase::init(name, desc);
-      this->is_time = is_time;
-      this->unit = unit;
+      this->publish();
     }
 
-    friend StatsScalar operator+(StatsScalar lhs, const auto rhs) {
-      lhs.max_v = std::max((double)rhs, lhs.max_v);
-      lhs.min_v = std::min((double)rhs, lhs.min_v);
-      lhs.total += rhs;
-      lhs.count++;
-
-      lhs.notify_sample();
-      return lhs;
+    /** @brief Count n operations at once */
+    ShardedCounter &add(size_t n) {
+      const auto shard = this_shard(shard_cnt);
+      shard_add(slots[shard.idx].val, n, shard.exclusive);
+      return *this;
     }
 
-    StatsScalar &operator+=(const auto rhs) {
-      this->max_v = std::max((double)rhs, this->max_v);
-      this->min_v = std::min((double)rhs, this->min_v);
-      this->total += rhs;
-      this->count++;
+    ShardedCounter &operator++() { return add(1); }
+    ShardedCounter &operator+=(size_t n) { return add(n); }
 
-      this->notify_sample();
-      return *this;
+    size_t value() const {
+      size_t result = 0;
+      for (size_t s = 0; s <= shard_cnt; s++) {
+        result += slots[s].val.load(std::memory_order_relaxed);
+      }
+      return result;
     }
 
     void reset() override {
-      this->count = 0;
-      this->total = 0;
-      this->max_v = -DBL_MAX;
-      this->min_v = DBL_MAX;
+      for (size_t s = 0; s <= shard_cnt; s++) {
+        slots[s].val.store(0, std::memory_order_relaxed);
+      }
     }
 
-    /** @brief Get the average value per operation */
-    double avg() const override {
-      if (count == 0) {
-        return 0;
-      } else {
-        return total / (double)count;
-      }
+    void export_entries(std::vector<StatsEntry> &out) const override {
+      StatsEntry entry;
+      entry.name = stat_name;
+      entry.kind = StatsKind::counter;
+      entry.count = value();
+      entry.sum = (double)value();
+
+      out.push_back(entry);
     }
 
     /** @brief Get the string representation of the stat */
     std::string str() const override {
       std::stringstream ss;
-      ss << stat_name << " = " << avg();
-
-      if (this->is_time) {
-        ss << " (" << ns_to_hr(this->avg()) << ")";
-      }
+      ss << StatsBase::stat_name << " = " << value();
 
       if (stat_desc != "") {
         ss << " # " << stat_desc;
@@ -355,111 +814,504 @@ namespace nvsl {
 
       return ss.str();
     }
+  };
 
-    std::string latex(const std::string &prefix = "") const override {
-      std::string name = "stat" + prefix + this->stat_name;
-      std::string result = "";
-      size_t ns, us, ms, s;
+  /**
+   * @brief Represents a single stat with a name and a description
+   * @details With track_quantiles, the stat also keeps a QuantileSketch and
+   * reports p50/p99/p999 in str(), latex() and export_entries(), using
+   * bounded memory.
+   *
+   * Adding a sample is lock-free: each thread writes into its own
+   * cacheline-aligned shard (see this_shard()), whose sequence number is odd
+   * while the shard is written. Readers copy a shard until its sequence number
+   * is the same and even before and after the copy, then merge the copies.
+   * Threads without a private shard take turns on the last shard.
+   *
+   * Samples can be added and merged while any thread reads the stat. reset()
+   * and assignments must not race with adding samples.
+   */
+  class StatsScalar : public StatsBase {
+  private:
+    /** @brief Samples of the thread(s) that map to a shard */
+    struct alignas(CL_SIZE) Shard {
+      std::atomic<uint64_t> seq = 0; /* Odd while being written */
+      mutable std::atomic<bool> reader = false; /* A reader is retrying */
+      std::atomic<size_t> count = 0;
+      std::atomic<double> total = 0;
+      std::atomic<double> max_v = -DBL_MAX;
+      std::atomic<double> min_v = DBL_MAX;
+      QuantileSketch sketch;
+    };
 
-      name = nvsl::zip(nvsl::split(name, "_"), "");
+    /** @brief Merged copy of the shards */
+    struct Totals {
+      size_t count = 0;
+      double total = 0;
+      double max_v = -DBL_MAX;
+      double min_v = DBL_MAX;
+      QuantileSketch sketch;
+
+      double avg() const { return count == 0 ? 0 : total / (double)count; }
+      double max() const { return max_v == -DBL_MAX ? 0 : max_v; }
+      double min() const { return min_v == DBL_MAX ? 0 : min_v; }
+    };
 
-      ns = this->avg();
-      us = this->avg() / 1000;
-      ms = this->avg() / 1000000;
-      s = this->avg() / 1000000000;
+    /** Copies of a shard a reader tries before keeping a torn one */
+    static constexpr size_t READ_RETRIES = 64;
+
+    /** Pauses a writer waits at most for a retrying reader */
+    static constexpr size_t WRITER_PAUSES = 1024;
+
+    size_t shard_cnt;
+    std::atomic<Shard *> shards = nullptr;
+
+    bool is_time = false;
+    time_unit unit = time_unit::any_unit;
+    bool quantiles = false;
+
+    /** @brief The shards, allocated on the first write */
+    Shard *shard_array() {
+      auto *result = shards.load(std::memory_order_acquire);
+      if (result != nullptr) [[likely]] {
+        return result;
+      }
+
+      auto fresh = std::make_unique<Shard[]>(shard_cnt + 1);
+      if (shards.compare_exchange_strong(result, fresh.get(),
+                                         std::memory_order_acq_rel)) {
+        result = fresh.release();
+      }
+
+      return result;
+    }
+
+    /**
+     * @brief Make the shard's sequence number odd
+     * @details The owner of an exclusive shard just stores it. Shared shards
+     * use the odd sequence number as a spinlock.
+     * @return The even sequence number before the write
+     */
+    static uint64_t begin_write(Shard &shard, bool exclusive) {
+      /* Give a retrying reader a window to copy the shard */
+      if (shard.reader.load(std::memory_order_relaxed)) [[unlikely]] {
+        for (size_t i = 0; i < WRITER_PAUSES; i++) {
+          if (not shard.reader.load(std::memory_order_relaxed)) break;
+          _mm_pause();
+        }
+      }
+
+      auto seq = shard.seq.load(std::memory_order_relaxed);
+      if (exclusive) {
+        shard.seq.store(seq + 1, std::memory_order_relaxed);
+      } else {
+        while (seq % 2 != 0 or
+               not shard.seq.compare_exchange_weak(
+                   seq, seq + 1, std::memory_order_acquire,
+                   std::memory_order_relaxed)) {
+          std::this_thread::yield();
+          seq = shard.seq.load(std::memory_order_relaxed);
+        }
+      }
+
+      /* Readers that see any of the writes see the odd sequence number */
+      std::atomic_thread_fence(std::memory_order_release);
+      return seq;
+    }
+
+    static void end_write(Shard &shard, uint64_t seq) {
+      shard.seq.store(seq + 2, std::memory_order_release);
+    }
+
+    /** @brief Merge a copy of shard into out */
+    void read_shard(const Shard &shard, Totals &out) const {
+      Totals copy;
+      size_t tries = 0;
+
+      for (;; tries++) {
+        const auto seq = shard.seq.load(std::memory_order_acquire);
+
+        copy.count = shard.count.load(std::memory_order_relaxed);
+        copy.total = shard.total.load(std::memory_order_relaxed);
+        copy.max_v = shard.max_v.load(std::memory_order_relaxed);
+        copy.min_v = shard.min_v.load(std::memory_order_relaxed);
+        if (quantiles) copy.sketch = shard.sketch;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq % 2 == 0 and
+            shard.seq.load(std::memory_order_relaxed) == seq) {
+          break;
+        }
+
+        /* A writer that never lets go gets a possibly torn copy */
+        if (tries == READ_RETRIES) break;
+        shard.reader.store(true, std::memory_order_relaxed);
+        std::this_thread::yield();
+      }
+      if (tries != 0) shard.reader.store(false, std::memory_order_relaxed);
+
+      out.count += copy.count;
+      out.total += copy.total;
+      out.max_v = std::max(out.max_v, copy.max_v);
+      out.min_v = std::min(out.min_v, copy.min_v);
+      if (quantiles) out.sketch.merge(copy.sketch);
+    }
+
+    Totals totals() const {
+      Totals result;
+
+      const auto *all = shards.load(std::memory_order_acquire);
+      if (all == nullptr) return result;
+
+      for (size_t s = 0; s <= shard_cnt; s++) read_shard(all[s], result);
+      return result;
+    }
+
+    void add_sample(double val) {
+      const auto ref = this_shard(shard_cnt);
+      auto &shard = shard_array()[ref.idx];
+      const auto seq = begin_write(shard, ref.exclusive);
+
+      /* Only this thread writes the shard until end_write() */
+      shard_add(shard.count, (size_t)1, true);
+      shard_add(shard.total, val, true);
+      shard.max_v.store(
+          std::max(val, shard.max_v.load(std::memory_order_relaxed)),
+          std::memory_order_relaxed);
+      shard.min_v.store(
+          std::min(val, shard.min_v.load(std::memory_order_relaxed)),
+          std::memory_order_relaxed);
+      if (quantiles) shard.sketch.add(val);
+
+      end_write(shard, seq);
+    }
+
+    std::string latex_value(const std::string &name, double val) const {
+      const size_t ns = val;
+      const size_t us = val / 1000;
+      const size_t ms = val / 1000000;
+      const size_t s = val / 1000000000;
 
       switch (unit) {
       case nvsl::time_unit::s_unit:
-        result = to_latex(name, ns, "~s", 1000000000);
-        break;
+        return to_latex(name, ns, "~s", 1000000000);
       case nvsl::time_unit::ms_unit:
-        result = to_latex(name, ns, "~ms", 1000000);
-        break;
+        return to_latex(name, ns, "~ms", 1000000);
       case nvsl::time_unit::us_unit:
-        result = to_latex(name, ns, "~\\us{}", 1000);
-        break;
+        return to_latex(name, ns, "~\\us{}", 1000);
       case nvsl::time_unit::ns_unit:
-        result = to_latex(name, ns, "~ns", 1);
-        break;
+        return to_latex(name, ns, "~ns", 1);
       case nvsl::time_unit::any_unit:
         if (s != 0)
-          result = to_latex(name, ns, "~s", 1000000000);
+          return to_latex(name, ns, "~s", 1000000000);
         else if (ms != 0)
-          result = to_latex(name, ns, "~ms", 1000000);
+          return to_latex(name, ns, "~ms", 1000000);
         else if (us != 0)
-          result = to_latex(name, ns, "~\\us{}", 1000);
+          return to_latex(name, ns, "~\\us{}", 1000);
         else
-          result = to_latex(name, ns, "~ns", 1);
-        break;
+          return to_latex(name, ns, "~ns", 1);
       }
 
-      result = result + " % total ops = " + std::to_string(this->count);
+      return "";
+    }
 
-      return result;
-    };
+  public:
+    /**
+     * @param[in] reg Register the stat with StatsCollection in init()
+     * @param[in] shards Number of threads that get a private shard, 0 picks
+     * one per CPU. Other threads take turns on one shared shard.
+     */
+    StatsScalar(bool reg = true, size_t shards = 0)
+        : StatsBase(reg),
+          shard_cnt(shards == 0 ? default_shard_count() : shards){};
+
+    /** @brief Copies are not registered */
+    StatsScalar(const StatsScalar &other)
+        : StatsBase(other), shard_cnt(other.shard_cnt), is_time(other.is_time),
+          unit(other.unit), quantiles(other.quantiles) {
+      merge(other);
+    }
 
-    double max() const {
-      if (this->max_v == -DBL_MAX) {
-        return 0;
-      } else {
-        return this->max_v;
+    StatsScalar &operator=(const StatsScalar &other) {
+      if (this == &other) return *this;
+
+      StatsBase::operator=(other);
+      this->is_time = other.is_time;
+      this->unit = other.unit;
+      this->quantiles = other.quantiles;
+
+      reset();
+      merge(other);
+      return *this;
+    }
+
+    ~StatsScalar() {
+      this->deregister();
+      delete[] shards.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @param name Name of the stat
+     * @param desc Description of the stat
+     * @param is_time Values are times in ns
+     * @param unit Unit used for latex()
+     * @param track_quantiles Keep a sketch to report p50/p99/p999
+     */
+    void init(const std::string &name, const std::string &desc,
+              bool is_time = false, time_unit unit = time_unit::any_unit,
+              bool track_quantiles = false) {
+      StatsBase::init(name, desc);
+
+      this->is_time = is_time;
+      this->unit = unit;
+      this->quantiles = track_quantiles;
+
+      this->publish();
+    }
+
+    friend StatsScalar operator+(StatsScalar lhs, const auto rhs) {
+      lhs.add_sample((double)rhs);
+      return lhs;
+    }
+
+    StatsScalar &operator+=(const auto rhs) {
+      this->add_sample((double)rhs);
+      return *this;
+    }
+
+    /**
+     * @brief Add the samples of another stat, e.g., one per thread
+     * @details Quantiles are merged if both stats track them. The samples go
+     * to the shared shard, so merging can race with adding samples.
+     */
+    void merge(const StatsScalar &other) {
+      if (this == &other) return;
+
+      const auto from = other.totals();
+      auto &shard = shard_array()[shard_cnt];
+      const auto seq = begin_write(shard, false);
+
+      shard_add(shard.count, from.count, true);
+      shard_add(shard.total, from.total, true);
+      shard.max_v.store(
+          std::max(from.max_v, shard.max_v.load(std::memory_order_relaxed)),
+          std::memory_order_relaxed);
+      shard.min_v.store(
+          std::min(from.min_v, shard.min_v.load(std::memory_order_relaxed)),
+          std::memory_order_relaxed);
+      if (quantiles and other.quantiles) shard.sketch.merge(from.sketch);
+
+      end_write(shard, seq);
+    }
+
+    void reset() override {
+      auto *all = shards.load(std::memory_order_acquire);
+      if (all == nullptr) return;
+
+      for (size_t s = 0; s <= shard_cnt; s++) {
+        auto &shard = all[s];
+        const auto seq = begin_write(shard, false);
+
+        shard.count.store(0, std::memory_order_relaxed);
+        shard.total.store(0, std::memory_order_relaxed);
+        shard.max_v.store(-DBL_MAX, std::memory_order_relaxed);
+        shard.min_v.store(DBL_MAX, std::memory_order_relaxed);
+        shard.sketch.reset();
+
+        end_write(shard, seq);
       }
     }
 
-    double min() const {
-      if (this->min_v == DBL_MAX) {
-        return 0;
-      } else {
-        return this->min_v;
+    bool tracks_quantiles() const { return quantiles; }
+
+    /**
+     * @brief Estimated value at a quantile, 0 without track_quantiles
+     * @param[in] q Quantile between 0 and 1, e.g., 0.99
+     */
+    double quantile(double q) const {
+      return quantiles ? totals().sketch.quantile(q) : 0;
+    }
+
+    /** @brief Get the average value per operation */
+    double avg() const override { return totals().avg(); }
+
+    /** @brief Get the string representation of the stat */
+    std::string str() const override {
+      const auto all = totals();
+
+      std::stringstream ss;
+      ss << stat_name << " = " << all.avg();
+
+      if (this->is_time) {
+        ss << " (" << ns_to_hr(all.avg()) << ")";
+      }
+
+      if (quantiles) {
+        for (const auto &[label, q] : {std::pair{"p50", 0.5}, {"p99", 0.99},
+                                       {"p999", 0.999}}) {
+          const auto val = all.sketch.quantile(q);
+          ss << " " << label << " = " << val;
+          if (this->is_time) ss << " (" << ns_to_hr(val) << ")";
+        }
       }
+
+      if (stat_desc != "") {
+        ss << " # " << stat_desc;
+      }
+
+      return ss.str();
+    }
+
+    void export_entries(std::vector<StatsEntry> &out) const override {
+      const auto all = totals();
+
+      StatsEntry entry;
+      entry.name = stat_name;
+      entry.kind = StatsKind::scalar;
+      entry.count = all.count;
+      entry.sum = all.total;
+      entry.min = all.min();
+      entry.max = all.max();
+      if (quantiles) {
+        entry.p50 = all.sketch.quantile(0.5);
+        entry.p90 = all.sketch.quantile(0.9);
+        entry.p99 = all.sketch.quantile(0.99);
+        entry.p999 = all.sketch.quantile(0.999);
+        entry.has_quantiles = true;
+      }
+
+      out.push_back(entry);
     }
 
-    size_t counts() const { return count; }
+    std::string latex(const std::string &prefix = "") const override {
+      std::string name = "stat" + prefix + this->stat_name;
+      name = nvsl::zip(nvsl::split_view(name, "_"), "");
+
+      const auto all = totals();
+      std::string result = latex_value(name, all.avg());
+      result = result + " % total ops = " + std::to_string(all.count);
+
+      /* LaTeX macro names can't have digits */
+      if (quantiles) {
+        result += "\n" + latex_value(name + "PFifty", all.sketch.quantile(0.5));
+        result += "\n" + latex_value(name + "PNinetyNine",
+                                     all.sketch.quantile(0.99));
+        result += "\n" + latex_value(name + "PNinetyNineNine",
+                                     all.sketch.quantile(0.999));
+      }
+
+      return result;
+    };
+
+    double max() const { return totals().max(); }
+
+    double min() const { return totals().min(); }
+
+    size_t counts() const { return totals().count; }
   };
 
-  /** @brief Represents a vector of stats, each with a name */
+  /**
+   * @brief Represents a vector of stats, each with a name
+   * @details Members can be looked up by name, or registered once with
+   * handle() and then accessed through the handle without any lookup:
+   * @code
+   * static const auto parse = phases.handle("parse");
+   * phases[parse] += elapsed_ns;
+   * @endcode
+   * References to members stay valid when members are added. Adding members
+   * and reading the vector take its lock, adding samples to a member through
+   * a handle is lock-free.
+   */
   class StatsNamedVector : public StatsBase {
+  public:
+    /** @brief Stable reference to a member, valid for the vector's lifetime */
+    struct Handle {
+      size_t idx;
+      StatsScalar *stat;
+    };
+
   private:
-    std::map<std::string, StatsScalar> vec;
+    mutable std::mutex lock;
+    std::deque<StatsScalar> members;
+    std::map<std::string, size_t, std::less<>> index;
     time_unit unit;
 
   public:
     StatsNamedVector(bool reg = true) : StatsBase(reg){};
 
+    ~StatsNamedVector() { this->deregister(); }
+
     void init(const std::string &name, const std::string &desc,
               time_unit unit = time_unit::any_unit) {
       StatsBase::init(name, desc);
-      this->unit = unit;
+
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        this->unit = unit;
+      }
+
+      this->publish();
     }
 
-    StatsScalar &operator[](const std::string &memb_name) {
-      const auto memb = this->vec.find(memb_name);
-      const auto exists = memb != this->vec.end();
+    /** @brief Get the handle of a member, adding the member if needed */
+    Handle handle(std::string_view memb_name) {
+      std::lock_guard<std::mutex> guard(lock);
 
-      if (not exists) {
-        vec.emplace(std::make_pair(memb_name, false));
-        vec[memb_name].init(memb_name, "", false, this->unit);
+      const auto memb = this->index.find(memb_name);
+      if (memb != this->index.end()) {
+        return {memb->second, &members[memb->second]};
       }
 
-      return vec[memb_name];
+      auto &stat = members.emplace_back(false);
+      stat.init(std::string(memb_name), "", false, this->unit);
+      index.emplace(memb_name, members.size() - 1);
+
+      return {members.size() - 1, &stat};
+    }
+
+    StatsScalar &operator[](Handle handle) { return *handle.stat; }
+    const StatsScalar &operator[](Handle handle) const { return *handle.stat; }
+
+    StatsScalar &operator[](std::string_view memb_name) {
+      return *this->handle(memb_name).stat;
+    }
+
+    /** @brief Number of members */
+    size_t size() const {
+      std::lock_guard<std::mutex> guard(lock);
+      return members.size();
     }
 
     /** @brief Get the string representation of the stat */
     std::string str() const override {
+      std::lock_guard<std::mutex> guard(lock);
       std::stringstream ss;
 
-      for (const auto &[k, v] : this->vec) {
-        ss << this->stat_name << "." << k << " = " << v.avg() << std::endl;
+      for (const auto &[k, idx] : this->index) {
+        ss << this->stat_name << "." << k << " = " << members[idx].avg()
+           << std::endl;
       }
 
       return ss.str();
     }
 
+    /** @brief One entry per member, named <stat name>.<member name> */
+    void export_entries(std::vector<StatsEntry> &out) const override {
+      std::lock_guard<std::mutex> guard(lock);
+
+      for (const auto &[k, idx] : this->index) {
+        const auto first = out.size();
+        members[idx].export_entries(out);
+        out[first].name = this->stat_name + "." + k;
+      }
+    }
+
     std::string latex(const std::string &prefix = "") const override {
+      std::lock_guard<std::mutex> guard(lock);
       std::stringstream ss;
 
-      for (const auto &[k, v] : this->vec) {
-        ss << v.latex(prefix + this->stat_name) << std::endl;
+      for (const auto &[k, idx] : this->index) {
+        ss << members[idx].latex(prefix + this->stat_name) << std::endl;
       }
 
       return ss.str();
@@ -472,6 +1324,8 @@ namespace nvsl {
 
   inline void StatsCollection::dump_stats() {
     if (get_env_val(NVSL_GEN_STATS_ENV)) {
+      std::lock_guard<std::mutex> guard(stats_lock);
+
       std::cout << std::endl
                 << "==== " << StatsCollection::stats->size()
                 << " Stats ====" << std::endl;
@@ -481,4 +1335,466 @@ namespace nvsl {
       }
     }
   }
+
+  namespace detail {
+    /** @brief Background thread started by StatsCollection::start_exporter() */
+    class StatsExporter {
+    private:
+      const StatsExporterConfig cfg;
+
+      std::mutex lock;
+      std::condition_variable cv;
+      bool stopping = false;
+
+      StatsShmHeader *shm = nullptr;
+      size_t shm_sz = 0;
+
+      std::thread thread;
+
+      void map_shm() {
+        const auto path = "/" + cfg.shm_name;
+        shm_sz = sizeof(StatsShmHeader) + cfg.shm_capacity * sizeof(StatsShmEntry);
+
+        const int fd = shm_open(path.c_str(), O_CREAT | O_RDWR, 0644);
+        if (fd == -1 or ftruncate(fd, shm_sz) != 0) {
+          DBGW << "Unable to create stats shm " << path << ": "
+               << strerror(errno) << std::endl;
+          if (fd != -1) close(fd);
+          return;
+        }
+
+        void *map =
+            mmap(nullptr, shm_sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+
+        if (map == MAP_FAILED) {
+          DBGW << "Unable to map stats shm " << path << ": " << strerror(errno)
+               << std::endl;
+          return;
+        }
+
+        shm = new (map) StatsShmHeader;
+        memcpy(shm->magic, "NVSLSTAT", sizeof(shm->magic));
+        shm->version = STATS_SHM_VERSION;
+        shm->entry_size = sizeof(StatsShmEntry);
+        shm->capacity = cfg.shm_capacity;
+        shm->count = 0;
+        shm->timestamp_ns = 0;
+        shm->seq.store(0, std::memory_order_release);
+      }
+
+      void publish(const std::vector<StatsEntry> &entries) {
+        auto *shm_entries = (StatsShmEntry *)(shm + 1);
+        const auto cnt = std::min(entries.size(), cfg.shm_capacity);
+        const auto now = std::chrono::system_clock::now().time_since_epoch();
+
+        shm->seq.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (size_t i = 0; i < cnt; i++) {
+          const auto &src = entries[i];
+          auto &dst = shm_entries[i];
+
+          strncpy(dst.name, src.name.c_str(), sizeof(dst.name) - 1);
+          dst.name[sizeof(dst.name) - 1] = '\0';
+          dst.kind = (uint32_t)src.kind;
+          dst.flags = src.has_quantiles ? 1 : 0;
+          dst.count = src.count;
+          dst.sum = src.sum;
+          dst.min = src.min;
+          dst.max = src.max;
+          dst.p50 = src.p50;
+          dst.p90 = src.p90;
+          dst.p99 = src.p99;
+          dst.p999 = src.p999;
+        }
+        shm->count = cnt;
+        shm->timestamp_ns =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+
+        shm->seq.fetch_add(1, std::memory_order_release);
+      }
+
+      void run() {
+        std::unique_lock<std::mutex> guard(lock);
+
+        while (not stopping) {
+          cv.wait_for(guard, cfg.interval, [this]() { return stopping; });
+
+          /* Export one last time when stopping, to get the final values */
+          guard.unlock();
+          export_now();
+          guard.lock();
+        }
+      }
+
+    public:
+      explicit StatsExporter(const StatsExporterConfig &cfg) : cfg(cfg) {
+        if (not cfg.shm_name.empty()) map_shm();
+
+        thread = std::thread([this]() { run(); });
+      }
+
+      ~StatsExporter() {
+        {
+          std::lock_guard<std::mutex> guard(lock);
+          stopping = true;
+        }
+        cv.notify_all();
+        thread.join();
+
+        if (shm != nullptr) {
+          munmap(shm, shm_sz);
+          shm_unlink(("/" + cfg.shm_name).c_str());
+        }
+      }
+
+      /** @brief Snapshot all the stats and write them out */
+      void export_now() {
+        using dump_t = std::pair<std::string, std::string>;
+
+        std::vector<StatsEntry> entries;
+        std::vector<dump_t> dumps;
+
+        {
+          std::lock_guard<std::mutex> guard(StatsCollection::stats_lock);
+
+          for (const auto stat : *StatsCollection::stats) {
+            if (shm != nullptr) stat->export_entries(entries);
+            if (cfg.dump_files) {
+              std::stringstream ss;
+              ss << "name: \"" << stat->name() << "\"" << std::endl
+                 << "desc: \"" << stat->desc() << "\"" << std::endl
+                 << "---" << std::endl
+                 << stat->str() << std::endl;
+
+              dumps.emplace_back(stat->dump_file_name(), ss.str());
+            }
+          }
+        }
+
+        /* File and shm writes don't hold the lock */
+        const std::filesystem::path STAT_DUMP_DIR("/tmp/");
+        for (const auto &[fname, content] : dumps) {
+          std::ofstream dump_file(STAT_DUMP_DIR / fname,
+                                  std::ios::out | std::ios::trunc);
+          dump_file << content;
+        }
+
+        if (shm != nullptr) publish(entries);
+      }
+    };
+
+    struct StatsExporterState {
+      std::mutex lock;
+      std::unique_ptr<StatsExporter> exporter;
+    };
+
+    inline StatsExporterState &stats_exporter_state() {
+      static StatsExporterState state;
+      return state;
+    }
+
+    /**
+     * @brief Interval of the exporter started by NVSL_PERIODIC_STAT_DUMP
+     * @details NVSL_STAT_DUMP_PERIOD used to count samples between dumps and
+     * has no equivalent interval, so setting it is an error.
+     */
+    inline std::chrono::milliseconds stat_dump_interval() {
+      if (std::string(get_env_str(NVSL_STAT_DUMP_PERIOD_ENV, "")) != "") {
+        NVSL_ERROR(std::string(NVSL_STAT_DUMP_PERIOD_ENV) +
+                   " is no longer supported, set " +
+                   NVSL_STAT_DUMP_INTERVAL_ENV + " (ms) instead");
+      }
+
+      const std::string interval_str =
+          get_env_str(NVSL_STAT_DUMP_INTERVAL_ENV, "");
+      if (interval_str == "") {
+        return std::chrono::milliseconds(STAT_DUMP_INTERVAL_MS);
+      }
+
+      try {
+        size_t end = 0;
+        const auto result = std::stoul(interval_str, &end, 10);
+
+        if (end != interval_str.size()) {
+          throw std::invalid_argument("Trailing characters");
+        }
+        return std::chrono::milliseconds(result);
+      } catch (std::exception &e) {
+        NVSL_ERROR("Unable to parse " +
+                   std::string(NVSL_STAT_DUMP_INTERVAL_ENV) +
+                   " env variable, expected ms: " + interval_str);
+      }
+    }
+  } // namespace detail
+
+  inline void StatsCollection::register_stat(StatsBase *stat) {
+    {
+      std::lock_guard<std::mutex> guard(stats_lock);
+      stats->push_back(stat);
+    }
+
+    if constexpr (periodic_stat_dump) {
+      static std::once_flag started;
+      std::call_once(started, []() {
+        StatsExporterConfig cfg;
+        cfg.interval = detail::stat_dump_interval();
+        cfg.shm_name = get_env_str(NVSL_STAT_SHM_ENV, "");
+
+        start_exporter(cfg);
+      });
+    }
+  }
+
+  inline void StatsCollection::deregister_stat(StatsBase *stat) {
+    std::lock_guard<std::mutex> guard(stats_lock);
+
+    const auto it = std::find(stats->begin(), stats->end(), stat);
+    if (it != stats->end()) stats->erase(it);
+  }
+
+  inline void StatsCollection::start_exporter(const StatsExporterConfig &cfg) {
+    auto &state = detail::stats_exporter_state();
+    std::lock_guard<std::mutex> guard(state.lock);
+
+    state.exporter.reset();
+    state.exporter = std::make_unique<detail::StatsExporter>(cfg);
+  }
+
+  inline void StatsCollection::stop_exporter() {
+    auto &state = detail::stats_exporter_state();
+    std::lock_guard<std::mutex> guard(state.lock);
+
+    state.exporter.reset();
+  }
+
+  inline StatsSnapshot StatsCollection::snapshot() {
+    StatsSnapshot result;
+    const auto now = std::chrono::system_clock::now().time_since_epoch();
+
+    result.taken_at = std::chrono::steady_clock::now();
+    result.timestamp_ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+
+    std::lock_guard<std::mutex> guard(stats_lock);
+    for (const auto stat : *stats) {
+      const auto first = result.entries.size();
+      stat->export_entries(result.entries);
+
+      for (size_t i = first; i < result.entries.size(); i++) {
+        if (result.entries[i].desc.empty()) {
+          result.entries[i].desc = stat->desc();
+        }
+      }
+    }
+
+    return result;
+  }
+
+  inline StatsSnapshot StatsSnapshot::delta(const StatsSnapshot &prev) const {
+    StatsSnapshot result = *this;
+    result.is_delta = true;
+    result.interval_s =
+        std::chrono::duration<double>(taken_at - prev.taken_at).count();
+
+    std::map<std::string_view, const StatsEntry *> prev_entries;
+    for (const auto &entry : prev.entries) {
+      prev_entries.emplace(entry.name, &entry);
+    }
+
+    for (auto &entry : result.entries) {
+      const auto it = prev_entries.find(entry.name);
+      if (it == prev_entries.end()) continue;
+
+      /* Counters can go down after a reset(), report the new value then */
+      if (it->second->count <= entry.count) {
+        entry.count -= it->second->count;
+        entry.sum -= it->second->sum;
+      }
+    }
+
+    return result;
+  }
+
+  namespace detail {
+    inline std::string json_escape(const std::string &str) {
+      std::stringstream ss;
+
+      for (const char c : str) {
+        switch (c) {
+        case '"': ss << "\\\""; break;
+        case '\\': ss << "\\\\"; break;
+        case '\n': ss << "\\n"; break;
+        case '\t': ss << "\\t"; break;
+        default:
+          if ((unsigned char)c < 0x20) {
+            ss << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+               << (int)c << std::dec;
+          } else {
+            ss << c;
+          }
+        }
+      }
+
+      return ss.str();
+    }
+
+    /** @brief Escape backslashes and newlines for a Prometheus HELP line */
+    inline std::string prometheus_escape(const std::string &str) {
+      std::string result;
+
+      for (const char c : str) {
+        if (c == '\\') {
+          result += "\\\\";
+        } else if (c == '\n') {
+          result += "\\n";
+        } else {
+          result += c;
+        }
+      }
+
+      return result;
+    }
+
+    /** @brief Quote a CSV field */
+    inline std::string csv_quote(const std::string &str) {
+      std::string result = "\"";
+
+      for (const char c : str) {
+        result += c;
+        if (c == '"') result += '"';
+      }
+
+      return result + "\"";
+    }
+
+    /** @brief Prometheus metric names are [a-zA-Z_:][a-zA-Z0-9_:]* */
+    inline std::string prometheus_name(const std::string &name) {
+      std::string result = "nvsl_";
+
+      for (const char c : name) {
+        result += (std::isalnum((unsigned char)c) or c == '_' or c == ':')
+                      ? c
+                      : '_';
+      }
+
+      return result;
+    }
+
+    /** @brief JSON has no inf or nan, write null instead */
+    inline std::string json_number(double val) {
+      if (not std::isfinite(val)) return "null";
+
+      std::stringstream ss;
+      ss.precision(std::numeric_limits<double>::max_digits10);
+      ss << val;
+      return ss.str();
+    }
+  } // namespace detail
+
+  inline std::string StatsSnapshot::json() const {
+    std::stringstream ss;
+    ss.precision(std::numeric_limits<double>::max_digits10);
+
+    using detail::json_number;
+
+    ss << "{\"timestamp_ns\": " << timestamp_ns
+       << ", \"interval_s\": " << json_number(interval_s)
+       << ", \"stats\": [";
+
+    for (size_t i = 0; i < entries.size(); i++) {
+      const auto &e = entries[i];
+
+      ss << (i == 0 ? "" : ", ") << "{\"name\": \""
+         << detail::json_escape(e.name) << "\", \"desc\": \""
+         << detail::json_escape(e.desc) << "\", \"kind\": \""
+         << to_string(e.kind) << "\", \"count\": " << e.count
+         << ", \"sum\": " << json_number(e.sum)
+         << ", \"mean\": " << json_number(e.mean())
+         << ", \"min\": " << json_number(e.min)
+         << ", \"max\": " << json_number(e.max);
+      if (e.has_quantiles) {
+        ss << ", \"p50\": " << json_number(e.p50)
+           << ", \"p90\": " << json_number(e.p90)
+           << ", \"p99\": " << json_number(e.p99)
+           << ", \"p999\": " << json_number(e.p999);
+      }
+      if (interval_s != 0) ss << ", \"rate\": " << json_number(rate(e));
+      ss << "}";
+    }
+    ss << "]}";
+
+    return ss.str();
+  }
+
+  inline std::string StatsSnapshot::csv() const {
+    std::stringstream ss;
+    ss.precision(std::numeric_limits<double>::max_digits10);
+
+    ss << "name,kind,count,sum,mean,min,max,p50,p90,p99,p999,rate\n";
+    for (const auto &e : entries) {
+      ss << detail::csv_quote(e.name) << ","
+         << to_string(e.kind) << "," << e.count << "," << e.sum << ","
+         << e.mean() << "," << e.min << "," << e.max << ",";
+      if (e.has_quantiles) {
+        ss << e.p50 << "," << e.p90 << "," << e.p99 << "," << e.p999;
+      } else {
+        ss << ",,,";
+      }
+      ss << "," << rate(e) << "\n";
+    }
+
+    return ss.str();
+  }
+
+  inline std::string StatsSnapshot::prometheus() const {
+    std::stringstream ss;
+    ss.precision(std::numeric_limits<double>::max_digits10);
+
+    for (const auto &e : entries) {
+      const auto name = detail::prometheus_name(e.name);
+
+      if (not e.desc.empty()) {
+        ss << "# HELP " << name << " " << detail::prometheus_escape(e.desc)
+           << "\n";
+      }
+
+      switch (e.kind) {
+      case StatsKind::counter:
+        ss << "# TYPE " << name << (is_delta ? " gauge\n" : " counter\n")
+           << name << " " << e.count << "\n";
+        break;
+      case StatsKind::scalar:
+      case StatsKind::freq:
+        if (not is_delta) {
+          ss << "# TYPE " << name << " summary\n";
+        } else if (e.has_quantiles) {
+          ss << "# TYPE " << name << " gauge\n";
+        }
+        if (e.has_quantiles) {
+          ss << name << "{quantile=\"0.5\"} " << e.p50 << "\n"
+             << name << "{quantile=\"0.9\"} " << e.p90 << "\n"
+             << name << "{quantile=\"0.99\"} " << e.p99 << "\n"
+             << name << "{quantile=\"0.999\"} " << e.p999 << "\n";
+        }
+        if (is_delta) {
+          ss << "# TYPE " << name << "_sum gauge\n"
+             << name << "_sum " << e.sum << "\n"
+             << "# TYPE " << name << "_count gauge\n"
+             << name << "_count " << e.count << "\n";
+        } else {
+          ss << name << "_sum " << e.sum << "\n"
+             << name << "_count " << e.count << "\n";
+        }
+        break;
+      case StatsKind::other:
+        ss << "# TYPE " << name << " gauge\n"
+           << name << " " << e.sum << "\n";
+        break;
+      }
+    }
+
+    return ss.str();
+  }
 } // namespace nvsl
@@ -9,29 +9,119 @@
  */
 
 #include "nvsl/error.hh"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
 #include <regex>
+#include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace nvsl {
+  /**
+   * @brief Lazy range over the non-empty tokens of a string
+   * @details Tokens are views into the original string, which must outlive
+   * the range. Nothing is allocated.
+   */
+  class SplitView {
+  private:
+    std::string_view str, delim;
+
+  public:
+    class iterator {
+    private:
+      std::string_view rest, delim, tok;
+      bool done = true;
+
+      void next() {
+        while (not rest.empty()) {
+          const auto pos =
+              delim.empty() ? std::string_view::npos : rest.find(delim);
+
+          if (pos == std::string_view::npos) {
+            tok = rest;
+            rest = {};
+          } else {
+            tok = rest.substr(0, pos);
+            rest = rest.substr(pos + delim.size());
+          }
+
+          if (not tok.empty()) return;
+        }
+
+        done = true;
+      }
+
+    public:
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = std::string_view;
+      using difference_type = std::ptrdiff_t;
+      using pointer = const std::string_view *;
+      using reference = const std::string_view &;
+
+      iterator() = default;
+      iterator(std::string_view str, std::string_view delim)
+          : rest(str), delim(delim), done(false) {
+        next();
+      }
+
+      reference operator*() const { return tok; }
+      pointer operator->() const { return &tok; }
+
+      iterator &operator++() {
+        next();
+        return *this;
+      }
+
+      iterator operator++(int) {
+        auto result = *this;
+        next();
+        return result;
+      }
+
+      bool operator==(const iterator &other) const {
+        return done == other.done and (done or tok.data() == other.tok.data());
+      }
+
+      bool operator!=(const iterator &other) const {
+        return not(*this == other);
+      }
+    };
+
+    SplitView(std::string_view str, std::string_view delim)
+        : str(str), delim(delim) {}
+
+    iterator begin() const { return iterator(str, delim); }
+    iterator end() const { return iterator(); }
+  };
+
+  /**
+   * @brief Split string using a delimeter into string_view tokens, lazily
+   * @details Skips empty tokens, like split()
+   * @code
+   * for (const auto tok : nvsl::split_view(line, ",")) parse(tok);
+   * @endcode
+   */
+  inline SplitView split_view(std::string_view str, std::string_view delim) {
+    return SplitView(str, delim);
+  }
+
+  inline SplitView split_view(const char *str, std::string_view delim) {
+    return SplitView(str, delim);
+  }
+
+  /* The tokens would point into a destroyed temporary */
+  SplitView split_view(std::string &&str, std::string_view delim) = delete;
+
   /** @brief Split string using a delimeter into a vector of strings */
   inline std::vector<std::string> split(const std::string &str,
                                         const std::string &delim,
                                         size_t assert_length = UINT64_MAX) {
     std::vector<std::string> result;
-    size_t prev = 0, pos = 0;
 
-    do {
-      pos = str.find(delim, prev);
-
-      if (pos == std::string::npos) pos = str.length();
-
-      std::string token = str.substr(prev, pos - prev);
-
-      if (!token.empty()) result.push_back(token);
-
-      prev = pos + delim.length();
-    } while (pos < str.length() && prev < str.length());
+    for (const auto tok : split_view(str, delim)) result.emplace_back(tok);
 
     if (assert_length != UINT64_MAX) {
       NVSL_ASSERT(result.size() == assert_length, "Not enough tokens");
@@ -40,21 +130,39 @@ namespace nvsl {
     return result;
   }
 
-  /** @brief Concat all the elements of a string vector into a stingle string */
-  inline auto zip(const std::vector<std::string> arr,
-                  const std::string join_str) {
-    std::string result = "";
+  /**
+   * @brief Concat all the elements of a range of strings into a single string
+   * @details Works with vectors of strings as well as split_view(), the
+   * output is allocated once
+   */
+  template <typename Range>
+  inline std::string zip(const Range &arr, std::string_view join_str) {
+    size_t len = 0, cnt = 0;
+    for (const auto &tok : arr) {
+      len += std::string_view(tok).size();
+      cnt++;
+    }
+
+    std::string result;
+    if (cnt == 0) return result;
+    result.reserve(len + join_str.size() * (cnt - 1));
 
-    size_t iter = 0;
+    bool first = true;
     for (const auto &tok : arr) {
+      if (not first) result += join_str;
       result += tok;
-
-      if (iter++ != arr.size() - 1) result += join_str;
+      first = false;
     }
 
     return result;
   }
 
+  /** @brief zip() for a braced list, e.g., zip({"1", "2"}, ", ") */
+  inline std::string zip(const std::vector<std::string> &arr,
+                         std::string_view join_str) {
+    return zip<std::vector<std::string>>(arr, join_str);
+  }
+
   /** @brief Checks if a string is suffix of another string */
   inline auto is_suffix(const std::string &suffix, const std::string &str) {
     auto mismatch =
@@ -107,9 +215,39 @@ namespace nvsl {
     return str.substr(0, end + 1);
   }
 
+  /** @brief Replace every occurrence of a literal substring, no regex */
+  inline std::string replace_all(std::string_view str, std::string_view from,
+                                 std::string_view to) {
+    if (from.empty()) return std::string(str);
+
+    std::string result;
+    result.reserve(str.size());
+
+    size_t prev = 0, pos;
+    while ((pos = str.find(from, prev)) != std::string_view::npos) {
+      result.append(str, prev, pos - prev);
+      result += to;
+      prev = pos + from.size();
+    }
+    result.append(str, prev);
+
+    return result;
+  }
+
+  /** @brief Replace every match of a regex, compile it once and reuse it */
+  inline std::string replace(const std::string &str, const std::regex &re,
+                             const std::string &replacement) {
+    return std::regex_replace(str, re, replacement);
+  }
+
+  /**
+   * @brief Replace every match of substr, interpreted as a regex
+   * @details Compiles the regex on every call, use replace_all() for literal
+   * substrings or pass a std::regex
+   */
   inline std::string replace(const std::string &str, const std::string &substr,
                              const std::string &replacement) {
-    return std::regex_replace(str, std::regex(substr), replacement);
+    return replace(str, std::regex(substr), replacement);
   }
 
   inline std::string trim(const std::string &str) {
@@ -117,6 +117,8 @@ namespace nvsl {
 
   /**
    * @brief Checks the memory for errors
+   * @details Single threaded with a single pattern, see memcheck.hh for
+   * a parallel multi-pattern test that reports where the errors are
    * @param[in] vram_ptr Pointer to the begining of the region to check
    * @param bytes Bytes to scan
    * @warn This function will overwrite memory. Any existing data will be lost
@@ -144,6 +146,8 @@ namespace nvsl {
 
   /**
    * @brief Get the CPU utilization
+   * @details Blocks for 100 ms, see CpuUtilSampler in cpu_util.hh for a
+   * non-blocking alternative
    * @return CPU utilization as a float between 0 and 1
    */
   inline float get_cpu_utilization() {
@@ -1,7 +1,27 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   waitpkg.hh
+ * @date   octobre 14, 2026
+ * @brief  TPAUSE/UMWAIT wrappers and an adaptive spin-then-sleep wait
+ */
+
+#pragma once
+
 #include <immintrin.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #include <x86intrin.h>
 
-#pragma once
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+
+#include "nvsl/cpu.hh"
 
 namespace nvsl {
   enum class TpauseType {
@@ -9,14 +29,22 @@ namespace nvsl {
     LightSleep = 1, // C0.1
   };
 
-  static inline void tpause(size_t wait_cycles, TpauseType type) {
+  /** @brief Requires WAITPKG, check cpu_features().waitpkg */
+  __attribute__((target("waitpkg"))) static inline void
+  tpause(size_t wait_cycles, TpauseType type) {
     const uint64_t current_tsc = _rdtsc();
     const uint64_t final_tsc = current_tsc + wait_cycles;
 
     _tpause(static_cast<int>(type), final_tsc);
   }
 
-  static inline void wait(void *addr, size_t wait_cycles, TpauseType type) {
+  /**
+   * @brief Wait for a write to the cacheline of addr, re-arming on timeouts
+   * @details Returns on the first wakeup that is not a timeout, which can be
+   * spurious. Use wait_until() to wait for a condition. Requires WAITPKG.
+   */
+  __attribute__((target("waitpkg"))) static inline void
+  wait(void *addr, size_t wait_cycles, TpauseType type) {
     _umonitor(addr);
 
     while (true) {
@@ -28,4 +56,138 @@ namespace nvsl {
       if (!expired) break;
     };
   }
-} // namespace nvsl
\ No newline at end of file
+
+  /**
+   * @brief How long wait_until() stays in each phase
+   * @details The phases are spinning on plain loads, spinning with PAUSE,
+   * UMONITOR/UMWAIT (if the CPU has WAITPKG) and sleeping on a futex.
+   */
+  struct WaitPolicy {
+    size_t spin_iters = 64;
+    size_t pause_iters = 256;
+    uint64_t umwait_cycles = 200000; /**< ~70 us at 3 GHz, 0 to skip */
+    uint64_t umwait_slice = 10000;   /**< Cycles per UMWAIT */
+    TpauseType sleep = TpauseType::LightSleep; /**< C0.1 wakes up faster */
+    long futex_timeout_ns = 1000000; /**< Re-check interval once sleeping */
+  };
+
+  namespace detail {
+    inline long futex_wait(const void *addr, uint32_t val, long timeout_ns) {
+      timespec ts = {timeout_ns / 1000000000, timeout_ns % 1000000000};
+      return syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val,
+                     timeout_ns < 0 ? nullptr : &ts, nullptr, 0);
+    }
+
+    inline void futex_wake(const void *addr) {
+      syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr,
+              0);
+    }
+
+    /** @brief UMWAIT on addr until pred() or `cycles` elapse */
+    template <typename Pred>
+    __attribute__((target("waitpkg"))) inline bool
+    umwait_until(const void *addr, Pred &pred, const WaitPolicy &policy) {
+      const uint64_t deadline = _rdtsc() + policy.umwait_cycles;
+
+      while (true) {
+        _umonitor(const_cast<void *>(addr));
+        if (pred()) return true; /* Re-check once armed, no lost wakeups */
+
+        const uint64_t now = _rdtsc();
+        if (now >= deadline) return false;
+
+        _umwait(static_cast<int>(policy.sleep),
+                std::min(deadline, now + policy.umwait_slice));
+      }
+    }
+
+    /**
+     * @brief Run the spin, pause and umwait phases of wait_until()
+     * @return true if pred() became true, false if it is time to sleep
+     */
+    template <typename Pred>
+    inline bool wait_before_sleep(const void *addr, Pred &pred,
+                                  const WaitPolicy &policy) {
+      for (size_t i = 0; i < policy.spin_iters; i++) {
+        if (pred()) return true;
+      }
+
+      for (size_t i = 0; i < policy.pause_iters; i++) {
+        if (pred()) return true;
+        _mm_pause();
+      }
+
+      if (policy.umwait_cycles != 0 and cpu_features().waitpkg) {
+        return umwait_until(addr, pred, policy);
+      }
+
+      return pred();
+    }
+  } // namespace detail
+
+  /**
+   * @brief Wait until pred() is true, escalating from spinning to sleeping
+   * @details addr should be the word whose update makes pred() true, UMWAIT
+   * watches its cacheline. Once sleeping, pred() is re-checked every
+   * policy.futex_timeout_ns, no waker is needed. Use WaitSlot for immediate
+   * wakeups after the spinning phases.
+   */
+  template <typename Pred>
+  inline void wait_until(const std::atomic<uint32_t> *addr, Pred &&pred,
+                         const WaitPolicy &policy = {}) {
+    if (detail::wait_before_sleep(addr, pred, policy)) return;
+
+    while (not pred()) {
+      detail::futex_wait(addr, addr->load(), policy.futex_timeout_ns);
+    }
+  }
+
+  /**
+   * @brief Cacheline sized event a thread can wait on
+   * @details Publish data, then notify(). Waiters go through the phases of
+   * wait_until() and, once sleeping, are woken up by notify() right away.
+   * notify() costs an atomic add plus a syscall only if someone sleeps.
+   * @code
+   * // Producer
+   * ready.store(true);
+   * slot.notify();
+   *
+   * // Consumer
+   * slot.wait_until([&]() { return ready.load(); });
+   * @endcode
+   */
+  class alignas(64) WaitSlot {
+  private:
+    std::atomic<uint32_t> word = 0;
+    std::atomic<uint32_t> sleepers = 0;
+
+  public:
+    void notify() {
+      word.fetch_add(1, std::memory_order_seq_cst);
+      if (sleepers.load(std::memory_order_seq_cst) != 0) [[unlikely]] {
+        detail::futex_wake(&word);
+      }
+    }
+
+    template <typename Pred>
+    void wait_until(Pred &&pred, const WaitPolicy &policy = {}) {
+      if (detail::wait_before_sleep(&word, pred, policy)) return;
+
+      sleepers.fetch_add(1, std::memory_order_seq_cst);
+      while (true) {
+        const auto val = word.load(std::memory_order_seq_cst);
+        if (pred()) break;
+
+        detail::futex_wait(&word, val, policy.futex_timeout_ns);
+      }
+      sleepers.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    /** @brief Wait for the next notify() */
+    void wait(const WaitPolicy &policy = {}) {
+      const auto val = word.load(std::memory_order_acquire);
+      wait_until([&]() { return word.load(std::memory_order_acquire) != val; },
+                 policy);
+    }
+  };
+} // namespace nvsl
@@ -0,0 +1,80 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   test_arena.cc
+ * @date   octobre 14, 2026
+ * @brief  Test the arena allocator
+ */
+
+#include <memory>
+#include <memory_resource>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "nvsl/arena.hh"
+
+TEST(arena, small_and_large) {
+  nvsl::ArenaConfig cfg;
+  cfg.region_size = 4 * nvsl::MiB;
+  nvsl::Arena arena(cfg);
+
+  std::set<void *> ptrs;
+  for (size_t i = 0; i < 1000; i++) {
+    auto *ptr = arena.allocate(24);
+    ASSERT_NE(ptr, nullptr);
+    EXPECT_EQ((uintptr_t)ptr % 32, 0UL);
+    EXPECT_TRUE(arena.owns(ptr));
+    ptrs.insert(ptr);
+  }
+  EXPECT_EQ(ptrs.size(), 1000UL);
+
+  /* Freed blocks are reused by the same thread */
+  auto *first = *ptrs.begin();
+  arena.deallocate(first, 24);
+  EXPECT_EQ(arena.allocate(24), first);
+
+  auto *large = arena.allocate(3 * nvsl::Arena::MAX_SMALL_SIZE);
+  EXPECT_EQ((uintptr_t)large % nvsl::SMALL_PG_SZ, 0UL);
+  arena.deallocate(large, 3 * nvsl::Arena::MAX_SMALL_SIZE);
+  EXPECT_EQ(arena.allocate(3 * nvsl::Arena::MAX_SMALL_SIZE), large);
+
+  EXPECT_EQ(arena.reserved() % nvsl::LARGE_PG_SZ, 0UL);
+}
+
+TEST(arena, threads_and_pmr) {
+  nvsl::Arena arena;
+  nvsl::ArenaResource res(arena);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&]() {
+      std::pmr::vector<uint64_t> vec(&res);
+      for (uint64_t i = 0; i < 100000; i++) vec.push_back(i);
+      EXPECT_TRUE(arena.owns(vec.data()));
+      EXPECT_EQ(vec[99999], 99999UL);
+    });
+  }
+  for (auto &t : threads) t.join();
+
+  nvsl::ArenaResource other(arena);
+  EXPECT_TRUE(res.is_equal(other));
+}
+
+TEST(arena, reused_id) {
+  nvsl::ArenaConfig cfg;
+  cfg.region_size = 2 * nvsl::MiB;
+
+  for (int i = 0; i < 3; i++) {
+    auto arena = std::make_unique<nvsl::Arena>(cfg);
+
+    /* Leaves blocks in this thread's cache of the arena */
+    auto *ptr = arena->allocate(64);
+    ASSERT_NE(ptr, nullptr);
+    EXPECT_TRUE(arena->owns(ptr));
+
+    /* Destroyed by another thread, the next arena reuses its id */
+    std::thread([&]() { arena.reset(); }).join();
+  }
+}
@@ -0,0 +1,45 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   test_bench.cc
+ * @date   octobre 14, 2026
+ * @brief  Test the benchmark runner
+ */
+
+#include <atomic>
+
+#include "gtest/gtest.h"
+#include "nvsl/bench.hh"
+
+TEST(bench, run) {
+  nvsl::bench::Config cfg;
+  cfg.threads = 2;
+  cfg.warmup_calls = 10;
+  cfg.rep_time = std::chrono::milliseconds(5);
+  cfg.min_reps = 2;
+  cfg.max_reps = 3;
+
+  std::atomic<uint64_t> calls = 0;
+  const auto res =
+      nvsl::bench::run("noop", cfg, [&](size_t) { calls++; });
+
+  EXPECT_GE(res.reps, 2UL);
+  EXPECT_LE(res.reps, 3UL);
+  EXPECT_GT(res.ops, 0UL);
+  EXPECT_EQ(calls, res.ops + 2 * cfg.warmup_calls);
+  EXPECT_GT(res.ops_per_s, 0);
+  EXPECT_LE(res.p50, res.p99);
+  EXPECT_NE(res.json().find("\"name\": \"noop\""), std::string::npos);
+}
+
+TEST(bench, latency_sample) {
+  nvsl::bench::Config cfg;
+  cfg.warmup_calls = 0;
+  cfg.rep_time = std::chrono::milliseconds(2);
+  cfg.min_reps = cfg.max_reps = 1;
+  cfg.latency_sample = 0;
+
+  const auto res = nvsl::bench::run("untimed", cfg, [](size_t) {});
+  EXPECT_GT(res.ops, 0UL);
+  EXPECT_EQ(res.p99, 0);
+}
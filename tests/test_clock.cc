@@ -0,0 +1,128 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   test_clock.cc
+ * @date   octobre 14, 2026
+ * @brief  Test the Clock modes
+ */
+
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "nvsl/clock.hh"
+
+TEST(clock, bounded_modes) {
+  nvsl::Clock hist(nvsl::ClockMode::histogram);
+  nvsl::Clock res(nvsl::ClockMode::reservoir, 16);
+
+  for (size_t i = 0; i < 1000; i++) {
+    for (auto *clk : {&hist, &res}) {
+      clk->tick();
+      clk->tock();
+    }
+  }
+
+  EXPECT_EQ(hist.histogram().total(), 1000UL);
+  EXPECT_LE(hist.percentile(50), hist.percentile(99));
+
+  res.reconcile();
+  EXPECT_LE(res.percentile(50), res.percentile(99));
+  EXPECT_GT(res.ns_per_event(), 0UL);
+
+  EXPECT_FALSE(hist.summarize(2000, true).empty());
+}
+
+TEST(clock, tsc_source) {
+  nvsl::TscClock clk(nvsl::ClockMode::histogram);
+
+  clk.tick();
+  volatile uint64_t sink = 0;
+  for (uint64_t i = 0; i < 100000; i++) sink = sink + i;
+  clk.tock();
+
+  EXPECT_GT(clk.ns(), 0UL);
+  EXPECT_GE(clk.percentile(50), clk.ns() / 2);
+  EXPECT_LE(clk.percentile(50), clk.ns() * 2);
+}
+
+TEST(clock, percentile_and_merge) {
+  nvsl::Clock a, b(nvsl::ClockMode::reservoir, 8);
+  nvsl::Clock c(nvsl::ClockMode::reservoir, 8);
+
+  EXPECT_EQ(a.percentile(50), 0UL);
+
+  a.tick();
+  a.tock();
+  /* A single sample is every percentile */
+  EXPECT_EQ(a.percentile(1), a.percentile(99));
+
+  for (size_t i = 0; i < 100; i++) {
+    for (auto *clk : {&a, &b, &c}) {
+      clk->tick();
+      clk->tock();
+    }
+  }
+
+  const auto p90 = a.percentile(90); /* nth_element */
+  a.reconcile();
+  a.reconcile();
+  EXPECT_EQ(a.percentile(90), p90);
+
+  nvsl::Clock merged;
+  merged.merge(a);
+  merged.merge(a);
+  EXPECT_EQ(merged.ns(), 2 * a.ns());
+  EXPECT_EQ(merged.percentile(90), p90);
+
+  b.merge(c);
+  EXPECT_EQ(b.ns_per_event(), (b.ns()) / 200);
+}
+
+TEST(clock, const_percentile_is_thread_safe) {
+  nvsl::Clock clk;
+  for (size_t i = 0; i < 10000; i++) {
+    clk.tick();
+    clk.tock();
+  }
+
+  const nvsl::Clock &view = clk;
+  const auto p99 = view.percentile(99);
+
+  size_t seen[2];
+  std::thread other([&]() { seen[1] = view.percentile(99); });
+  seen[0] = view.percentile(99);
+  other.join();
+
+  EXPECT_EQ(seen[0], p99);
+  EXPECT_EQ(seen[1], p99);
+}
+
+TEST(clock, merge_mode_mismatch) {
+  nvsl::Clock raw, hist(nvsl::ClockMode::histogram);
+  EXPECT_EXIT(raw.merge(hist), testing::ExitedWithCode(1),
+              "different modes");
+}
+
+TEST(clock, percentiles) {
+  nvsl::Clock clk;
+  for (size_t i = 0; i < 1000; i++) {
+    clk.tick();
+    clk.tock();
+  }
+
+  /* One copy for all the ranks, in any order */
+  const auto pcs = clk.percentiles({99, 50, 90, 50, 100});
+  const nvsl::Clock unsorted = clk;
+  clk.reconcile();
+
+  ASSERT_EQ(pcs.size(), 5UL);
+  EXPECT_EQ(pcs[0], clk.percentile(99));
+  EXPECT_EQ(pcs[1], clk.percentile(50));
+  EXPECT_EQ(pcs[2], clk.percentile(90));
+  EXPECT_EQ(pcs[3], pcs[1]);
+  EXPECT_EQ(pcs[4], clk.percentile(100));
+  EXPECT_EQ(clk.percentiles({50, 90, 99}),
+            unsorted.percentiles({50, 90, 99}));
+  EXPECT_EQ(nvsl::Clock().percentiles({50, 99}),
+            std::vector<size_t>({0, 0}));
+}
@@ -0,0 +1,153 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   test_common.cc
+ * @date   octobre 14, 2026
+ * @brief  Test the cached logging config
+ */
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "nvsl/common.hh"
+
+static bool site_enabled(nvsl::LogSite &site, int level) {
+  return nvsl::is_log_site_enabled(site, level, "site_enabled");
+}
+
+TEST(common, log_config_reload) {
+  nvsl::LogSite site;
+
+  setenv(NVSL_LOG_LEVEL_ENV, "2", 1);
+  unsetenv(NVSL_LOG_WILDCARD_ENV);
+  nvsl::reload_log_config();
+
+  EXPECT_EQ(nvsl::log_config().level, 2);
+  EXPECT_TRUE(site_enabled(site, 2));
+
+  /* Cached until the config is reloaded */
+  setenv(NVSL_LOG_LEVEL_ENV, "0", 1);
+  EXPECT_TRUE(site_enabled(site, 2));
+
+  nvsl::reload_log_config();
+  EXPECT_FALSE(site_enabled(site, 2));
+
+  setenv(NVSL_LOG_LEVEL_ENV, "4", 1);
+  setenv(NVSL_LOG_WILDCARD_ENV, "other*", 1);
+  nvsl::reload_log_config();
+  EXPECT_FALSE(site_enabled(site, 1));
+  EXPECT_TRUE(nvsl::is_caller_enabled("other_fn"));
+
+  unsetenv(NVSL_LOG_LEVEL_ENV);
+  unsetenv(NVSL_LOG_WILDCARD_ENV);
+  nvsl::reload_log_config();
+}
+
+/* Logs while being formatted into another record */
+struct NestedLog {};
+static std::ostream &operator<<(std::ostream &os, const NestedLog &) {
+  DBGH(1) << "inner record" << std::endl;
+  return os << "value";
+}
+
+TEST(common, async_log) {
+  const std::string path =
+      "/tmp/nvsl-test-async-log." + std::to_string(getpid());
+  unlink(path.c_str());
+
+  setenv(NVSL_LOG_LEVEL_ENV, "1", 1);
+  nvsl::reload_log_config();
+
+  nvsl::AsyncLogConfig cfg;
+  cfg.path = path;
+  cfg.ring_bytes = 256;
+  ASSERT_TRUE(nvsl::start_async_log(cfg));
+
+  std::thread other([]() { DBGH(1) << "from thread " << 2 << std::endl; });
+  other.join();
+
+  DBGH(1) << "hello " << 42 << std::endl;
+  DBGH(2) << "not logged" << std::endl;
+  DBGH(1) << "outer " << NestedLog{} << " done" << std::endl;
+  {
+    std::string caller = "temp_caller";
+    DBGH record(1, caller.c_str());
+    record << "short lived caller" << std::endl;
+  }
+  nvsl::flush_log();
+
+  DBGH(1) << std::string(1024, 'x') << std::endl; /* Doesn't fit the ring */
+  nvsl::flush_log();
+  nvsl::stop_async_log();
+
+  unsetenv(NVSL_LOG_LEVEL_ENV);
+  nvsl::reload_log_config();
+
+  std::ifstream in(path);
+  std::stringstream ss;
+  ss << in.rdbuf();
+  const auto log = ss.str();
+  unlink(path.c_str());
+
+  EXPECT_NE(log.find("hello 42\n"), std::string::npos);
+  EXPECT_NE(log.find("from thread 2\n"), std::string::npos);
+  EXPECT_NE(log.find("]:1 inner record\n"), std::string::npos);
+  EXPECT_NE(log.find("]:1 outer value done\n"), std::string::npos);
+  EXPECT_NE(log.find("[temp_caller()]:1 short lived caller\n"),
+            std::string::npos);
+  EXPECT_NE(log.find("dropped 1 log records"), std::string::npos);
+  EXPECT_EQ(log.find("not logged"), std::string::npos);
+}
+
+TEST(common, max_log_level) {
+  int evaluated = 0;
+  const auto arg = [&]() { return ++evaluated; };
+
+  setenv(NVSL_LOG_LEVEL_ENV, "4", 1);
+  nvsl::reload_log_config();
+
+  /* Above NVSL_MAX_LOG_LEVEL, the arguments are never evaluated */
+  DBGH(NVSL_MAX_LOG_LEVEL + 1) << arg() << std::endl;
+  NVSL_LOG(NVSL_MAX_LOG_LEVEL + 1, arg(), "\n");
+  EXPECT_EQ(evaluated, 0);
+
+  NVSL_LOG(1, "max_log_level ", arg(), "\n");
+  EXPECT_EQ(evaluated, 1);
+
+  /* Nor for call sites disabled by NVSL_LOG_LEVEL */
+  setenv(NVSL_LOG_LEVEL_ENV, "0", 1);
+  nvsl::reload_log_config();
+
+  DBGH(1) << arg() << std::endl;
+  NVSL_LOG(1, arg(), "\n");
+  EXPECT_EQ(evaluated, 1);
+
+  unsetenv(NVSL_LOG_LEVEL_ENV);
+  nvsl::reload_log_config();
+}
+
+TEST(common, reload_while_logging) {
+  std::atomic<bool> done = false;
+
+  /* Readers never take the reload lock and always see a whole config */
+  std::thread reader([&]() {
+    while (not done.load()) {
+      EXPECT_LE(nvsl::log_config().level, 4);
+      (void)nvsl::is_caller_enabled("reload_while_logging");
+    }
+  });
+
+  for (int i = 0; i < 100; i++) {
+    setenv(NVSL_LOG_WILDCARD_ENV, i % 2 ? "reload*" : "other*", 1);
+    nvsl::reload_log_config();
+  }
+  done = true;
+  reader.join();
+
+  EXPECT_TRUE(nvsl::is_caller_enabled("reload_while_logging"));
+  unsetenv(NVSL_LOG_WILDCARD_ENV);
+  nvsl::reload_log_config();
+}
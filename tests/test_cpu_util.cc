@@ -0,0 +1,51 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   test_cpu_util.cc
+ * @date   octobre 14, 2026
+ * @brief  Test the background CPU utilization sampler
+ */
+
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <set>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "nvsl/cpu_util.hh"
+
+TEST(cpu_util, sampler) {
+  nvsl::CpuUtilConfig cfg;
+  cfg.interval = std::chrono::milliseconds(5);
+  nvsl::CpuUtilSampler sampler(cfg);
+
+  EXPECT_GE(sampler.cpu_count(), 1UL);
+  EXPECT_EQ(sampler.utilization(sampler.cpu_count()), -1);
+
+  /* Spin so the counters (in 10 ms ticks) move */
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(2);
+  while (sampler.utilization() < 0 and
+         std::chrono::steady_clock::now() < deadline) {
+  }
+
+  EXPECT_GE(sampler.utilization(), 0);
+  EXPECT_LE(sampler.utilization(), 1);
+
+  /* Configured CPUs missing from /proc/stat are offline */
+  std::set<size_t> listed;
+  std::ifstream proc_stat("/proc/stat");
+  std::string line;
+  while (std::getline(proc_stat, line) and line.rfind("cpu", 0) == 0) {
+    if (line.size() > 3 and std::isdigit(line[3])) {
+      listed.insert(std::stoul(line.substr(3)));
+    }
+  }
+
+  for (size_t cpu = 0; cpu < sampler.cpu_count(); cpu++) {
+    if (listed.count(cpu) == 0) {
+      EXPECT_EQ(sampler.utilization(cpu), -1);
+    }
+  }
+}
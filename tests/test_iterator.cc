@@ -0,0 +1,61 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   test_iterator.cc
+ * @date   octobre 14, 2026
+ * @brief  Test range(), step() and indices()
+ */
+
+#include <algorithm>
+#include <iterator>
+#include <numeric>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "nvsl/iterator.hh"
+
+TEST(iterator, random_access) {
+  const auto r = nvsl::range(2, 12);
+  using It = decltype(r.begin());
+  static_assert(std::is_same_v<std::iterator_traits<It>::iterator_category,
+                               std::random_access_iterator_tag>);
+
+  EXPECT_EQ(r.size(), 10UL);
+  EXPECT_EQ(r[3], 5);
+  EXPECT_EQ(r.end() - r.begin(), 10);
+  EXPECT_EQ(r.begin()[4], 6);
+  EXPECT_EQ(std::accumulate(r.begin(), r.end(), 0), 65);
+  EXPECT_TRUE(std::binary_search(r.begin(), r.end(), 7));
+
+  EXPECT_EQ(nvsl::range(5, 2).size(), 0UL);
+  EXPECT_EQ(nvsl::range(5, 2).begin(), nvsl::range(5, 2).end());
+}
+
+TEST(iterator, step) {
+  std::vector<int> vals;
+  for (const auto i : nvsl::range(10, 0).step(-3)) vals.push_back(i);
+  EXPECT_EQ(vals, std::vector<int>({10, 7, 4, 1}));
+
+  const auto s = nvsl::range(0, 10).step(3);
+  EXPECT_EQ(s.size(), 4UL);
+  EXPECT_EQ(s[3], 9);
+  EXPECT_EQ(s.end() - s.begin(), 4);
+
+  /* No accumulated error over 10 steps of 0.1 */
+  EXPECT_EQ(nvsl::range(0.0, 1.0).step(0.1).size(), 10UL);
+}
+
+TEST(iterator, chunks) {
+  const std::vector<int> vec(10);
+  const auto chunks = nvsl::indices(vec).chunks(4);
+
+  ASSERT_EQ(chunks.size(), 3UL);
+  EXPECT_EQ(chunks[0][0], 0UL);
+  EXPECT_EQ(chunks[1][0], 4UL);
+  EXPECT_EQ(chunks[2].size(), 2UL);
+
+  const auto step_chunks = nvsl::range(0, 10).step(2).chunks(2);
+  ASSERT_EQ(step_chunks.size(), 3UL);
+  EXPECT_EQ(step_chunks[2][0], 8);
+  EXPECT_EQ(step_chunks[2].size(), 1UL);
+}
@@ -0,0 +1,83 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   test_memcheck.cc
+ * @date   octobre 14, 2026
+ * @brief  Test the multi-pattern memory checker
+ */
+
+#include <cstring>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "nvsl/memcheck.hh"
+
+namespace {
+  /** Flips a bit of one word whenever it gets written */
+  class FaultyPMemOps : public nvsl::PMemOpsNoPersist {
+  public:
+    uint64_t *bad;
+
+    void streaming_wr(void *dest, const void *src,
+                      size_t bytes) const override {
+      std::memcpy(dest, src, bytes);
+
+      const auto start = (uint64_t *)dest;
+      if (bad >= start and bad < start + bytes / sizeof(uint64_t)) *bad ^= 4;
+    }
+  };
+} // namespace
+
+TEST(memcheck, clean) {
+  std::vector<uint64_t> mem(300 * 1024 + 3);
+
+  nvsl::MemcheckConfig cfg;
+  cfg.region_bytes = 1 << 20;
+  cfg.threads = 3;
+  const auto res = nvsl::memcheck(mem.data(), mem.size() * 8 + 5, cfg);
+
+  EXPECT_TRUE(res.ok());
+  EXPECT_EQ(res.bytes, mem.size() * 8);
+  EXPECT_EQ(res.regions.size(), 3UL);
+  ASSERT_EQ(res.phases.size(), cfg.patterns.size());
+  EXPECT_GT(res.phases[0].write_gbps(), 0);
+  EXPECT_EQ(mem[4], 0xAAAAAAAAAAAAAAAAUL); /* Inverse checkerboard */
+}
+
+TEST(memcheck, error_map) {
+  std::vector<uint64_t> mem(256 * 1024);
+  FaultyPMemOps pmem;
+  pmem.bad = &mem[200 * 1024 + 7];
+
+  nvsl::MemcheckConfig cfg;
+  cfg.region_bytes = 512 * 1024;
+  cfg.threads = 2;
+  cfg.pmemops = &pmem;
+  const auto res = nvsl::memcheck(mem.data(), mem.size() * 8, cfg);
+
+  /* Every pattern catches the flipped bit, in the fourth region */
+  EXPECT_EQ(res.errors(), cfg.patterns.size());
+  EXPECT_EQ(res.regions[3].errors, cfg.patterns.size());
+  ASSERT_FALSE(res.regions[3].samples.empty());
+
+  const auto &err = res.regions[3].samples[0];
+  EXPECT_EQ(err.offset, (200 * 1024 + 7) * 8UL);
+  EXPECT_EQ(err.expected ^ err.actual, 4UL);
+  EXPECT_EQ(err.pattern, nvsl::MemcheckPattern::walking_ones);
+}
+
+TEST(memcheck, compare_kernels) {
+  std::vector<uint64_t> a(64, 7), b(64, 7);
+  b[37] = 8;
+
+  const auto &feat = nvsl::cpu_features();
+  EXPECT_EQ(nvsl::detail::memcheck_cmp_sse2(a.data(), b.data(), 512), 288UL);
+  if (feat.avx2) {
+    EXPECT_EQ(nvsl::detail::memcheck_cmp_avx2(a.data(), b.data(), 512),
+              288UL);
+  }
+  if (feat.avx512f) {
+    EXPECT_EQ(nvsl::detail::memcheck_cmp_avx512(a.data(), b.data(), 512),
+              256UL);
+  }
+}
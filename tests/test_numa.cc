@@ -0,0 +1,67 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   test_numa.cc
+ * @date   octobre 14, 2026
+ * @brief  Test the NUMA placement helpers
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+
+#include "gtest/gtest.h"
+#include "nvsl/numa.hh"
+
+TEST(numa, histogram_and_move) {
+  if (numa_available() < 0) GTEST_SKIP() << "libnuma not available";
+
+  const size_t size = 64 * nvsl::SMALL_PG_SZ;
+  auto *buf = (char *)mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  ASSERT_NE(buf, MAP_FAILED);
+  memset(buf, 1, size / 2); /* Second half is not faulted in */
+
+  nvsl::NumaMoveConfig cfg;
+  cfg.batch_pages = 8;
+  cfg.nthreads = 2;
+  cfg.page_size = nvsl::SMALL_PG_SZ;
+
+  const auto hist = nvsl::region_node_histogram(buf, size, cfg);
+  EXPECT_EQ(hist.total(), 64UL);
+  EXPECT_EQ(hist.unmapped, 32UL);
+  EXPECT_EQ(hist.failed, 0UL);
+
+  const int node = hist.nodes.begin()->first;
+  cfg.verify = true;
+  const auto res = nvsl::move_region(buf, size / 2, node, cfg);
+  EXPECT_EQ(res.pages, 32UL);
+  EXPECT_TRUE(res.ok());
+  EXPECT_EQ(res.placement.on(node), 32UL);
+  EXPECT_TRUE(nvsl::verify_placement(buf, size / 2, node));
+
+  munmap(buf, size);
+}
+
+TEST(numa, region_pages) {
+  using nvsl::LARGE_PG_SZ;
+  using nvsl::SMALL_PG_SZ;
+
+  /* 4 KiB pages up to the first 2 MiB boundary, 2 huge pages, 3 KiB tail */
+  auto *base = (uint8_t *)(64 * LARGE_PG_SZ);
+  auto *start = base - 3 * SMALL_PG_SZ + 100;
+  const size_t size = (base + 2 * LARGE_PG_SZ + 3 * nvsl::KiB) - start;
+
+  const auto pages = nvsl::detail::region_pages(start, size, LARGE_PG_SZ);
+  ASSERT_EQ(pages.size(), 6UL);
+  EXPECT_EQ(pages[0], base - 3 * SMALL_PG_SZ);
+  EXPECT_EQ(pages[2], base - SMALL_PG_SZ);
+  EXPECT_EQ(pages[3], base);
+  EXPECT_EQ(pages[4], base + LARGE_PG_SZ);
+  EXPECT_EQ(pages[5], base + 2 * LARGE_PG_SZ);
+
+  const auto small = nvsl::detail::region_pages(start, size, SMALL_PG_SZ);
+  EXPECT_EQ(small.size(), 3 + 2 * LARGE_PG_SZ / SMALL_PG_SZ + 1);
+  EXPECT_EQ(small[3], base);
+  EXPECT_EQ(small[small.size() - 1], base + 2 * LARGE_PG_SZ);
+}
@@ -0,0 +1,40 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   test_parallel.cc
+ * @date   octobre 14, 2026
+ * @brief  Test the thread pool and parallel_for()
+ */
+
+#include <atomic>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "nvsl/parallel.hh"
+
+TEST(parallel, parallel_for) {
+  nvsl::ThreadPoolConfig cfg;
+  cfg.threads = 4;
+  cfg.pin = false;
+  nvsl::ThreadPool pool(cfg);
+  EXPECT_EQ(pool.size(), 4UL);
+
+  std::vector<std::atomic<int>> hits(10007);
+  nvsl::parallel_for(
+      nvsl::indices(hits), [&](size_t i) { hits[i]++; }, 16, pool);
+
+  bool once = true;
+  for (const auto &hit : hits) once = once and hit == 1;
+  EXPECT_TRUE(once);
+
+  /* Nested calls run serially instead of deadlocking */
+  std::atomic<long> sum = 0;
+  nvsl::parallel_for(
+      nvsl::range(0, 8),
+      [&](int i) {
+        nvsl::parallel_for(
+            nvsl::range(0, 10), [&](int j) { sum += i * 10 + j; }, 1, pool);
+      },
+      1, pool);
+  EXPECT_EQ(sum, 79 * 80 / 2);
+}
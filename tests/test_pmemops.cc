@@ -6,11 +6,19 @@
  * @brief  Test pmemops functions
  */
 
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "nvsl/pmemops.hh"
+#include "nvsl/pmemops_instrumented.hh"
+#include "nvsl/pmemops_parallel.hh"
 
 void do_check(nvsl::PMemOps *pmemops) {
   char src[1024], dst[1024];
@@ -38,6 +46,19 @@ TEST(pmemops, clwb_if_available) {
   do_check(pmemops);
 }
 
+TEST(pmemops, nt_threshold_env) {
+  if (not nvsl::cpu_features().clwb) GTEST_SKIP() << "No clwb";
+
+  setenv(NVSL_NT_THRESHOLD_ENV, "8192", 1);
+  EXPECT_EQ(nvsl::PMemOpsClwb().get_nt_threshold(), 8192UL);
+
+  setenv(NVSL_NT_THRESHOLD_ENV, "4k", 1);
+  EXPECT_EXIT(nvsl::PMemOpsClwb(), testing::ExitedWithCode(1),
+              "Unable to parse NVSL_NT_THRESHOLD");
+
+  unsetenv(NVSL_NT_THRESHOLD_ENV);
+}
+
 TEST(pmemops, clflushopt_if_available) {
   nvsl::PMemOps *pmemops_clflushopt
 #ifdef CLFLUSHOPT_AVAIL
@@ -55,3 +76,295 @@ TEST(pmemops, msync) {
 
   do_check(pmemops_np);
 }
+
+TEST(pmemops, best) {
+  nvsl::PMemOps *pmemops = nvsl::PMemOps::best();
+
+  EXPECT_EQ(pmemops, nvsl::PMemOps::best());
+  do_check(pmemops);
+}
+
+TEST(pmemops, streaming_wr) {
+  if (not nvsl::cpu_features().clwb) GTEST_SKIP() << "CLWB unavailable";
+
+  nvsl::PMemOpsClwb pmemops;
+  alignas(64) char src[1024], dst[1024 + 64];
+
+  for (size_t i = 0; i < sizeof(src); i++) {
+    src[i] = (char)(i + 1);
+  }
+
+  for (size_t off : {0, 1, 4, 17}) {
+    for (size_t sz = 1; sz <= sizeof(src); sz++) {
+      memset(dst, 0, sizeof(dst));
+      pmemops.streaming_wr(dst + off, src, sz);
+      pmemops.drain();
+
+      ASSERT_EQ(0, memcmp(src, dst + off, sz)) << "size " << sz;
+      ASSERT_EQ(0, dst[off + sz]) << "size " << sz;
+    }
+  }
+}
+
+TEST(pmemops, nt_memcpy_memset) {
+  if (not nvsl::cpu_features().clwb) GTEST_SKIP() << "CLWB unavailable";
+
+  nvsl::PMemOpsClwb pmemops;
+  pmemops.set_nt_threshold(0);
+
+  constexpr size_t SZ = 8192;
+  auto src = std::make_unique<char[]>(SZ);
+  auto dst = std::make_unique<char[]>(SZ + 64);
+
+  for (size_t i = 0; i < SZ; i++) {
+    src[i] = (char)(i * 7);
+  }
+
+  for (size_t off : {0, 3, 60}) {
+    for (size_t sz : {1, 63, 64, 65, 1000, 4096, 8191}) {
+      memset(dst.get(), 0, SZ + 64);
+
+      pmemops.memcpy(dst.get() + off, src.get(), sz);
+      ASSERT_EQ(0, memcmp(src.get(), dst.get() + off, sz)) << "size " << sz;
+      ASSERT_EQ(0, dst[off + sz]);
+
+      pmemops.memset(dst.get() + off, 'x', sz);
+      for (size_t i = 0; i < sz; i++) {
+        ASSERT_EQ('x', dst[off + i]) << "size " << sz << " idx " << i;
+      }
+      ASSERT_EQ(0, dst[off + sz]);
+    }
+  }
+}
+
+/** @brief Records flushes and drains instead of persisting */
+class PMemOpsRecorder : public nvsl::PMemOpsNoPersist {
+public:
+  mutable std::vector<std::pair<uintptr_t, size_t>> flushes;
+  mutable size_t drains = 0;
+
+  void flush(void *base, size_t size) const override {
+    flushes.emplace_back((uintptr_t)base, size);
+  }
+  void drain() const override { drains++; }
+};
+
+TEST(pmemops, persist_batch) {
+  PMemOpsRecorder recorder;
+  nvsl::PersistBatch batch(&recorder);
+
+  alignas(64) char buf[1024];
+
+  batch.add(buf + 256, 8);
+  batch.add(buf, 8);
+  batch.add(buf + 8, 100); /* Overlaps first line, extends to second */
+  batch.add(buf + 128, 64); /* Adjacent to second line */
+  batch.add(buf + 260, 4);
+
+  EXPECT_EQ(5UL, batch.size());
+
+  const auto stats = batch.commit();
+
+  EXPECT_TRUE(batch.empty());
+  EXPECT_EQ(1UL, recorder.drains);
+  ASSERT_EQ(2UL, recorder.flushes.size());
+  EXPECT_EQ((uintptr_t)buf, recorder.flushes[0].first);
+  EXPECT_EQ(192UL, recorder.flushes[0].second);
+  EXPECT_EQ((uintptr_t)(buf + 256), recorder.flushes[1].first);
+  EXPECT_EQ(64UL, recorder.flushes[1].second);
+
+  EXPECT_EQ(5UL, stats.ranges_added);
+  EXPECT_EQ(3UL, stats.ranges_merged);
+  EXPECT_EQ(4UL, stats.lines_flushed);
+  EXPECT_EQ(2UL, stats.lines_deduped);
+}
+
+static_assert(nvsl::pmem::LinePolicy<nvsl::pmem::Clwb>);
+static_assert(nvsl::pmem::LinePolicy<nvsl::pmem::ClflushOpt>);
+static_assert(nvsl::pmem::PMemOpsPolicy<nvsl::pmem::Msync>);
+static_assert(not nvsl::pmem::LinePolicy<nvsl::pmem::NoPersist>);
+
+TEST(pmemops, static_policy) {
+  if (not nvsl::cpu_features().clwb) GTEST_SKIP() << "CLWB unavailable";
+
+  using pm = nvsl::pmem::ops<nvsl::pmem::Clwb>;
+
+  char src[1024], dst[1024];
+  pm::memset(src, 'p', sizeof(src));
+  pm::memcpy(dst, src, sizeof(src));
+  EXPECT_EQ(0, memcmp(src, dst, sizeof(src)));
+
+  uint64_t val = 42;
+  pm::persist(&val);
+  pm::streaming_wr(dst, &val, sizeof(val));
+  pm::drain();
+  EXPECT_EQ(0, memcmp(dst, &val, sizeof(val)));
+}
+
+TEST(pmemops, parallel) {
+  const nvsl::PMemOps *pmemops = nvsl::PMemOps::best();
+
+  constexpr size_t SZ = 8 * nvsl::MiB + 123;
+  auto src = std::make_unique<char[]>(SZ);
+  auto dst = std::make_unique<char[]>(SZ);
+
+  nvsl::memset_parallel(pmemops, src.get(), 's', SZ, 4);
+  nvsl::memcpy_parallel(pmemops, dst.get(), src.get(), SZ, 4);
+  nvsl::persist_parallel(pmemops, dst.get(), SZ, 4);
+
+  EXPECT_EQ('s', dst[0]);
+  EXPECT_EQ('s', dst[SZ - 1]);
+  EXPECT_EQ(0, memcmp(src.get(), dst.get(), SZ));
+}
+
+TEST(pmemops, parallel_chunks_aligned) {
+  constexpr size_t SZ = 8 * nvsl::MiB;
+  auto buf = std::make_unique<char[]>(SZ + nvsl::SMALL_PG_SZ);
+  auto *base = (char *)nvsl::align_4kb(buf.get()) + 100;
+
+  std::mutex lock;
+  std::vector<std::pair<size_t, size_t>> chunks;
+  nvsl::detail::parallel_chunks(base, SZ - 200, 4, [&](size_t off, size_t len) {
+    std::lock_guard<std::mutex> guard(lock);
+    chunks.emplace_back(off, len);
+  });
+  std::sort(chunks.begin(), chunks.end());
+
+  ASSERT_EQ(chunks.size(), 4UL);
+  size_t expected = 0;
+  for (const auto &[off, len] : chunks) {
+    EXPECT_EQ(off, expected);
+    if (off != 0) {
+      EXPECT_EQ((uintptr_t)(base + off) % nvsl::SMALL_PG_SZ, 0UL);
+    }
+    expected = off + len;
+  }
+  EXPECT_EQ(expected, SZ - 200);
+}
+
+TEST(pmemops, msync_file) {
+  constexpr size_t SZ = 64 * 4096;
+
+  FILE *tmp = tmpfile();
+  ASSERT_NE(nullptr, tmp);
+  const int fd = fileno(tmp);
+  ASSERT_EQ(0, ftruncate(fd, SZ));
+
+  auto *map = (char *)mmap(nullptr, SZ, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                           0);
+  ASSERT_NE(MAP_FAILED, (void *)map);
+
+  nvsl::PMemOpsMsync pmemops;
+  char src[3 * 4096];
+  memset(src, 'm', sizeof(src));
+
+  /* Unaligned and overlapping ranges, coalesced at drain */
+  pmemops.memset(map + 10, 'a', 100);
+  memcpy(map + 5000, src, 3000);
+  memcpy(map + 7000, src, 3000);
+  pmemops.flush(map + 5000, 3000);
+  pmemops.flush(map + 7000, 3000);
+  pmemops.streaming_wr(map + 20001, src, sizeof(src));
+  pmemops.drain();
+
+  char file_buf[SZ];
+  ASSERT_EQ((ssize_t)SZ, pread(fd, file_buf, SZ, 0));
+  EXPECT_EQ(0, memcmp(map, file_buf, SZ));
+  EXPECT_EQ('a', file_buf[109]);
+  EXPECT_EQ('m', file_buf[9999]);
+  EXPECT_EQ('m', file_buf[20001 + sizeof(src) - 1]);
+
+  munmap(map, SZ);
+  fclose(tmp);
+}
+
+TEST(pmemops, streaming_wr_all_backends) {
+  std::vector<nvsl::PMemOps *> backends = {new nvsl::PMemOpsMsync(),
+                                           new nvsl::PMemOpsNoPersist()};
+  if (nvsl::cpu_features().clflushopt) {
+    backends.push_back(new nvsl::PMemOpsClflushOpt());
+  }
+  if (nvsl::cpu_features().clflush) {
+    backends.push_back(new nvsl::PMemOpsClflush());
+  }
+
+  char src[777], dst[777 + 3];
+  for (size_t i = 0; i < sizeof(src); i++) {
+    src[i] = (char)(i ^ 0x5A);
+  }
+
+  for (auto *pmemops : backends) {
+    memset(dst, 0, sizeof(dst));
+    pmemops->streaming_wr(dst + 3, src, sizeof(src));
+    pmemops->drain();
+
+    EXPECT_EQ(0, memcmp(src, dst + 3, sizeof(src)));
+    delete pmemops;
+  }
+}
+
+static const nvsl::PMemOpsInstrumented &instrumented_site(
+    const nvsl::PMemOpsInstrumented &pmemops) {
+  static const auto &site = pmemops.at();
+  return site;
+}
+
+TEST(pmemops, instrumented) {
+  nvsl::PMemOpsNoPersist backend;
+  nvsl::PMemOpsInstrumented pmemops(&backend, "test_pm");
+
+  alignas(64) char buf[256], src[256] = {};
+
+  pmemops.persist(buf, 8);       /* 1 line */
+  pmemops.flush(buf + 60, 8);    /* Straddles 2 lines */
+  pmemops.streaming_wr(buf, src, sizeof(src));
+  pmemops.drain();
+  pmemops.memset(buf, 0, 100);   /* NoPersist neither flushes nor drains */
+
+  EXPECT_EQ(3UL, pmemops.flushed_lines());
+  EXPECT_EQ(2UL, pmemops.fence_count());
+  EXPECT_EQ(sizeof(src), pmemops.nt_bytes_written());
+  EXPECT_EQ(100UL, pmemops.bytes_copied());
+
+  const auto &site = instrumented_site(pmemops);
+  site.persist(buf, 128);
+
+  EXPECT_EQ(&site, &pmemops.at("instrumented_site"));
+  EXPECT_EQ(2UL, site.flushed_lines());
+  EXPECT_EQ(3UL, pmemops.flushed_lines());
+}
+
+TEST(pmemops, instrumented_memcpy) {
+  if (not nvsl::cpu_features().clwb) GTEST_SKIP() << "No clwb";
+
+  nvsl::PMemOpsClwb backend;
+  backend.set_nt_threshold(4 * nvsl::KiB);
+  nvsl::PMemOpsInstrumented pmemops(&backend, "test_pm_memcpy");
+
+  constexpr size_t SZ = 64 * nvsl::KiB;
+  auto *dst = (char *)aligned_alloc(64, SZ);
+  auto *src = (char *)aligned_alloc(64, SZ);
+  memset(src, 0x5A, SZ);
+
+  /* Below the threshold: cached copy, one line flushed */
+  pmemops.memcpy(dst, src, 64);
+  EXPECT_EQ(1UL, pmemops.flushed_lines());
+  EXPECT_EQ(0UL, pmemops.nt_bytes_written());
+  EXPECT_EQ(1UL, pmemops.fence_count());
+
+  /* Above the threshold: every line is streamed, nothing is flushed */
+  pmemops.memcpy(dst, src, SZ);
+  EXPECT_EQ(1UL, pmemops.flushed_lines());
+  EXPECT_EQ(SZ, pmemops.nt_bytes_written());
+  EXPECT_EQ(2UL, pmemops.fence_count());
+  EXPECT_EQ(SZ + 64, pmemops.bytes_copied());
+  EXPECT_EQ(0, memcmp(dst, src, SZ));
+
+  /* Unaligned NT copy: the partial head and tail lines are flushed */
+  pmemops.memcpy(dst + 8, src, SZ - 64);
+  EXPECT_EQ(3UL, pmemops.flushed_lines());
+  EXPECT_EQ(2 * SZ - 64 * 2, pmemops.nt_bytes_written());
+
+  free(dst);
+  free(src);
+}
@@ -0,0 +1,60 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   test_scope_timer.cc
+ * @date   octobre 14, 2026
+ * @brief  Test the sampled scope timers
+ */
+
+#include <cstdlib>
+
+#include "gtest/gtest.h"
+#include "nvsl/scope_timer.hh"
+
+NVSL_DECL_ENV(TEST_SCOPE_SAMPLE);
+
+static nvsl::StatsScopeTimer *find_site(const std::string &name) {
+  std::lock_guard<std::mutex> guard(nvsl::StatsCollection::stats_lock);
+  for (auto *stat : *nvsl::StatsCollection::stats) {
+    if (stat->name() == name) {
+      return dynamic_cast<nvsl::StatsScopeTimer *>(stat);
+    }
+  }
+  return nullptr;
+}
+
+static void timed() { NVSL_TIME_SCOPE("test.scope_timer.every"); }
+
+static void defaulted() { NVSL_TIME_SCOPE("test.scope_timer.default"); }
+
+static void sampled() {
+  NVSL_TIME_SCOPE_ENV("test.scope_timer.sampled", TEST_SCOPE_SAMPLE_ENV);
+}
+
+TEST(scope_timer, sampling) {
+  EXPECT_EQ(find_site("test.scope_timer.every"), nullptr);
+
+  setenv(NVSL_TIME_SCOPE_SAMPLE_ENV, "1", 1);
+  for (int i = 0; i < 10; i++) timed();
+  unsetenv(NVSL_TIME_SCOPE_SAMPLE_ENV);
+
+  for (int i = 0; i < 130; i++) defaulted();
+
+  setenv(TEST_SCOPE_SAMPLE_ENV, "4", 1);
+  for (int i = 0; i < 10; i++) sampled();
+  unsetenv(TEST_SCOPE_SAMPLE_ENV);
+
+  const auto *every = find_site("test.scope_timer.every");
+  const auto *dflt = find_site("test.scope_timer.default");
+  const auto *some = find_site("test.scope_timer.sampled");
+  ASSERT_NE(every, nullptr);
+  ASSERT_NE(dflt, nullptr);
+  ASSERT_NE(some, nullptr);
+
+  EXPECT_EQ(every->period(), 1U);
+  EXPECT_EQ(every->sampled(), 10UL);
+  EXPECT_EQ(dflt->period(), nvsl::DEFAULT_SCOPE_SAMPLE_PERIOD);
+  EXPECT_EQ(dflt->sampled(), 3UL); /* Calls 1, 65 and 129 */
+  EXPECT_EQ(some->period(), 4U);
+  EXPECT_EQ(some->sampled(), 3UL); /* Calls 1, 5 and 9 */
+}
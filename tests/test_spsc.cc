@@ -0,0 +1,73 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   test_spsc.cc
+ * @date   octobre 14, 2026
+ * @brief  Test the SPSC ring
+ */
+
+#include <chrono>
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "nvsl/spsc.hh"
+
+TEST(spsc, try_push_pop) {
+  nvsl::SpscRing<int> ring(3);
+  EXPECT_EQ(ring.capacity(), 4UL);
+
+  for (int i = 0; i < 4; i++) EXPECT_TRUE(ring.try_push(i));
+  EXPECT_FALSE(ring.try_push(4));
+  EXPECT_EQ(ring.size(), 4UL);
+
+  int val;
+  for (int i = 0; i < 4; i++) {
+    EXPECT_TRUE(ring.try_pop(val));
+    EXPECT_EQ(val, i);
+  }
+  EXPECT_FALSE(ring.try_pop(val));
+}
+
+TEST(spsc, blocking) {
+  constexpr uint64_t count = 100000;
+  nvsl::SpscRing<uint64_t> ring(16);
+
+  std::thread producer([&]() {
+    for (uint64_t i = 0; i < count; i++) ring.push(i);
+  });
+
+  uint64_t sum = 0;
+  bool ordered = true;
+  for (uint64_t i = 0; i < count; i++) {
+    const auto val = ring.pop();
+    ordered = ordered and val == i;
+    sum += val;
+  }
+  producer.join();
+
+  EXPECT_TRUE(ordered);
+  EXPECT_EQ(sum, count * (count - 1) / 2);
+}
+
+TEST(spsc, sleep_wakeup) {
+  /* Go straight to the futex on both sides, a missed wakeup costs 10 s */
+  nvsl::WaitPolicy policy;
+  policy.spin_iters = policy.pause_iters = policy.umwait_cycles = 0;
+  policy.futex_timeout_ns = 10000000000;
+
+  constexpr uint64_t count = 20000;
+  nvsl::SpscRing<uint64_t> ring(1, policy);
+
+  const auto start = std::chrono::steady_clock::now();
+  std::thread producer([&]() {
+    for (uint64_t i = 0; i < count; i++) ring.push(i);
+  });
+
+  uint64_t sum = 0;
+  for (uint64_t i = 0; i < count; i++) sum += ring.pop();
+  producer.join();
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+
+  EXPECT_EQ(sum, count * (count - 1) / 2);
+  EXPECT_LT(elapsed, std::chrono::seconds(5));
+}
@@ -6,12 +6,21 @@
  * @brief  Test stats functions
  */
 
+#include <chrono>
 #include <cstdlib>
+#include <fcntl.h>
 #include <iostream>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "nvsl/stats.hh"
 
+std::vector<nvsl::StatsBase *> *nvsl::StatsCollection::stats =
+    new std::vector<nvsl::StatsBase *>();
+
 TEST(stats, scalar) {
   nvsl::StatsScalar testStat;
 
@@ -19,3 +28,356 @@ TEST(stats, scalar) {
 
   EXPECT_EQ(testStat.avg(), 100);
 }
+
+TEST(stats, freq_sharded) {
+  /* One private shard, the other threads share the overflow shard */
+  for (const size_t shards : {0UL, 1UL}) {
+    nvsl::StatsFreq<size_t> freq(false);
+    freq.init("freq", "Test freq", 10, 0, 100, shards);
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 4; t++) {
+      threads.emplace_back([&freq, t]() {
+        for (size_t i = 0; i < 10000; i++) {
+          freq.add(t * 10 + 5);
+        }
+        freq.add(1000, 2); /* Overflow */
+      });
+    }
+    for (auto &t : threads) t.join();
+
+    EXPECT_EQ(4 * 10002UL, freq.total());
+    EXPECT_EQ(8UL, freq.uoflow_count(false, true));
+    for (size_t b = 0; b < 4; b++) {
+      EXPECT_EQ(10000UL, freq.bucket_count(b));
+    }
+    EXPECT_EQ(0UL, freq.bucket_count(9));
+  }
+}
+
+TEST(stats, histogram_log_linear) {
+  nvsl::LogLinearBuckets buckets(100000000, 5);
+
+  /* Every value maps to a bucket that holds it, within 1/16 relative error */
+  for (uint64_t val = 0; val < 100000000; val = val * 5 / 4 + 1) {
+    const auto idx = buckets.index(val);
+    EXPECT_LE(buckets.lower(idx), val);
+    EXPECT_GE(buckets.upper(idx), val);
+    EXPECT_LE(buckets.upper(idx) - buckets.lower(idx), val / 16);
+  }
+
+  nvsl::LogLinearHistogram a(100000000), b(100000000);
+  for (uint64_t i = 1; i <= 1000; i++) a.add(i * 100);
+  b.add(50000000, 10);
+  a.merge(b);
+
+  EXPECT_EQ(1010UL, a.total());
+  EXPECT_NEAR(50000, a.percentile(50), 50000 / 16);
+  EXPECT_EQ(50000000UL, a.percentile(100));
+  EXPECT_EQ(100UL, a.percentile(0));
+
+  const auto c = nvsl::LogLinearHistogram::deserialize(a.serialize());
+  EXPECT_EQ(a.total(), c.total());
+  EXPECT_EQ(a.percentile(99), c.percentile(99));
+}
+
+TEST(stats, freq_log_linear) {
+  nvsl::StatsFreq<size_t> lat(false), other(false);
+  lat.init_log_linear("lat", "Latency in ns", 100000000);
+  other.init_log_linear("other", "Latency in ns", 100000000);
+
+  for (size_t ns = 100; ns <= 100000; ns += 100) lat.add(ns);
+  other.add(1000000000, 3); /* Overflow */
+  lat.merge(other);
+
+  EXPECT_EQ(1003UL, lat.total());
+  EXPECT_EQ(3UL, lat.uoflow_count(false, true));
+  EXPECT_NEAR(50000, lat.percentile(50), 50000 / 16);
+  EXPECT_NE(std::string::npos, lat.str().find("lat.p99:"));
+}
+
+TEST(stats, sharded_counter) {
+  /* 2 private slots, the other 6 threads share one */
+  nvsl::ShardedCounter ops(false, 2);
+  ops.init("ops", "Operations");
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < 8; t++) {
+    threads.emplace_back([&ops]() {
+      for (size_t i = 0; i < 10000; i++) ++ops;
+      ops.add(5);
+    });
+  }
+  for (auto &t : threads) t.join();
+
+  EXPECT_EQ(8 * 10005UL, ops.value());
+  EXPECT_EQ("ops = 80040 # Operations", ops.str());
+
+  ops.reset();
+  EXPECT_EQ(0UL, ops.value());
+}
+
+TEST(stats, exporter_shm) {
+  using namespace std::chrono_literals;
+
+  const auto shm_name = "nvsl-test-stats-" + std::to_string(getpid());
+  nvsl::StatsExporterConfig cfg;
+  cfg.interval = 5ms;
+  cfg.dump_files = false;
+  cfg.shm_name = shm_name;
+
+  auto ops = std::make_unique<nvsl::Counter>();
+  ops->init("test_exporter.ops", "Operations");
+  *ops += 42;
+
+  nvsl::StatsCollection::start_exporter(cfg);
+
+  const int fd = shm_open(("/" + shm_name).c_str(), O_RDONLY, 0);
+  ASSERT_NE(-1, fd);
+  const auto *hdr = (const nvsl::StatsShmHeader *)mmap(
+      nullptr, sizeof(nvsl::StatsShmHeader) + 1024 * sizeof(nvsl::StatsShmEntry),
+      PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  ASSERT_NE(MAP_FAILED, (void *)hdr);
+
+  bool found = false;
+  for (int tries = 0; tries < 200 and not found; tries++) {
+    std::this_thread::sleep_for(5ms);
+
+    const auto seq = hdr->seq.load(std::memory_order_acquire);
+    if (seq == 0 or seq % 2 != 0) continue;
+
+    const auto *entries = (const nvsl::StatsShmEntry *)(hdr + 1);
+    for (size_t i = 0; i < hdr->count; i++) {
+      if (std::string(entries[i].name) == "test_exporter.ops") {
+        EXPECT_EQ((uint32_t)nvsl::StatsKind::counter, entries[i].kind);
+        EXPECT_EQ(42UL, entries[i].count);
+        found = true;
+      }
+    }
+  }
+  EXPECT_TRUE(found);
+  EXPECT_EQ(0, memcmp(hdr->magic, "NVSLSTAT", 8));
+  munmap((void *)hdr,
+         sizeof(nvsl::StatsShmHeader) + 1024 * sizeof(nvsl::StatsShmEntry));
+
+  /* Destroyed stats are no longer exported */
+  ops.reset();
+  nvsl::StatsCollection::stop_exporter();
+  EXPECT_EQ(-1, shm_open(("/" + shm_name).c_str(), O_RDONLY, 0));
+}
+
+TEST(stats, named_vector_handles) {
+  nvsl::StatsNamedVector phases(false);
+  phases.init("phases", "Time per phase");
+
+  const auto parse = phases.handle("parse");
+  auto &parse_ref = phases[parse];
+
+  for (int i = 0; i < 100; i++) phases.handle("other" + std::to_string(i));
+
+  phases[parse] += 10;
+  phases[std::string_view("parse")] += 20;
+  phases["exec"] += 5;
+
+  EXPECT_EQ(&parse_ref, &phases[parse]);
+  EXPECT_EQ(parse.idx, phases.handle("parse").idx);
+  EXPECT_EQ(15, parse_ref.avg());
+  EXPECT_EQ(102UL, phases.size());
+  EXPECT_NE(std::string::npos, phases.str().find("phases.exec = 5"));
+}
+
+TEST(stats, export_while_writing) {
+  nvsl::StatsScalar lat;
+  lat.init("test_export_race.lat", "Latency", true, nvsl::time_unit::ns_unit,
+           true);
+  nvsl::StatsNamedVector phases;
+  phases.init("test_export_race.phases", "Time per phase");
+
+  /* The writer grows the sketch and the vector while the reader exports */
+  std::thread writer([&]() {
+    for (int i = 1; i <= 20000; i++) {
+      lat += i * 37 % 100000;
+      phases["p" + std::to_string(i % 50)] += i;
+    }
+  });
+
+  size_t exported = 0;
+  for (int i = 0; i < 200; i++) {
+    exported += nvsl::StatsCollection::snapshot().entries.size();
+  }
+  writer.join();
+
+  EXPECT_GT(exported, 0UL);
+  EXPECT_EQ(20000UL, lat.counts());
+  EXPECT_EQ(50UL, phases.size());
+}
+
+TEST(stats, scalar_quantiles) {
+  nvsl::StatsScalar lat(false), other(false);
+  lat.init("lat", "Latency", true, nvsl::time_unit::ns_unit, true);
+  other.init("lat", "Latency", true, nvsl::time_unit::ns_unit, true);
+
+  for (int i = 1; i <= 10000; i++) lat += i;
+  for (int i = 0; i < 100; i++) other += 1000000;
+  lat.merge(other);
+
+  EXPECT_EQ(10100UL, lat.counts());
+  EXPECT_NEAR(5050, lat.quantile(0.5), 5050 * 0.02);
+  EXPECT_NEAR(1000000, lat.quantile(0.999), 1000000 * 0.02);
+  EXPECT_NE(std::string::npos, lat.str().find("p99 = "));
+  EXPECT_NE(std::string::npos, lat.latex().find("statlatPNinetyNine"));
+
+  nvsl::QuantileSketch small(8); /* Collapses the lowest buckets */
+  for (int i = -10; i <= 100000; i++) small.add(i);
+  EXPECT_EQ(-10, std::round(small.quantile(0)));
+  EXPECT_NEAR(99000, small.quantile(0.99), 99000 * 0.02);
+}
+
+TEST(stats, snapshot_delta_export) {
+  nvsl::Counter reqs;
+  reqs.init("test_snapshot.reqs", "Requests");
+  nvsl::StatsScalar lat;
+  lat.init("test_snapshot.lat", "Latency", true, nvsl::time_unit::ns_unit,
+           true);
+
+  reqs += 10;
+  lat += 100;
+  const auto before = nvsl::StatsCollection::snapshot();
+
+  reqs += 5;
+  lat += 200;
+  lat += 300;
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  const auto delta = nvsl::StatsCollection::snapshot().delta(before);
+
+  const auto *reqs_e = delta.find("test_snapshot.reqs");
+  const auto *lat_e = delta.find("test_snapshot.lat");
+  ASSERT_NE(nullptr, reqs_e);
+  ASSERT_NE(nullptr, lat_e);
+
+  EXPECT_EQ(5UL, reqs_e->count);
+  EXPECT_EQ("Requests", reqs_e->desc);
+  EXPECT_EQ(2UL, lat_e->count);
+  EXPECT_EQ(250, lat_e->mean());
+  EXPECT_GT(delta.rate(*reqs_e), 0);
+  EXPECT_LT(delta.rate(*reqs_e), 5 / 0.01 + 1);
+
+  const auto prom = delta.prometheus();
+  EXPECT_NE(std::string::npos,
+            prom.find("# TYPE nvsl_test_snapshot_reqs gauge\n"
+                      "nvsl_test_snapshot_reqs 5\n"));
+  EXPECT_NE(std::string::npos,
+            prom.find("nvsl_test_snapshot_lat{quantile=\"0.99\"}"));
+  EXPECT_NE(std::string::npos,
+            prom.find("# TYPE nvsl_test_snapshot_lat_count gauge\n"
+                      "nvsl_test_snapshot_lat_count 2\n"));
+
+  /* Cumulative snapshots keep the monotonic types */
+  const auto cumulative = nvsl::StatsCollection::snapshot().prometheus();
+  EXPECT_NE(std::string::npos,
+            cumulative.find("# TYPE nvsl_test_snapshot_reqs counter\n"
+                            "nvsl_test_snapshot_reqs 15\n"));
+  EXPECT_NE(std::string::npos,
+            cumulative.find("# TYPE nvsl_test_snapshot_lat summary\n"));
+
+  EXPECT_NE(std::string::npos,
+            delta.json().find("{\"name\": \"test_snapshot.reqs\", \"desc\": "
+                              "\"Requests\", \"kind\": \"counter\", "
+                              "\"count\": 5"));
+  EXPECT_NE(std::string::npos,
+            delta.csv().find("\"test_snapshot.reqs\",counter,5,5,1,0,0,,,,,"));
+
+  nvsl::StatsSnapshot odd;
+  odd.entries.push_back({"test_snapshot.odd", "", nvsl::StatsKind::scalar, 1,
+                         NAN, INFINITY, -INFINITY});
+  EXPECT_NE(std::string::npos,
+            odd.json().find("\"sum\": null, \"mean\": null, \"min\": null, "
+                            "\"max\": null}"));
+}
+
+TEST(stats, export_uninitialized) {
+  using namespace std::chrono_literals;
+
+  nvsl::StatsExporterConfig cfg;
+  cfg.interval = 10ms;
+  cfg.dump_files = false;
+  nvsl::StatsCollection::start_exporter(cfg);
+
+  /* Not exported until init(), and readable before it */
+  nvsl::StatsFreq<> freq;
+  nvsl::StatsScalar lat;
+  std::this_thread::sleep_for(50ms);
+
+  EXPECT_EQ(0UL, freq.total());
+  EXPECT_EQ(0UL, freq.percentile(99));
+  EXPECT_NE(std::string::npos, freq.str().find(".sample_count: 0"));
+  EXPECT_EQ(nullptr, nvsl::StatsCollection::snapshot().find(""));
+
+  freq.init("test_uninit.freq", "Freq", 10, 0, 100);
+  freq.add(5);
+  std::this_thread::sleep_for(20ms);
+  nvsl::StatsCollection::stop_exporter();
+
+  const auto snap = nvsl::StatsCollection::snapshot();
+  const auto *entry = snap.find("test_uninit.freq");
+  ASSERT_NE(nullptr, entry);
+  EXPECT_EQ(1UL, entry->count);
+}
+
+TEST(stats, scalar_sharded) {
+  /* 2 private shards, the other threads take turns on the shared one */
+  nvsl::StatsScalar lat(false, 2);
+  lat.init("lat", "Latency", true, nvsl::time_unit::ns_unit, true);
+
+  std::atomic<bool> done = false;
+  std::thread reader([&]() {
+    size_t last = 0;
+    while (not done.load()) {
+      const auto cnt = lat.counts();
+      EXPECT_GE(cnt, last);
+      EXPECT_LE(lat.max(), 1000);
+      last = cnt;
+    }
+  });
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < 4; t++) {
+    threads.emplace_back([&lat]() {
+      for (int i = 1; i <= 10000; i++) lat += i % 1000 + 1;
+    });
+  }
+  for (auto &t : threads) t.join();
+  done = true;
+  reader.join();
+
+  EXPECT_EQ(40000UL, lat.counts());
+  EXPECT_EQ(1, lat.min());
+  EXPECT_EQ(1000, lat.max());
+  EXPECT_NEAR(500.5, lat.avg(), 0.01);
+  EXPECT_NEAR(500, lat.quantile(0.5), 500 * 0.02);
+
+  const auto copy = lat;
+  lat.reset();
+  EXPECT_EQ(0UL, lat.counts());
+  EXPECT_EQ(40000UL, copy.counts());
+  EXPECT_NEAR(990, copy.quantile(0.99), 990 * 0.02);
+}
+
+TEST(stats, stat_dump_interval_env) {
+  EXPECT_EQ(1000, nvsl::detail::stat_dump_interval().count());
+
+  setenv(NVSL_STAT_DUMP_INTERVAL_ENV, "250", 1);
+  EXPECT_EQ(250, nvsl::detail::stat_dump_interval().count());
+
+  setenv(NVSL_STAT_DUMP_INTERVAL_ENV, "1s", 1);
+  EXPECT_EXIT(nvsl::detail::stat_dump_interval(), testing::ExitedWithCode(1),
+              "Unable to parse NVSL_STAT_DUMP_INTERVAL");
+  unsetenv(NVSL_STAT_DUMP_INTERVAL_ENV);
+
+  /* The old sample count based period can't be mapped to an interval */
+  setenv(NVSL_STAT_DUMP_PERIOD_ENV, "16384", 1);
+  EXPECT_EXIT(nvsl::detail::stat_dump_interval(), testing::ExitedWithCode(1),
+              "NVSL_STAT_DUMP_PERIOD is no longer supported");
+  unsetenv(NVSL_STAT_DUMP_PERIOD_ENV);
+}
@@ -8,6 +8,9 @@
 
 #include <cstdlib>
 #include <iostream>
+#include <regex>
+#include <string_view>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "nvsl/string.hh"
@@ -20,3 +23,29 @@ TEST(string, split) {
   EXPECT_TRUE(toks[1] == "World.");
   
 }
+
+TEST(string, split_view) {
+  const std::string test_str = ",a,,bc,";
+  std::vector<std::string_view> toks;
+  for (const auto tok : nvsl::split_view(test_str, ",")) toks.push_back(tok);
+
+  ASSERT_EQ(toks.size(), 2UL);
+  EXPECT_EQ(toks[0], "a");
+  EXPECT_EQ(toks[1], "bc");
+  EXPECT_EQ(toks[0].data(), test_str.data() + 1);
+
+  EXPECT_EQ(nvsl::zip(nvsl::split_view(test_str, ","), "-"), "a-bc");
+  EXPECT_EQ(nvsl::zip(nvsl::split(test_str, ","), "-"), "a-bc");
+  EXPECT_EQ(nvsl::zip(nvsl::split_view("", ","), "-"), "");
+  EXPECT_EQ(nvsl::zip({"1", "2", "3"}, ", "), "1, 2, 3");
+}
+
+TEST(string, replace_all) {
+  EXPECT_EQ(nvsl::replace_all("a b  c", " ", "_"), "a_b__c");
+  EXPECT_EQ(nvsl::replace_all("a.b", ".", "[.]"), "a[.]b");
+  EXPECT_EQ(nvsl::replace_all("abc", "", "x"), "abc");
+
+  const std::regex digits("[0-9]+");
+  EXPECT_EQ(nvsl::replace("a12b3", digits, "#"), "a#b#");
+  EXPECT_EQ(nvsl::replace("a12b3", "[0-9]", "#"), "a##b#");
+}
@@ -0,0 +1,48 @@
+// -*- mode: c++; c-basic-offset: 2; -*-
+
+/**
+ * @file   test_waitpkg.cc
+ * @date   octobre 14, 2026
+ * @brief  Test the adaptive wait primitives
+ */
+
+#include <atomic>
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "nvsl/waitpkg.hh"
+
+TEST(waitpkg, wait_slot) {
+  nvsl::WaitSlot slot;
+  std::atomic<bool> ready = false;
+
+  /* Skip straight to the futex so the wakeup comes from notify() */
+  nvsl::WaitPolicy policy;
+  policy.spin_iters = policy.pause_iters = policy.umwait_cycles = 0;
+  policy.futex_timeout_ns = -1;
+
+  std::thread waiter(
+      [&]() { slot.wait_until([&]() { return ready.load(); }, policy); });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  ready = true;
+  slot.notify();
+  waiter.join();
+
+  EXPECT_TRUE(ready);
+}
+
+TEST(waitpkg, wait_until_polls) {
+  std::atomic<uint32_t> word = 0;
+
+  std::thread setter([&]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    word = 1;
+  });
+
+  /* Nobody wakes the futex up, the timeout re-checks the predicate */
+  nvsl::wait_until(&word, [&]() { return word.load() == 1; });
+  setter.join();
+
+  EXPECT_EQ(word, 1U);
+}